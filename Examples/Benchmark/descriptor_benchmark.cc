@@ -0,0 +1,149 @@
+//ORB描述子计算方式的性能测试和一致性检查
+//
+//用法：./descriptor_benchmark [图像文件]
+//在一幅模糊后的灰度图像（不给出时使用随机纹理）上随机生成1000和2000个特征点，分别用精确旋转方式、查找表加SIMD核函数、
+//查找表加标量核函数计算描述子，输出每个特征点的平均耗时（ns）。同时检查：
+//  - 查找表的SIMD核函数和标量核函数的结果逐字节相同；
+//  - 特征点方向为12度的整数倍（查找表角度区间的中心）时，查找表方式和精确方式的结果逐字节相同；
+//  - 任意方向时，查找表方式和精确方式之间的平均汉明距离（角度离散化带来的差别，只输出不检查）。
+//任何一项逐字节检查失败时程序返回非0
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "include/ORBextractor.h"
+
+using namespace std;
+using namespace ORB_SLAM2;
+
+//特征点到图像边界的最小距离，和ORBextractor中的EDGE_THRESHOLD相同
+const int EDGE_THRESHOLD=19;
+
+/**
+ * @brief 在图像中随机生成特征点
+ * @param[in] bSnapAngle 是否把方向取整到12度的整数倍
+ */
+static void RandomKeyPoints(const cv::Size &size,const int &N,const bool &bSnapAngle,mt19937 &rng,vector<cv::KeyPoint> &vKeys)
+{
+    uniform_real_distribution<float> distX((float)EDGE_THRESHOLD,(float)(size.width-EDGE_THRESHOLD-1));
+    uniform_real_distribution<float> distY((float)EDGE_THRESHOLD,(float)(size.height-EDGE_THRESHOLD-1));
+    uniform_real_distribution<float> distAngle(0.f,360.f);
+
+    vKeys.resize(N);
+    for (int i = 0; i < N; ++i)
+    {
+        float angle=distAngle(rng);
+        if(bSnapAngle)
+            angle=12.f*(float)((int)std::floor(angle/12.f+0.5f)%30);
+        vKeys[i]=cv::KeyPoint(distX(rng),distY(rng),31.f,angle);
+    }
+}
+
+//多次计算，返回最快一次每个特征点的耗时，单位ns
+static double TimeDescriptors(const cv::Mat &image,const vector<cv::KeyPoint> &vKeys,const int &method,cv::Mat &descriptors)
+{
+    const int nRepeats=50;
+    double best=1e30;
+    for (int r = 0; r < nRepeats; ++r)
+    {
+        chrono::steady_clock::time_point t1=chrono::steady_clock::now();
+        ORBextractor::ComputeDescriptors(image,vKeys,descriptors,method);
+        chrono::steady_clock::time_point t2=chrono::steady_clock::now();
+        best=std::min(best,chrono::duration_cast<chrono::duration<double,nano> >(t2-t1).count());
+    }
+    return best/vKeys.size();
+}
+
+//逐行比较两个描述子矩阵，返回不同的行数和平均汉明距离
+static int CompareDescriptors(const cv::Mat &a,const cv::Mat &b,double &meanHamming)
+{
+    int nDiff=0;
+    double sum=0;
+    for (int i = 0; i < a.rows; ++i)
+    {
+        if(memcmp(a.ptr<uchar>(i),b.ptr<uchar>(i),a.cols)!=0)
+        {
+            nDiff++;
+            sum+=cv::norm(a.row(i),b.row(i),cv::NORM_HAMMING);
+        }
+    }
+    meanHamming=a.rows>0? sum/a.rows : 0;
+    return nDiff;
+}
+
+int main(int argc, char **argv)
+{
+    cv::Mat image;
+    if(argc>1)
+    {
+        image=cv::imread(argv[1],CV_LOAD_IMAGE_GRAYSCALE);
+        if(image.empty())
+        {
+            cerr<<"Failed to read "<<argv[1]<<endl;
+            return 1;
+        }
+    }
+    else
+    {
+        image.create(480,640,CV_8UC1);
+        cv::randu(image,0,256);
+    }
+    //和提取器一样，在模糊后的图像上计算描述子
+    cv::GaussianBlur(image,image,cv::Size(7,7),2,2,cv::BORDER_REFLECT_101);
+
+    cout<<"image "<<image.cols<<"x"<<image.rows<<endl;
+    cout<<endl<<"keypoints  exact(ns)    lut(ns)  scalar(ns)  lut==scalar  snapped exact==lut  exact vs lut hamming"<<endl;
+
+    mt19937 rng(42);
+    const int vN[]={1000,2000};
+    int nFailed=0;
+    for (int t = 0; t < 2; ++t)
+    {
+        const int N=vN[t];
+        vector<cv::KeyPoint> vKeys,vSnapped;
+        RandomKeyPoints(image.size(),N,false,rng,vKeys);
+        RandomKeyPoints(image.size(),N,true,rng,vSnapped);
+
+        cv::Mat exact,lut,scalar;
+        const double tExact=TimeDescriptors(image,vKeys,ORBextractor::DESCRIPTOR_EXACT,exact);
+        const double tLUT=TimeDescriptors(image,vKeys,ORBextractor::DESCRIPTOR_LUT,lut);
+        const double tScalar=TimeDescriptors(image,vKeys,ORBextractor::DESCRIPTOR_LUT_SCALAR,scalar);
+
+        double meanHamming=0,dummy=0;
+        const int nDiffScalar=CompareDescriptors(lut,scalar,dummy);
+        CompareDescriptors(exact,lut,meanHamming);
+
+        cv::Mat snappedExact,snappedLUT;
+        ORBextractor::ComputeDescriptors(image,vSnapped,snappedExact,ORBextractor::DESCRIPTOR_EXACT);
+        ORBextractor::ComputeDescriptors(image,vSnapped,snappedLUT,ORBextractor::DESCRIPTOR_LUT);
+        const int nDiffSnapped=CompareDescriptors(snappedExact,snappedLUT,dummy);
+
+        if(nDiffScalar>0)
+            nFailed++;
+        if(nDiffSnapped>0)
+            nFailed++;
+
+        cout<<setw(9)<<N
+            <<fixed<<setprecision(1)
+            <<setw(11)<<tExact
+            <<setw(11)<<tLUT
+            <<setw(12)<<tScalar
+            <<setw(13)<<(nDiffScalar==0? "same" : "DIFFERENT")
+            <<setw(20)<<(nDiffSnapped==0? "same" : "DIFFERENT")
+            <<setprecision(2)
+            <<setw(22)<<meanHamming<<endl;
+    }
+
+    return nFailed==0? 0 : 2;
+}
@@ -0,0 +1,351 @@
+//四叉树特征点分配的性能测试和一致性检查
+//
+//用法：./distribute_benchmark
+//在VGA（640x480，1个初始节点）和KITTI（1241x376，3个初始节点）大小的区域中生成5000到50000个均匀分布或者成簇分布的特征点，
+//分别用ORBextractor::DistributeOctTree（扁平数组实现）和原来基于std::list的实现分配1000个特征点，
+//输出两者的耗时（多次运行取最快的一次），并逐个比较两者选出的特征点。任何一组结果不一致时程序返回非0。
+//这里的std::list实现保留了原来的结构，只加上了扁平实现中的几处修正，这样两者的结果应该完全相同：
+//DivideNode中n2右下角的坐标和y方向的划分线、宽高比小于0.5时至少一个初始节点、特征点数目相同的节点按创建顺序排序
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <list>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "include/ORBextractor.h"
+
+using namespace std;
+using namespace ORB_SLAM2;
+
+//原来的提取器节点，每个节点保存自己的特征点
+struct ListNode
+{
+    ListNode():bNoMore(false),nId(0){}
+
+    vector<cv::KeyPoint> vKeys;
+    cv::Point2i UL,UR,BL,BR;
+    list<ListNode>::iterator lit;
+    bool bNoMore;
+    int nId;            //节点的创建顺序，排序时代替原来的指针地址
+};
+
+//原来的DivideNode，修正了n2的右下角和y方向的划分线
+static void DivideListNode(const ListNode &node,ListNode &n1,ListNode &n2,ListNode &n3,ListNode &n4)
+{
+    const int halfX=ceil(static_cast<float>(node.UR.x-node.UL.x)/2);
+    const int halfY=ceil(static_cast<float>(node.BR.y-node.UL.y)/2);
+
+    n1.UL=node.UL;
+    n1.UR=cv::Point2i(node.UL.x+halfX,node.UL.y);
+    n1.BL=cv::Point2i(node.UL.x,node.UL.y+halfY);
+    n1.BR=cv::Point2i(node.UL.x+halfX,node.UL.y+halfY);
+    n1.vKeys.reserve(node.vKeys.size());
+
+    n2.UL=n1.UR;
+    n2.UR=node.UR;
+    n2.BL=n1.BR;
+    n2.BR=cv::Point2i(node.UR.x,node.UL.y+halfY);
+    n2.vKeys.reserve(node.vKeys.size());
+
+    n3.UL=n1.BL;
+    n3.UR=n1.BR;
+    n3.BL=node.BL;
+    n3.BR=cv::Point2i(n1.BR.x,node.BL.y);
+    n3.vKeys.reserve(node.vKeys.size());
+
+    n4.UL=n3.UR;
+    n4.UR=n2.BR;
+    n4.BL=n3.BR;
+    n4.BR=node.BR;
+    n4.vKeys.reserve(node.vKeys.size());
+
+    for(size_t i=0;i<node.vKeys.size();++i)
+    {
+        const cv::KeyPoint &kp=node.vKeys[i];
+        if(kp.pt.x<n1.UR.x)
+        {
+            if(kp.pt.y<n1.BR.y)
+                n1.vKeys.push_back(kp);
+            else
+                n3.vKeys.push_back(kp);
+        }
+        else
+        {
+            if(kp.pt.y<n1.BR.y)
+                n2.vKeys.push_back(kp);
+            else
+                n4.vKeys.push_back(kp);
+        }
+    }
+
+    n1.bNoMore=(n1.vKeys.size()==1);
+    n2.bNoMore=(n2.vKeys.size()==1);
+    n3.bNoMore=(n3.vKeys.size()==1);
+    n4.bNoMore=(n4.vKeys.size()==1);
+}
+
+//把分裂得到的非空子节点push_front到链表中，可以继续分裂的子节点记录到vSizeAndNode中，返回可以继续分裂的子节点个数
+static int AddChildren(ListNode* vChildren,list<ListNode> &lNodes,int &nNextId,vector<pair<int,ListNode*> > &vSizeAndNode)
+{
+    int nToExpand=0;
+    for(int q=0;q<4;q++)
+    {
+        if(vChildren[q].vKeys.empty())
+            continue;
+        vChildren[q].nId=nNextId++;
+        lNodes.push_front(vChildren[q]);
+        if(vChildren[q].vKeys.size()>1)
+        {
+            nToExpand++;
+            vSizeAndNode.push_back(make_pair((int)vChildren[q].vKeys.size(),&lNodes.front()));
+            lNodes.front().lit=lNodes.begin();
+        }
+    }
+    return nToExpand;
+}
+
+//原来基于std::list的DistributeOctTree
+static void DistributeList(const vector<cv::KeyPoint> &vToDistributeKeys,const int &minX,const int &maxX,const int &minY,const int &maxY,
+                           const int &N,vector<cv::KeyPoint> &vResultKeys)
+{
+    vResultKeys.clear();
+    if(vToDistributeKeys.empty())
+        return;
+
+    const int nIni=std::max(1,(int)round(static_cast<float>(maxX-minX)/(maxY-minY)));
+    const float hX=static_cast<float>(maxX-minX)/nIni;
+
+    list<ListNode> lNodes;
+    vector<ListNode*> vpIniNodes(nIni);
+    int nNextId=0;
+    for(int i=0;i<nIni;i++)
+    {
+        ListNode ni;
+        ni.UL=cv::Point2i(hX*static_cast<float>(i),0);
+        ni.UR=cv::Point2i(hX*static_cast<float>(i+1),0);
+        ni.BL=cv::Point2i(ni.UL.x,maxY-minY);
+        ni.BR=cv::Point2i(ni.UR.x,maxY-minY);
+        ni.vKeys.reserve(vToDistributeKeys.size());
+        ni.nId=nNextId++;
+        lNodes.push_back(ni);
+        vpIniNodes[i]=&lNodes.back();
+    }
+
+    for(size_t i=0;i<vToDistributeKeys.size();i++)
+    {
+        const cv::KeyPoint &kp=vToDistributeKeys[i];
+        vpIniNodes[std::min((int)(kp.pt.x/hX),nIni-1)]->vKeys.push_back(kp);
+    }
+
+    list<ListNode>::iterator lit=lNodes.begin();
+    while(lit!=lNodes.end())
+    {
+        if(lit->vKeys.size()==1)
+        {
+            lit->bNoMore=true;
+            lit++;
+        }
+        else if(lit->vKeys.empty())
+            lit=lNodes.erase(lit);
+        else
+            lit++;
+    }
+
+    //数目相同的节点按创建顺序排序
+    auto compare=[](const pair<int,ListNode*> &a,const pair<int,ListNode*> &b){
+        if(a.first!=b.first)
+            return a.first<b.first;
+        return a.second->nId<b.second->nId;
+    };
+
+    bool bFinish=false;
+    vector<pair<int,ListNode*> > vSizeAndPointerToNode;
+    vSizeAndPointerToNode.reserve(lNodes.size()*4);
+
+    while(!bFinish)
+    {
+        int prevSize=lNodes.size();
+        lit=lNodes.begin();
+        int nToExpand=0;
+        vSizeAndPointerToNode.clear();
+
+        while(lit!=lNodes.end())
+        {
+            if(lit->bNoMore)
+            {
+                lit++;
+                continue;
+            }
+            ListNode n[4];
+            DivideListNode(*lit,n[0],n[1],n[2],n[3]);
+            nToExpand+=AddChildren(n,lNodes,nNextId,vSizeAndPointerToNode);
+            lit=lNodes.erase(lit);
+        }
+
+        if((int)lNodes.size()>=N || (int)lNodes.size()==prevSize)
+        {
+            bFinish=true;
+        }
+        else if(((int)lNodes.size()+nToExpand*3)>N)
+        {
+            while(!bFinish)
+            {
+                prevSize=lNodes.size();
+                vector<pair<int,ListNode*> > vPrevSizeAndPointerToNode=vSizeAndPointerToNode;
+                vSizeAndPointerToNode.clear();
+
+                sort(vPrevSizeAndPointerToNode.begin(),vPrevSizeAndPointerToNode.end(),compare);
+                for(int j=(int)vPrevSizeAndPointerToNode.size()-1;j>=0;j--)
+                {
+                    ListNode n[4];
+                    DivideListNode(*vPrevSizeAndPointerToNode[j].second,n[0],n[1],n[2],n[3]);
+                    AddChildren(n,lNodes,nNextId,vSizeAndPointerToNode);
+                    lNodes.erase(vPrevSizeAndPointerToNode[j].second->lit);
+                    if((int)lNodes.size()>=N)
+                        break;
+                }
+
+                if((int)lNodes.size()>=N || (int)lNodes.size()==prevSize)
+                    bFinish=true;
+            }
+        }
+    }
+
+    vResultKeys.reserve(lNodes.size());
+    for(list<ListNode>::iterator lit=lNodes.begin();lit!=lNodes.end();lit++)
+    {
+        vector<cv::KeyPoint> &vNodeKeys=lit->vKeys;
+        cv::KeyPoint* pKP=&vNodeKeys[0];
+        float maxResponse=pKP->response;
+        for(size_t i=1;i<vNodeKeys.size();i++)
+        {
+            if(vNodeKeys[i].response>maxResponse)
+            {
+                pKP=&vNodeKeys[i];
+                maxResponse=vNodeKeys[i].response;
+            }
+        }
+        vResultKeys.push_back(*pKP);
+    }
+}
+
+//只有一层的提取器，把受保护的DistributeOctTree公开出来
+class OctTreeExtractor : public ORBextractor
+{
+public:
+    OctTreeExtractor(int nfeatures):ORBextractor(nfeatures,1.2f,1,20,7){}
+    using ORBextractor::DistributeOctTree;
+};
+
+/**
+ * @brief 生成待分配的特征点，坐标相对于区域的左上角
+ * @param[in] bClustered 为true时特征点集中在若干个小区域中，四叉树会分裂得更深
+ */
+static void RandomKeyPoints(const int &width,const int &height,const int &n,const bool &bClustered,mt19937 &rng,vector<cv::KeyPoint> &vKeys)
+{
+    uniform_real_distribution<float> distX(0.f,(float)width);
+    uniform_real_distribution<float> distY(0.f,(float)height);
+    normal_distribution<float> distCluster(0.f,12.f);
+    //响应值取整数，制造响应值相同的情况
+    uniform_int_distribution<int> distResponse(7,80);
+
+    vector<cv::Point2f> vCenters(20);
+    for (size_t i = 0; i < vCenters.size(); ++i)
+        vCenters[i]=cv::Point2f(distX(rng),distY(rng));
+
+    vKeys.resize(n);
+    for (int i = 0; i < n; ++i)
+    {
+        float x,y;
+        if(bClustered)
+        {
+            const cv::Point2f &c=vCenters[rng()%vCenters.size()];
+            x=std::min(std::max(c.x+distCluster(rng),0.f),(float)width-1);
+            y=std::min(std::max(c.y+distCluster(rng),0.f),(float)height-1);
+        }
+        else
+        {
+            x=std::min(distX(rng),(float)width-1);
+            y=std::min(distY(rng),(float)height-1);
+        }
+        vKeys[i]=cv::KeyPoint(x,y,7.f,-1,(float)distResponse(rng),0);
+    }
+}
+
+static bool SameKeyPoints(const vector<cv::KeyPoint> &a,const vector<cv::KeyPoint> &b)
+{
+    if(a.size()!=b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if(a[i].pt.x!=b[i].pt.x || a[i].pt.y!=b[i].pt.y || a[i].response!=b[i].response)
+            return false;
+    }
+    return true;
+}
+
+int main()
+{
+    const int nFeatures=1000;
+    const int nRepeats=5;
+    const int vPoints[]={5000,10000,20000,50000};
+    const cv::Size vRegions[]={cv::Size(640,480),cv::Size(1241,376)};
+
+    OctTreeExtractor extractor(nFeatures);
+    mt19937 rng(7);
+    int nFailed=0;
+
+    cout<<"  region  points  distribution   list(ms)   flat(ms)  speedup  kept  result"<<endl;
+    for (int r = 0; r < 2; ++r)
+    {
+        const cv::Size &region=vRegions[r];
+        for (int c = 0; c < 2; ++c)
+        {
+            const bool bClustered=(c==1);
+            for (int p = 0; p < 4; ++p)
+            {
+                vector<cv::KeyPoint> vKeys,vListResult,vFlatResult;
+                RandomKeyPoints(region.width,region.height,vPoints[p],bClustered,rng,vKeys);
+
+                double tList=1e30,tFlat=1e30;
+                for (int k = 0; k < nRepeats; ++k)
+                {
+                    chrono::steady_clock::time_point t1=chrono::steady_clock::now();
+                    DistributeList(vKeys,0,region.width,0,region.height,nFeatures,vListResult);
+                    chrono::steady_clock::time_point t2=chrono::steady_clock::now();
+                    extractor.DistributeOctTree(vKeys,0,region.width,0,region.height,nFeatures,0,vFlatResult);
+                    chrono::steady_clock::time_point t3=chrono::steady_clock::now();
+                    tList=std::min(tList,chrono::duration_cast<chrono::duration<double,milli> >(t2-t1).count());
+                    tFlat=std::min(tFlat,chrono::duration_cast<chrono::duration<double,milli> >(t3-t2).count());
+                }
+
+                const bool bSame=SameKeyPoints(vListResult,vFlatResult);
+                if(!bSame)
+                    nFailed++;
+
+                stringstream ss;
+                ss<<region.width<<"x"<<region.height;
+                cout<<setw(8)<<ss.str()
+                    <<setw(8)<<vPoints[p]
+                    <<setw(14)<<(bClustered? "clustered" : "uniform")
+                    <<fixed<<setprecision(3)
+                    <<setw(11)<<tList
+                    <<setw(11)<<tFlat
+                    <<setprecision(2)
+                    <<setw(9)<<tList/tFlat
+                    <<setw(6)<<vFlatResult.size()
+                    <<"  "<<(bSame? "same" : "MISMATCH")<<endl;
+            }
+        }
+    }
+
+    return nFailed==0? 0 : 2;
+}
@@ -0,0 +1,161 @@
+//描述子汉明距离（DBoW2::FORB::distance）的性能测试和一致性检查
+//
+//用法：./hamming_benchmark [描述子对数]
+//生成随机的ORB描述子，对当前CPU支持的每一种距离实现（SWAR、AVX2查表、popcnt、AVX-512 VPOPCNTQ、NEON）：
+//先检查结果和SWAR参考实现逐对完全一致，再测量每次距离计算的平均耗时。然后测量FORB::distance(cv::Mat)实际使用的实现，
+//以及词典树下降时使用的一对多FORB::distanceArgmin的各种实现。
+//任何一种实现和参考结果不一致时程序返回非0
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "Thirdparty/DBoW2/DBoW2/FORB.h"
+
+using namespace std;
+
+//测量kernel在所有描述子对上的平均耗时，单位ns。sum用于防止编译器把计算优化掉
+static double TimeKernel(DBoW2::FORB::DistanceKernel kernel,const cv::Mat &A,const cv::Mat &B,const int &nRepeats,long &sum)
+{
+    chrono::steady_clock::time_point t1=chrono::steady_clock::now();
+    for (int r = 0; r < nRepeats; ++r)
+    {
+        for (int i = 0; i < A.rows; ++i)
+            sum+=kernel(A.ptr<uchar>(i),B.ptr<uchar>(i));
+    }
+    chrono::steady_clock::time_point t2=chrono::steady_clock::now();
+    return chrono::duration_cast<chrono::duration<double,nano> >(t2-t1).count()/((double)nRepeats*A.rows);
+}
+
+int main(int argc, char **argv)
+{
+    const int N=argc>1? atoi(argv[1]) : 100000;
+    if(N<=0)
+    {
+        cerr<<endl<<"Usage: ./hamming_benchmark [number_of_pairs]"<<endl;
+        return 1;
+    }
+
+    //随机的描述子，前两对分别是全0对全1和完全相同，覆盖距离的两个极端
+    cv::Mat A(N,32,CV_8U),B(N,32,CV_8U);
+    cv::randu(A,cv::Scalar(0),cv::Scalar(256));
+    cv::randu(B,cv::Scalar(0),cv::Scalar(256));
+    A.row(0).setTo(cv::Scalar(0));
+    B.row(0).setTo(cv::Scalar(255));
+    if(N>1)
+        A.row(1).copyTo(B.row(1));
+
+    vector<DBoW2::FORB::DistanceKernel> vKernels;
+    vector<string> vNames;
+    DBoW2::FORB::availableDistanceKernels(vKernels,vNames);
+
+    //参考结果
+    vector<int> vReference(N);
+    for (int i = 0; i < N; ++i)
+        vReference[i]=vKernels[0](A.ptr<uchar>(i),B.ptr<uchar>(i));
+
+    //重复次数，使每种实现的测量时间在几十毫秒以上
+    const int nRepeats=std::max(1,2000000/N);
+
+    int nFailed=0;
+    long sum=0;
+    cout<<"kernel                      ns/pair   exact"<<endl;
+    for (size_t k = 0; k < vKernels.size(); ++k)
+    {
+        int nMismatch=0;
+        for (int i = 0; i < N; ++i)
+        {
+            if(vKernels[k](A.ptr<uchar>(i),B.ptr<uchar>(i))!=vReference[i])
+                nMismatch++;
+        }
+        if(nMismatch>0)
+            nFailed++;
+
+        const double t=TimeKernel(vKernels[k],A,B,nRepeats,sum);
+        cout<<left<<setw(26)<<vNames[k]<<right<<fixed<<setprecision(2)<<setw(9)<<t
+            <<"   "<<(nMismatch==0? "yes" : "NO")<<endl;
+    }
+
+    //FORB::distance(cv::Mat)，包括取行指针的开销，也是词典和匹配中实际的调用方式
+    {
+        vector<cv::Mat> vA(N),vB(N);
+        for (int i = 0; i < N; ++i)
+        {
+            vA[i]=A.row(i);
+            vB[i]=B.row(i);
+        }
+
+        int nMismatch=0;
+        chrono::steady_clock::time_point t1=chrono::steady_clock::now();
+        for (int r = 0; r < nRepeats; ++r)
+        {
+            for (int i = 0; i < N; ++i)
+            {
+                const int d=DBoW2::FORB::distance(vA[i],vB[i]);
+                sum+=d;
+                if(r==0 && d!=vReference[i])
+                    nMismatch++;
+            }
+        }
+        chrono::steady_clock::time_point t2=chrono::steady_clock::now();
+        if(nMismatch>0)
+            nFailed++;
+
+        const double t=chrono::duration_cast<chrono::duration<double,nano> >(t2-t1).count()/((double)nRepeats*N);
+        cout<<left<<setw(26)<<("FORB::distance("+vNames.back()+")")<<right<<fixed<<setprecision(2)<<setw(9)<<t
+            <<"   "<<(nMismatch==0? "yes" : "NO")<<endl;
+    }
+
+    //一对多的FORB::distanceArgmin：每个查询描述子和连续存放的K个描述子比较（和词典树下降时的分支数相同），
+    //结果（最小距离的位置和距离）要和逐个比较的参考结果完全一致
+    {
+        const int K=10;
+        const int nBlocks=N/K;
+
+        vector<DBoW2::FORB::ArgminKernel> vArgminKernels;
+        vector<string> vArgminNames;
+        DBoW2::FORB::availableArgminKernels(vArgminKernels,vArgminNames);
+
+        vector<int> vBest(nBlocks),vBestDist(nBlocks);
+        for (int b = 0; b < nBlocks; ++b)
+            vBest[b]=vArgminKernels[0](A.ptr<uchar>(b),B.ptr<uchar>(b*K),K,vBestDist[b]);
+
+        cout<<endl<<"argmin (k="<<K<<")                ns/child  exact"<<endl;
+        for (size_t k = 0; k < vArgminKernels.size(); ++k)
+        {
+            int nMismatch=0;
+            for (int b = 0; b < nBlocks; ++b)
+            {
+                int dist;
+                if(vArgminKernels[k](A.ptr<uchar>(b),B.ptr<uchar>(b*K),K,dist)!=vBest[b] || dist!=vBestDist[b])
+                    nMismatch++;
+            }
+            if(nMismatch>0)
+                nFailed++;
+
+            chrono::steady_clock::time_point t1=chrono::steady_clock::now();
+            for (int r = 0; r < nRepeats; ++r)
+            {
+                for (int b = 0; b < nBlocks; ++b)
+                {
+                    int dist;
+                    sum+=vArgminKernels[k](A.ptr<uchar>(b),B.ptr<uchar>(b*K),K,dist)+dist;
+                }
+            }
+            chrono::steady_clock::time_point t2=chrono::steady_clock::now();
+            const double t=chrono::duration_cast<chrono::duration<double,nano> >(t2-t1).count()/((double)nRepeats*nBlocks*K);
+            cout<<left<<setw(26)<<vArgminNames[k]<<right<<fixed<<setprecision(2)<<setw(9)<<t
+                <<"   "<<(nMismatch==0? "yes" : "NO")<<endl;
+        }
+    }
+
+    cout<<"checksum "<<sum<<endl;
+
+    return nFailed==0? 0 : 2;
+}
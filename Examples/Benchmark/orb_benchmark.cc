@@ -0,0 +1,575 @@
+//ORB特征点提取的性能测试和回归检查
+//
+//用法：./orb_benchmark 图像文件夹 golden文件夹 [record]
+//对图像文件夹中的所有图像（按文件名排序，以灰度图读入），在若干种配置（特征点数目、金字塔层数、线程数）下运行ORBextractor，
+//输出每种配置的吞吐量、单帧耗时的p50/p99以及每帧内部缓存的分配次数。
+//带record参数时，把单线程配置的特征点和描述子写入golden文件夹；其余情况与golden文件夹中已有的结果逐帧比较，
+//任何一帧的特征点或描述子不完全一致都会被报告，并且程序返回非0，用于确认优化没有改变提取结果。
+//之后输出几组对比测试：耗时统计开启和关闭时的单帧耗时（需要用-DORB_PROFILING编译），720p和1080p下融合金字塔和原始金字塔的耗时
+//以及缩放和模糊结果的偏差，双目批量提取和依次提取的耗时（结果不一致或者缩放、模糊偏差超过±1时同样返回非0）
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "include/ORBextractor.h"
+#include "include/ThreadPool.h"
+
+using namespace std;
+using namespace ORB_SLAM2;
+
+//金字塔每层图像的边界宽度，和ORBextractor中的EDGE_THRESHOLD相同
+const int EDGE_THRESHOLD=19;
+
+//一种测试配置
+struct BenchConfig
+{
+    int nFeatures;
+    int nLevels;
+    int nThreads;           //参与计算的线程数，1表示不使用线程池
+};
+
+//一帧的提取结果
+struct FrameResult
+{
+    vector<cv::KeyPoint> vKeys;
+    cv::Mat descriptors;
+};
+
+//配置对应的golden文件名。线程数不影响提取结果，所以不同线程数的配置共用同一个golden文件
+static string GetGoldenName(const BenchConfig &config)
+{
+    stringstream ss;
+    ss<<"orb_f"<<config.nFeatures<<"_l"<<config.nLevels<<".bin";
+    return ss.str();
+}
+
+//排好序的数组中的百分位数（最近秩法）
+static double Percentile(const vector<double> &vSorted,const double &p)
+{
+    if(vSorted.empty())
+        return 0;
+    int idx=(int)ceil(p*vSorted.size())-1;
+    idx=std::min(std::max(idx,0),(int)vSorted.size()-1);
+    return vSorted[idx];
+}
+
+/**
+ * @brief 把所有帧的结果写入golden文件
+ * @details 二进制格式，每一帧依次为：特征点数目N，描述子的列数，N个特征点(x,y,size,angle,response,octave)，N行描述子
+ */
+static bool WriteGolden(const string &filename,const vector<FrameResult> &vResults)
+{
+    ofstream f(filename.c_str(),ios::binary);
+    if(!f.is_open())
+        return false;
+
+    const int nFrames=(int)vResults.size();
+    f.write((const char*)&nFrames,sizeof(int));
+    for (int i = 0; i < nFrames; ++i)
+    {
+        const FrameResult &result=vResults[i];
+        const int N=(int)result.vKeys.size();
+        const int nCols=result.descriptors.cols;
+        f.write((const char*)&N,sizeof(int));
+        f.write((const char*)&nCols,sizeof(int));
+        for (int k = 0; k < N; ++k)
+        {
+            const cv::KeyPoint &kp=result.vKeys[k];
+            const float data[5]={kp.pt.x,kp.pt.y,kp.size,kp.angle,kp.response};
+            f.write((const char*)data,sizeof(data));
+            f.write((const char*)&kp.octave,sizeof(int));
+        }
+        for (int k = 0; k < N; ++k)
+        {
+            f.write((const char*)result.descriptors.ptr<uchar>(k),nCols);
+        }
+    }
+    return f.good();
+}
+
+//读取WriteGolden写入的文件
+static bool ReadGolden(const string &filename,vector<FrameResult> &vResults)
+{
+    ifstream f(filename.c_str(),ios::binary);
+    if(!f.is_open())
+        return false;
+
+    int nFrames=0;
+    f.read((char*)&nFrames,sizeof(int));
+    if(!f || nFrames<0)
+        return false;
+
+    vResults.resize(nFrames);
+    for (int i = 0; i < nFrames; ++i)
+    {
+        FrameResult &result=vResults[i];
+        int N=0,nCols=0;
+        f.read((char*)&N,sizeof(int));
+        f.read((char*)&nCols,sizeof(int));
+        if(!f || N<0 || nCols<0)
+            return false;
+
+        result.vKeys.resize(N);
+        for (int k = 0; k < N; ++k)
+        {
+            float data[5];
+            int octave;
+            f.read((char*)data,sizeof(data));
+            f.read((char*)&octave,sizeof(int));
+            result.vKeys[k]=cv::KeyPoint(data[0],data[1],data[2],data[3],data[4],octave);
+        }
+        result.descriptors.create(N,nCols,CV_8U);
+        for (int k = 0; k < N; ++k)
+        {
+            f.read((char*)result.descriptors.ptr<uchar>(k),nCols);
+        }
+    }
+    return (bool)f;
+}
+
+/**
+ * @brief 比较一帧的结果和golden结果是否完全一致
+ * @param[out] reason 不一致时的说明
+ */
+static bool CompareFrame(const FrameResult &result,const FrameResult &golden,string &reason)
+{
+    stringstream ss;
+    if(result.vKeys.size()!=golden.vKeys.size())
+    {
+        ss<<"keypoint count "<<result.vKeys.size()<<" vs golden "<<golden.vKeys.size();
+        reason=ss.str();
+        return false;
+    }
+    if(!result.vKeys.empty() && result.descriptors.cols!=golden.descriptors.cols)
+    {
+        ss<<"descriptor size "<<result.descriptors.cols<<" vs golden "<<golden.descriptors.cols;
+        reason=ss.str();
+        return false;
+    }
+
+    for (size_t k = 0; k < result.vKeys.size(); ++k)
+    {
+        const cv::KeyPoint &kp=result.vKeys[k];
+        const cv::KeyPoint &gkp=golden.vKeys[k];
+        if(kp.pt.x!=gkp.pt.x || kp.pt.y!=gkp.pt.y || kp.octave!=gkp.octave ||
+           kp.size!=gkp.size || kp.angle!=gkp.angle || kp.response!=gkp.response)
+        {
+            ss<<"keypoint "<<k<<" ("<<kp.pt.x<<","<<kp.pt.y<<",o"<<kp.octave<<",a"<<kp.angle<<")"
+              <<" vs golden ("<<gkp.pt.x<<","<<gkp.pt.y<<",o"<<gkp.octave<<",a"<<gkp.angle<<")";
+            reason=ss.str();
+            return false;
+        }
+        if(memcmp(result.descriptors.ptr<uchar>((int)k),golden.descriptors.ptr<uchar>((int)k),result.descriptors.cols)!=0)
+        {
+            ss<<"descriptor "<<k<<" differs (hamming "
+              <<cv::norm(result.descriptors.row((int)k),golden.descriptors.row((int)k),cv::NORM_HAMMING)<<")";
+            reason=ss.str();
+            return false;
+        }
+    }
+    return true;
+}
+
+//对所有帧提取一遍，返回平均单帧耗时，单位ms
+static double MeanFrameTime(ORBextractor &extractor,const vector<cv::Mat> &vImages)
+{
+    vector<cv::KeyPoint> vKeys;
+    cv::Mat descriptors;
+    chrono::steady_clock::time_point t1=chrono::steady_clock::now();
+    for (size_t i = 0; i < vImages.size(); ++i)
+    {
+        extractor(vImages[i],cv::Mat(),vKeys,descriptors);
+    }
+    chrono::steady_clock::time_point t2=chrono::steady_clock::now();
+    return chrono::duration_cast<chrono::duration<double,milli> >(t2-t1).count()/vImages.size();
+}
+
+/**
+ * @brief 耗时统计本身的开销：同一个提取器交替关闭和开启统计，各取多轮中最快的一轮比较
+ * @details 统计只有定义了ORB_PROFILING才会编译进提取器，否则只输出提示
+ */
+static void CompareProfiling(const vector<cv::Mat> &vImages,const float &fScaleFactor,const int &nIniThFAST,const int &nMinThFAST)
+{
+    cout<<endl<<"profiling overhead"<<endl;
+#ifdef ORB_PROFILING
+    const int vFeatures[]={1000,2000};
+    const int nRounds=5;
+    cout<<"features   off(ms)    on(ms)  overhead"<<endl;
+    for (int f = 0; f < 2; ++f)
+    {
+        ORBextractor extractor(vFeatures[f],fScaleFactor,8,nIniThFAST,nMinThFAST,vImages[0].size());
+        MeanFrameTime(extractor,vImages);
+
+        double tOff=1e30,tOn=1e30;
+        for (int r = 0; r < nRounds; ++r)
+        {
+            extractor.SetProfiling(false);
+            tOff=std::min(tOff,MeanFrameTime(extractor,vImages));
+            extractor.SetProfiling(true);
+            tOn=std::min(tOn,MeanFrameTime(extractor,vImages));
+        }
+        cout<<setw(8)<<vFeatures[f]
+            <<fixed<<setprecision(3)
+            <<setw(10)<<tOff
+            <<setw(10)<<tOn
+            <<setprecision(2)
+            <<setw(9)<<100.0*(tOn-tOff)/tOff<<"%"<<endl;
+    }
+#else
+    (void)vImages;(void)fScaleFactor;(void)nIniThFAST;(void)nMinThFAST;
+    cout<<"not compiled in, rebuild with -DORB_PROFILING to compare"<<endl;
+#endif
+}
+
+/**
+ * @brief 融合的金字塔构建方式和原始方式（resize、copyMakeBorder、GaussianBlur）的对比
+ * @details 把所有帧缩放到1280x720和1920x1080，两个提取器都使用精确描述子方式，这样原始方式会模糊整层图像，
+ * 两者只有金字塔和模糊的做法不同。输出单帧耗时，以及各层缩放结果、模糊结果和参考结果的最大偏差和不同像素的比例。
+ * 缩放的参考结果是原始方式的各层图像。融合方式按标量公式舍入，而OpenCV的SIMD实现先把中间结果右移再分别舍入，
+ * 两者在部分像素上差1，所以FAST看到的像素和原始方式也不完全相同。模糊的参考结果是对原始方式的每层图像按BORDER_REFLECT_101
+ * 补边后做GaussianBlur，融合方式的模糊是定点运算。两者都允许±1的偏差
+ * @return 缩放和模糊偏差都不超过1
+ */
+static bool CompareFusedPyramid(const vector<cv::Mat> &vImages,const float &fScaleFactor,const int &nIniThFAST,const int &nMinThFAST)
+{
+    cout<<endl<<"fused vs classic pyramid"<<endl;
+    cout<<"    size  classic(ms)  fused(ms)  speedup  resize max|diff|  resize diff pixels  blur max|diff|  blur diff pixels"<<endl;
+
+    const cv::Size vSizes[]={cv::Size(1280,720),cv::Size(1920,1080)};
+    bool bOk=true;
+    for (int s = 0; s < 2; ++s)
+    {
+        const cv::Size &size=vSizes[s];
+        vector<cv::Mat> vScaled(vImages.size());
+        for (size_t i = 0; i < vImages.size(); ++i)
+        {
+            cv::resize(vImages[i],vScaled[i],size,0,0,cv::INTER_LINEAR);
+        }
+
+        ORBextractor classic(1000,fScaleFactor,8,nIniThFAST,nMinThFAST,size);
+        ORBextractor fused(1000,fScaleFactor,8,nIniThFAST,nMinThFAST,size);
+        classic.SetExactDescriptors(true);
+        fused.SetExactDescriptors(true);
+        fused.SetFusedPyramid(true);
+        MeanFrameTime(classic,vScaled);
+        MeanFrameTime(fused,vScaled);
+        const double tClassic=MeanFrameTime(classic,vScaled);
+        const double tFused=MeanFrameTime(fused,vScaled);
+
+        //逐帧比较各层的缩放结果和模糊结果
+        double maxResizeDiff=0,maxDiff=0;
+        long nResizeDiffPixels=0,nDiffPixels=0,nPixels=0;
+        vector<cv::KeyPoint> vKeys;
+        cv::Mat descriptors,bordered,reference,diff;
+        for (size_t i = 0; i < vScaled.size(); ++i)
+        {
+            classic(vScaled[i],cv::Mat(),vKeys,descriptors);
+            fused(vScaled[i],cv::Mat(),vKeys,descriptors);
+            const vector<cv::Mat> vBlur=fused.GetBlurPyramid();
+            for (int level = 0; level < classic.GetLevels(); ++level)
+            {
+                const cv::Mat &imClassic=classic.mvImagePyramid[level];
+                cv::absdiff(imClassic,fused.mvImagePyramid[level],diff);
+                maxResizeDiff=std::max(maxResizeDiff,cv::norm(diff,cv::NORM_INF));
+                nResizeDiffPixels+=cv::countNonZero(diff);
+
+                cv::copyMakeBorder(imClassic,bordered,EDGE_THRESHOLD,EDGE_THRESHOLD,EDGE_THRESHOLD,EDGE_THRESHOLD,cv::BORDER_REFLECT_101);
+                cv::GaussianBlur(bordered,reference,cv::Size(7,7),2,2,cv::BORDER_REFLECT_101);
+                cv::absdiff(reference(cv::Rect(EDGE_THRESHOLD,EDGE_THRESHOLD,imClassic.cols,imClassic.rows)),vBlur[level],diff);
+                maxDiff=std::max(maxDiff,cv::norm(diff,cv::NORM_INF));
+                nDiffPixels+=cv::countNonZero(diff);
+                nPixels+=(long)diff.total();
+            }
+        }
+        bOk=bOk && maxResizeDiff<=1 && maxDiff<=1;
+
+        stringstream ss;
+        ss<<size.width<<"x"<<size.height;
+        cout<<setw(9)<<ss.str()
+            <<fixed<<setprecision(3)
+            <<setw(13)<<tClassic
+            <<setw(11)<<tFused
+            <<setprecision(2)
+            <<setw(9)<<tClassic/tFused
+            <<setprecision(0)
+            <<setw(18)<<maxResizeDiff
+            <<setprecision(3)
+            <<setw(19)<<100.0*nResizeDiffPixels/std::max(nPixels,1L)<<"%"
+            <<setprecision(0)
+            <<setw(16)<<maxDiff
+            <<setprecision(3)
+            <<setw(17)<<100.0*nDiffPixels/std::max(nPixels,1L)<<"%"<<endl;
+    }
+    return bOk;
+}
+
+/**
+ * @brief 双目情况下批量提取和依次提取的对比
+ * @details 相邻两帧作为左右图像，每幅图像使用自己的提取器。依次提取时两个提取器先后在同一个线程池上运行，
+ * 批量提取时用ExtractBatch把两幅图像的任务合并。两种方式的结果应该完全一致
+ * @return 结果是否一致
+ */
+static bool CompareBatch(const vector<cv::Mat> &vImages,const int &nThreads,const float &fScaleFactor,const int &nIniThFAST,const int &nMinThFAST)
+{
+    cout<<endl<<"stereo batch vs sequential, "<<nThreads<<" threads"<<endl;
+    if(vImages.size()<2)
+    {
+        cout<<"needs at least 2 frames"<<endl;
+        return true;
+    }
+
+    const int vFeatures[]={1000,2000};
+    bool bSame=true;
+    cout<<"features  sequential(ms)  batch(ms)  speedup  result"<<endl;
+    for (int f = 0; f < 2; ++f)
+    {
+        ThreadPool threadPool(nThreads);
+        ORBextractor left(vFeatures[f],fScaleFactor,8,nIniThFAST,nMinThFAST,vImages[0].size());
+        ORBextractor right(vFeatures[f],fScaleFactor,8,nIniThFAST,nMinThFAST,vImages[0].size());
+        left.SetThreadPool(&threadPool);
+        right.SetThreadPool(&threadPool);
+        vector<ORBextractor*> vpExtractors;
+        vpExtractors.push_back(&left);
+        vpExtractors.push_back(&right);
+
+        const size_t nPairs=vImages.size()-1;
+        vector<FrameResult> vSequential(2*nPairs),vBatch(2*nPairs);
+        vector<cv::Mat> vPair(2);
+        vector<vector<cv::KeyPoint> > vvKeys;
+        vector<cv::Mat> vDescriptors;
+
+        //预热
+        left(vImages[0],cv::Mat(),vSequential[0].vKeys,vSequential[0].descriptors);
+        right(vImages[1],cv::Mat(),vSequential[1].vKeys,vSequential[1].descriptors);
+
+        chrono::steady_clock::time_point t1=chrono::steady_clock::now();
+        for (size_t i = 0; i < nPairs; ++i)
+        {
+            left(vImages[i],cv::Mat(),vSequential[2*i].vKeys,vSequential[2*i].descriptors);
+            right(vImages[i+1],cv::Mat(),vSequential[2*i+1].vKeys,vSequential[2*i+1].descriptors);
+        }
+        chrono::steady_clock::time_point t2=chrono::steady_clock::now();
+        for (size_t i = 0; i < nPairs; ++i)
+        {
+            vPair[0]=vImages[i];
+            vPair[1]=vImages[i+1];
+            ORBextractor::ExtractBatch(vpExtractors,vPair,vvKeys,vDescriptors,&threadPool);
+            for (int k = 0; k < 2; ++k)
+            {
+                vBatch[2*i+k].vKeys.swap(vvKeys[k]);
+                vBatch[2*i+k].descriptors=vDescriptors[k];
+                vDescriptors[k]=cv::Mat();
+            }
+        }
+        chrono::steady_clock::time_point t3=chrono::steady_clock::now();
+
+        int nMismatch=0;
+        for (size_t i = 0; i < vBatch.size(); ++i)
+        {
+            string reason;
+            if(!CompareFrame(vBatch[i],vSequential[i],reason))
+            {
+                if(nMismatch==0)
+                    cerr<<"batch pair "<<i/2<<(i%2? " right: " : " left: ")<<reason<<endl;
+                nMismatch++;
+            }
+        }
+        bSame=bSame && nMismatch==0;
+
+        const double tSequential=chrono::duration_cast<chrono::duration<double,milli> >(t2-t1).count()/nPairs;
+        const double tBatch=chrono::duration_cast<chrono::duration<double,milli> >(t3-t2).count()/nPairs;
+        cout<<setw(8)<<vFeatures[f]
+            <<fixed<<setprecision(3)
+            <<setw(16)<<tSequential
+            <<setw(11)<<tBatch
+            <<setprecision(2)
+            <<setw(9)<<tSequential/tBatch
+            <<"  "<<(nMismatch==0? "same" : "MISMATCH")<<endl;
+    }
+    return bSame;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc!=3 && argc!=4)
+    {
+        cerr<<endl<<"Usage: ./orb_benchmark path_to_images path_to_golden [record]"<<endl;
+        return 1;
+    }
+
+    const string strImageDir=argv[1];
+    const string strGoldenDir=argv[2];
+    const bool bRecord=(argc==4 && string(argv[3])=="record");
+
+    //读入所有图像，避免把读文件的时间算进去
+    vector<cv::String> vstrFiles;
+    cv::glob(strImageDir,vstrFiles,false);
+    sort(vstrFiles.begin(),vstrFiles.end());
+
+    vector<cv::Mat> vImages;
+    for (size_t i = 0; i < vstrFiles.size(); ++i)
+    {
+        cv::Mat im=cv::imread(vstrFiles[i],CV_LOAD_IMAGE_GRAYSCALE);
+        if(im.empty())
+            continue;
+        //所有帧的尺寸需要一致，和第一帧不同的跳过
+        if(!vImages.empty() && im.size()!=vImages[0].size())
+        {
+            cerr<<"Skipping "<<vstrFiles[i]<<": size differs from first frame"<<endl;
+            continue;
+        }
+        vImages.push_back(im);
+    }
+
+    if(vImages.empty())
+    {
+        cerr<<"No images found in "<<strImageDir<<endl;
+        return 1;
+    }
+
+    cout<<"Loaded "<<vImages.size()<<" frames of "<<vImages[0].cols<<"x"<<vImages[0].rows<<endl;
+
+    //测试的配置，多线程的配置和对应的单线程配置的结果应当完全一致
+    const int nHardwareThreads=std::max(2,(int)std::thread::hardware_concurrency());
+    const BenchConfig vConfigs[]={
+        {1000,8,1},{1000,8,nHardwareThreads},
+        {2000,8,1},{2000,8,nHardwareThreads},
+        {1000,4,1},{1000,4,nHardwareThreads}
+    };
+    const int nConfigs=sizeof(vConfigs)/sizeof(vConfigs[0]);
+
+    const float fScaleFactor=1.2f;
+    const int nIniThFAST=20;
+    const int nMinThFAST=7;
+
+    int nFailedConfigs=0;
+
+    cout<<endl<<"features levels threads    fps      p50      p99   allocs  keys    golden"<<endl;
+    for (int c = 0; c < nConfigs; ++c)
+    {
+        const BenchConfig &config=vConfigs[c];
+
+        ORBextractor extractor(config.nFeatures,fScaleFactor,config.nLevels,nIniThFAST,nMinThFAST,vImages[0].size());
+        ThreadPool* pThreadPool=NULL;
+        if(config.nThreads>1)
+        {
+            pThreadPool=new ThreadPool(config.nThreads);
+            extractor.SetThreadPool(pThreadPool);
+        }
+
+        //预热一帧，让内部缓存和线程都准备好
+        {
+            vector<cv::KeyPoint> vKeys;
+            cv::Mat descriptors;
+            extractor(vImages[0],cv::Mat(),vKeys,descriptors);
+            extractor.GetProfiler().Clear();
+        }
+
+        vector<FrameResult> vResults(vImages.size());
+        vector<double> vTimes(vImages.size());
+        double sumTime=0;
+        long nAllocations=0,nKeys=0;
+        for (size_t i = 0; i < vImages.size(); ++i)
+        {
+            FrameResult &result=vResults[i];
+            chrono::steady_clock::time_point t1=chrono::steady_clock::now();
+            extractor(vImages[i],cv::Mat(),result.vKeys,result.descriptors);
+            chrono::steady_clock::time_point t2=chrono::steady_clock::now();
+
+            vTimes[i]=chrono::duration_cast<chrono::duration<double,milli> >(t2-t1).count();
+            sumTime+=vTimes[i];
+            nAllocations+=extractor.GetLastFrameAllocations();
+            nKeys+=(long)result.vKeys.size();
+        }
+        sort(vTimes.begin(),vTimes.end());
+
+        //记录或者比较golden结果。只有单线程的配置负责记录，多线程的配置总是和它的结果比较
+        const string strGolden=strGoldenDir+"/"+GetGoldenName(config);
+        string strStatus;
+        if(bRecord && config.nThreads==1)
+        {
+            strStatus=WriteGolden(strGolden,vResults)? "recorded" : "WRITE FAILED";
+            if(strStatus!="recorded")
+                nFailedConfigs++;
+        }
+        else
+        {
+            vector<FrameResult> vGolden;
+            if(!ReadGolden(strGolden,vGolden))
+            {
+                strStatus="MISSING";
+                nFailedConfigs++;
+            }
+            else if(vGolden.size()!=vResults.size())
+            {
+                strStatus="FRAME COUNT";
+                nFailedConfigs++;
+            }
+            else
+            {
+                int nMismatch=0;
+                for (size_t i = 0; i < vResults.size(); ++i)
+                {
+                    string reason;
+                    if(!CompareFrame(vResults[i],vGolden[i],reason))
+                    {
+                        if(nMismatch==0)
+                            cerr<<GetGoldenName(config)<<" frame "<<i<<": "<<reason<<endl;
+                        nMismatch++;
+                    }
+                }
+                if(nMismatch==0)
+                    strStatus="ok";
+                else
+                {
+                    stringstream ss;
+                    ss<<nMismatch<<" MISMATCH";
+                    strStatus=ss.str();
+                    nFailedConfigs++;
+                }
+            }
+        }
+
+        const double nFrames=(double)vImages.size();
+        cout<<setw(8)<<config.nFeatures
+            <<setw(7)<<config.nLevels
+            <<setw(8)<<config.nThreads
+            <<fixed<<setprecision(1)
+            <<setw(7)<<1000.0*nFrames/sumTime
+            <<setprecision(3)
+            <<setw(9)<<Percentile(vTimes,0.5)
+            <<setw(9)<<Percentile(vTimes,0.99)
+            <<setprecision(2)
+            <<setw(9)<<nAllocations/nFrames
+            <<setprecision(0)
+            <<setw(6)<<nKeys/nFrames
+            <<"    "<<strStatus<<endl;
+
+#ifdef ORB_PROFILING
+        extractor.GetProfiler().Dump(cout);
+#endif
+
+        delete pThreadPool;
+    }
+
+    CompareProfiling(vImages,fScaleFactor,nIniThFAST,nMinThFAST);
+    if(!CompareFusedPyramid(vImages,fScaleFactor,nIniThFAST,nMinThFAST))
+        nFailedConfigs++;
+    if(!CompareBatch(vImages,nHardwareThreads,fScaleFactor,nIniThFAST,nMinThFAST))
+        nFailedConfigs++;
+
+    return nFailedConfigs==0? 0 : 2;
+}
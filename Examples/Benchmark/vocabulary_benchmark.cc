@@ -0,0 +1,79 @@
+//词典读取的耗时和内存测试
+//
+//用法：./vocabulary_benchmark 词典文件 text|parallel|binary [线程数]
+//用指定的方式读取词典：text为逐行读取文本词典（loadFromTextFile），parallel为多线程读取文本词典（loadFromTextFileParallel），
+//binary为内存映射二进制词典（loadFromBinaryFile）。输出读取耗时、读取期间进程内存峰值的增加量，以及一个由所有单词的描述子、
+//权重和转换结果计算的指纹。进程的内存峰值只增不减，所以每次运行只测一种方式；同一个词典不同方式得到的指纹应该相同
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+
+#include <sys/resource.h>
+
+#include "include/ORBVocabulary.h"
+
+using namespace std;
+
+//进程的内存峰值，单位KB
+static long PeakMemory()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF,&usage);
+    return usage.ru_maxrss;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc<3)
+    {
+        cerr<<endl<<"Usage: ./vocabulary_benchmark path_to_vocabulary text|parallel|binary [threads]"<<endl;
+        return 1;
+    }
+
+    const string strMode=argv[2];
+    const int nThreads=argc>3? atoi(argv[3]) : 0;
+
+    ORB_SLAM2::ORBVocabulary vocabulary;
+    const long nMemoryBefore=PeakMemory();
+    chrono::steady_clock::time_point t1=chrono::steady_clock::now();
+
+    bool bLoaded=false;
+    if(strMode=="text")
+        bLoaded=vocabulary.loadFromTextFile(argv[1]);
+    else if(strMode=="parallel")
+        bLoaded=vocabulary.loadFromTextFileParallel(argv[1],nThreads);
+    else if(strMode=="binary")
+        bLoaded=vocabulary.loadFromBinaryFile(argv[1]);
+
+    chrono::steady_clock::time_point t2=chrono::steady_clock::now();
+    const long nMemoryAfter=PeakMemory();
+
+    if(!bLoaded)
+    {
+        cerr<<"Failed to load "<<argv[1]<<" as "<<strMode<<endl;
+        return 1;
+    }
+
+    //FNV-1a，包括每个单词的描述子、权重和描述子转换得到的单词
+    unsigned long long fingerprint=14695981039346656037ULL;
+    for (unsigned int wid = 0; wid < vocabulary.size(); ++wid)
+    {
+        const cv::Mat word=vocabulary.getWord(wid);
+        const uchar* p=word.ptr<uchar>();
+        for (int i = 0; i < DBoW2::FORB::L; ++i)
+            fingerprint=(fingerprint^p[i])*1099511628211ULL;
+        fingerprint=(fingerprint^(unsigned long long)(vocabulary.getWordWeight(wid)*1e9))*1099511628211ULL;
+        fingerprint=(fingerprint^vocabulary.transform(word))*1099511628211ULL;
+    }
+
+    cout<<strMode<<": "<<vocabulary.size()<<" words, k = "<<vocabulary.getBranchingFactor()
+        <<", L = "<<vocabulary.getDepthLevels()<<endl;
+    cout<<"load time   "<<fixed<<setprecision(3)<<chrono::duration_cast<chrono::duration<double> >(t2-t1).count()<<" s"<<endl;
+    cout<<"peak memory +"<<(nMemoryAfter-nMemoryBefore)/1024<<" MB ("<<nMemoryAfter/1024<<" MB in total)"<<endl;
+    cout<<"fingerprint "<<hex<<fingerprint<<dec<<endl;
+
+    return 0;
+}
@@ -0,0 +1,145 @@
+//把文本格式的ORB词典转换为二进制格式
+//
+//用法：./bin_vocabulary ORBvoc.txt ORBvoc.bin
+//读取文本词典，保存为可以用ORBVocabulary::loadFromBinaryFile内存映射的二进制词典，然后重新映射保存的文件，
+//检查每个单词的描述子、权重以及转换得到的单词和文本词典完全一致。最后把保存的文件中的各种下标逐个改为越界或成环的值，
+//重新计算校验和后写入临时文件，检查loadFromBinaryFile拒绝每一个这样的文件。检查失败时程序返回非0
+
+#include <iostream>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "include/ORBVocabulary.h"
+
+using namespace std;
+
+//二进制文件的格式和校验和是TemplatedVocabulary的保护成员，通过派生类访问
+class BinaryVocabularyCheck : public ORB_SLAM2::ORBVocabulary
+{
+public:
+    /**
+     * @brief 逐个修改二进制词典中的下标，重新计算校验和后尝试读取
+     * @param[in] strFile 正确的二进制词典
+     * @return 没有被loadFromBinaryFile拒绝的修改个数
+     */
+    static int CountAcceptedCorruptions(const string &strFile)
+    {
+        ifstream f(strFile.c_str(),ios_base::in|ios_base::binary);
+        const vector<char> original((istreambuf_iterator<char>(f)),istreambuf_iterator<char>());
+        f.close();
+
+        BinaryHeader header;
+        memcpy(&header,original.data(),sizeof(header));
+        size_t offsets[6];
+        binaryLayout(header,offsets);
+
+        FlatNode root;
+        memcpy(&root,&original[offsets[0]],sizeof(root));
+        unsigned int leafSlot;
+        memcpy(&leafSlot,&original[offsets[2]],sizeof(leafSlot));
+
+        //每一项：修改的位置和新的值
+        const size_t rootOffset=offsets[0];
+        const size_t childOffset=offsets[0]+(size_t)root.first*sizeof(FlatNode);
+        const size_t leafOffset=offsets[0]+(size_t)leafSlot*sizeof(FlatNode);
+        const size_t lastNode=header.nnodes-1;
+        const struct { const char *name; size_t offset; unsigned int value; } vCorruptions[]={
+            {"child id out of range",childOffset+offsetof(FlatNode,id),0xfffffff0u},
+            {"children out of range",rootOffset+offsetof(FlatNode,first),header.nslots},
+            {"children before parent",rootOffset+offsetof(FlatNode,first),0},
+            {"word id out of range",leafOffset+offsetof(FlatNode,word_id),header.nwords},
+            {"word slot out of range",offsets[2],header.nslots},
+            {"node slot out of range",offsets[3]+lastNode*sizeof(unsigned int),header.nslots},
+            {"node is its own parent",offsets[4]+lastNode*sizeof(DBoW2::NodeId),(unsigned int)lastNode}
+        };
+
+        const string strCorrupted=strFile+".corrupted";
+        int nAccepted=0;
+        for (size_t i = 0; i < sizeof(vCorruptions)/sizeof(vCorruptions[0]); ++i)
+        {
+            vector<char> data=original;
+            memcpy(&data[vCorruptions[i].offset],&vCorruptions[i].value,sizeof(unsigned int));
+            //校验和正确，只有下标检查能发现错误
+            BinaryHeader corrupted=header;
+            corrupted.checksum=binaryChecksum(reinterpret_cast<const unsigned char*>(&data[sizeof(BinaryHeader)]),
+                data.size()-sizeof(BinaryHeader));
+            memcpy(&data[0],&corrupted,sizeof(corrupted));
+
+            ofstream out(strCorrupted.c_str(),ios_base::out|ios_base::binary);
+            out.write(data.data(),data.size());
+            out.close();
+
+            ORB_SLAM2::ORBVocabulary vocabulary;
+            if(vocabulary.loadFromBinaryFile(strCorrupted))
+            {
+                cerr<<"A binary vocabulary with "<<vCorruptions[i].name<<" was accepted"<<endl;
+                nAccepted++;
+            }
+        }
+        remove(strCorrupted.c_str());
+        return nAccepted;
+    }
+};
+
+int main(int argc, char **argv)
+{
+    if(argc!=3)
+    {
+        cerr<<endl<<"Usage: ./bin_vocabulary path_to_text_vocabulary path_to_binary_vocabulary"<<endl;
+        return 1;
+    }
+
+    ORB_SLAM2::ORBVocabulary textVocabulary;
+    chrono::steady_clock::time_point t1=chrono::steady_clock::now();
+    if(!textVocabulary.loadFromTextFile(argv[1]))
+    {
+        cerr<<"Failed to load "<<argv[1]<<endl;
+        return 1;
+    }
+    chrono::steady_clock::time_point t2=chrono::steady_clock::now();
+    cout<<"text vocabulary: "<<textVocabulary.size()<<" words, loaded in "
+        <<chrono::duration_cast<chrono::duration<double> >(t2-t1).count()<<" s"<<endl;
+
+    if(!textVocabulary.saveToBinaryFile(argv[2]))
+        return 1;
+
+    ORB_SLAM2::ORBVocabulary binaryVocabulary;
+    t1=chrono::steady_clock::now();
+    if(!binaryVocabulary.loadFromBinaryFile(argv[2]))
+        return 1;
+    t2=chrono::steady_clock::now();
+    cout<<"binary vocabulary: "<<binaryVocabulary.size()<<" words, mapped in "
+        <<chrono::duration_cast<chrono::duration<double> >(t2-t1).count()<<" s"<<endl;
+
+    //每个单词的描述子转换后应该得到同一个单词（描述子相同的单词取第一个），两个词典的结果要完全一致
+    int nMismatch=binaryVocabulary.size()==textVocabulary.size()? 0 : 1;
+    for (unsigned int wid = 0; wid < textVocabulary.size() && nMismatch==0; ++wid)
+    {
+        const cv::Mat word=textVocabulary.getWord(wid);
+        const cv::Mat mappedWord=binaryVocabulary.getWord(wid);
+        if(memcmp(word.ptr<uchar>(),mappedWord.ptr<uchar>(),DBoW2::FORB::L)!=0)
+            nMismatch++;
+        if(textVocabulary.getWordWeight(wid)!=binaryVocabulary.getWordWeight(wid))
+            nMismatch++;
+        if(textVocabulary.transform(word)!=binaryVocabulary.transform(word))
+            nMismatch++;
+    }
+
+    if(nMismatch>0)
+    {
+        cerr<<"The binary vocabulary does not match the text vocabulary"<<endl;
+        return 2;
+    }
+
+    if(BinaryVocabularyCheck::CountAcceptedCorruptions(argv[2])>0)
+        return 3;
+
+    cout<<"saved "<<argv[2]<<endl;
+    return 0;
+}
@@ -13,8 +13,17 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <cstring>
 #include <stdint-gcc.h>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define FORB_SIMD_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FORB_SIMD_NEON
+#endif
+
 #include "FORB.h"
 
 using namespace std;
@@ -78,20 +87,24 @@ void FORB::meanValue(const std::vector<FORB::pDescriptor> &descriptors,
 
 // --------------------------------------------------------------------------
   
-int FORB::distance(const FORB::TDescriptor &a,
-  const FORB::TDescriptor &b)
-{
-  // Bit set count operation from
-  // http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
-
-  const int *pa = a.ptr<int32_t>();
-  const int *pb = b.ptr<int32_t>();
+// Hamming distance kernels. All of them count the bits of a ^ b over
+// FORB::L = 32 bytes and return exactly the same value; they only differ
+// in the instructions used. Descriptors may come from any row of a Mat,
+// so no alignment is assumed
 
+// Bit set count operation from
+// http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
+// Portable reference implementation
+static int distanceSWAR(const unsigned char *a, const unsigned char *b)
+{
   int dist=0;
 
-  for(int i=0; i<8; i++, pa++, pb++)
+  for(int i=0; i<8; i++)
   {
-      unsigned  int v = *pa ^ *pb;
+      uint32_t va, vb;
+      memcpy(&va, a + 4*i, 4);
+      memcpy(&vb, b + 4*i, 4);
+      unsigned  int v = va ^ vb;
       v = v - ((v >> 1) & 0x55555555);
       v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
       dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
@@ -100,6 +113,384 @@ int FORB::distance(const FORB::TDescriptor &a,
   return dist;
 }
 
+#if defined(FORB_SIMD_X86)
+
+// Four 64-bit hardware popcounts
+__attribute__((target("popcnt")))
+static int distancePopcnt(const unsigned char *a, const unsigned char *b)
+{
+  uint64_t va[4], vb[4];
+  memcpy(va, a, 32);
+  memcpy(vb, b, 32);
+
+  return (int)(_mm_popcnt_u64(va[0] ^ vb[0]) + _mm_popcnt_u64(va[1] ^ vb[1]) +
+    _mm_popcnt_u64(va[2] ^ vb[2]) + _mm_popcnt_u64(va[3] ^ vb[3]));
+}
+
+// AVX2: popcount of every nibble with a 16-entry shuffle table, then
+// the byte counts are summed with SAD against zero
+__attribute__((target("avx2")))
+static int distanceAVX2(const unsigned char *a, const unsigned char *b)
+{
+  const __m256i lut = _mm256_setr_epi8(
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+
+  const __m256i v = _mm256_xor_si256(
+    _mm256_loadu_si256((const __m256i*)a),
+    _mm256_loadu_si256((const __m256i*)b));
+
+  const __m256i lo = _mm256_and_si256(v, low_mask);
+  const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+  const __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo),
+    _mm256_shuffle_epi8(lut, hi));
+
+  // four 64-bit partial sums
+  const __m256i sad = _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+  const __m128i s = _mm_add_epi64(_mm256_castsi256_si128(sad),
+    _mm256_extracti128_si256(sad, 1));
+  return (int)(_mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1));
+}
+
+// AVX-512 VPOPCNTQ on a 256-bit register
+__attribute__((target("avx512vpopcntdq,avx512vl,avx2")))
+static int distanceAVX512(const unsigned char *a, const unsigned char *b)
+{
+  const __m256i v = _mm256_xor_si256(
+    _mm256_loadu_si256((const __m256i*)a),
+    _mm256_loadu_si256((const __m256i*)b));
+
+  const __m256i cnt = _mm256_popcnt_epi64(v);
+  const __m128i s = _mm_add_epi64(_mm256_castsi256_si128(cnt),
+    _mm256_extracti128_si256(cnt, 1));
+  return (int)(_mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1));
+}
+
+#elif defined(FORB_SIMD_NEON)
+
+// NEON: per-byte popcount, then pairwise widening additions
+static int distanceNEON(const unsigned char *a, const unsigned char *b)
+{
+  const uint8x16_t c0 = vcntq_u8(veorq_u8(vld1q_u8(a), vld1q_u8(b)));
+  const uint8x16_t c1 = vcntq_u8(veorq_u8(vld1q_u8(a + 16), vld1q_u8(b + 16)));
+
+  const uint64x2_t s = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vaddq_u8(c0, c1))));
+  return (int)(vgetq_lane_u64(s, 0) + vgetq_lane_u64(s, 1));
+}
+
+#endif
+
+// --------------------------------------------------------------------------
+
+// One-to-many kernels: the query is loaded once and compared against every
+// descriptor of a contiguous block. They keep the first minimum, like a
+// sequential scan with a strict comparison
+
+static int argminSWAR(const unsigned char *query, const unsigned char *block,
+  int n, int &best_dist)
+{
+  int best = 0;
+  best_dist = distanceSWAR(query, block);
+  for(int i = 1; i < n; ++i)
+  {
+    const int d = distanceSWAR(query, block + 32*i);
+    if(d < best_dist)
+    {
+      best_dist = d;
+      best = i;
+    }
+  }
+  return best;
+}
+
+#if defined(FORB_SIMD_X86)
+
+__attribute__((target("popcnt")))
+static int argminPopcnt(const unsigned char *query, const unsigned char *block,
+  int n, int &best_dist)
+{
+  uint64_t q[4];
+  memcpy(q, query, 32);
+
+  int best = 0;
+  best_dist = 257;
+  for(int i = 0; i < n; ++i)
+  {
+    uint64_t v[4];
+    memcpy(v, block + 32*i, 32);
+    const int d = (int)(_mm_popcnt_u64(q[0] ^ v[0]) + _mm_popcnt_u64(q[1] ^ v[1]) +
+      _mm_popcnt_u64(q[2] ^ v[2]) + _mm_popcnt_u64(q[3] ^ v[3]));
+    if(d < best_dist)
+    {
+      best_dist = d;
+      best = i;
+    }
+  }
+  return best;
+}
+
+// Per-byte popcount of a 256-bit register with the nibble table, summed
+// into four 64-bit partial counts
+__attribute__((target("avx2")))
+static inline __m256i popcount4x64AVX2(const __m256i v)
+{
+  const __m256i lut = _mm256_setr_epi8(
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+
+  const __m256i lo = _mm256_and_si256(v, low_mask);
+  const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+  const __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo),
+    _mm256_shuffle_epi8(lut, hi));
+  return _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+}
+
+// Reduces the four 64-bit partial counts of four descriptors into one
+// register holding their four distances
+__attribute__((target("avx2")))
+static inline __m256i reduce4x64AVX2(const __m256i s0, const __m256i s1,
+  const __m256i s2, const __m256i s3)
+{
+  const __m256i t01 = _mm256_add_epi64(_mm256_unpacklo_epi64(s0, s1),
+    _mm256_unpackhi_epi64(s0, s1));
+  const __m256i t23 = _mm256_add_epi64(_mm256_unpacklo_epi64(s2, s3),
+    _mm256_unpackhi_epi64(s2, s3));
+  return _mm256_add_epi64(_mm256_permute2x128_si256(t01, t23, 0x20),
+    _mm256_permute2x128_si256(t01, t23, 0x31));
+}
+
+// Four descriptors per iteration; the minimum is then tracked in order
+__attribute__((target("avx2")))
+static int argminAVX2(const unsigned char *query, const unsigned char *block,
+  int n, int &best_dist)
+{
+  const __m256i q = _mm256_loadu_si256((const __m256i*)query);
+
+  int best = 0;
+  best_dist = 257;
+  int i = 0;
+  for(; i + 4 <= n; i += 4)
+  {
+    const __m256i *p = (const __m256i*)(block + 32*i);
+    const __m256i d4 = reduce4x64AVX2(
+      popcount4x64AVX2(_mm256_xor_si256(q, _mm256_loadu_si256(p))),
+      popcount4x64AVX2(_mm256_xor_si256(q, _mm256_loadu_si256(p + 1))),
+      popcount4x64AVX2(_mm256_xor_si256(q, _mm256_loadu_si256(p + 2))),
+      popcount4x64AVX2(_mm256_xor_si256(q, _mm256_loadu_si256(p + 3))));
+
+    uint64_t d[4];
+    _mm256_storeu_si256((__m256i*)d, d4);
+    for(int j = 0; j < 4; ++j)
+    {
+      if((int)d[j] < best_dist)
+      {
+        best_dist = (int)d[j];
+        best = i + j;
+      }
+    }
+  }
+  for(; i < n; ++i)
+  {
+    const int d = distanceAVX2(query, block + 32*i);
+    if(d < best_dist)
+    {
+      best_dist = d;
+      best = i;
+    }
+  }
+  return best;
+}
+
+// Same as argminAVX2 with VPOPCNTQ instead of the nibble table
+__attribute__((target("avx512vpopcntdq,avx512vl,avx2")))
+static int argminAVX512(const unsigned char *query, const unsigned char *block,
+  int n, int &best_dist)
+{
+  const __m256i q = _mm256_loadu_si256((const __m256i*)query);
+
+  int best = 0;
+  best_dist = 257;
+  int i = 0;
+  for(; i + 4 <= n; i += 4)
+  {
+    const __m256i *p = (const __m256i*)(block + 32*i);
+    const __m256i d4 = reduce4x64AVX2(
+      _mm256_popcnt_epi64(_mm256_xor_si256(q, _mm256_loadu_si256(p))),
+      _mm256_popcnt_epi64(_mm256_xor_si256(q, _mm256_loadu_si256(p + 1))),
+      _mm256_popcnt_epi64(_mm256_xor_si256(q, _mm256_loadu_si256(p + 2))),
+      _mm256_popcnt_epi64(_mm256_xor_si256(q, _mm256_loadu_si256(p + 3))));
+
+    uint64_t d[4];
+    _mm256_storeu_si256((__m256i*)d, d4);
+    for(int j = 0; j < 4; ++j)
+    {
+      if((int)d[j] < best_dist)
+      {
+        best_dist = (int)d[j];
+        best = i + j;
+      }
+    }
+  }
+  for(; i < n; ++i)
+  {
+    const int d = distanceAVX512(query, block + 32*i);
+    if(d < best_dist)
+    {
+      best_dist = d;
+      best = i;
+    }
+  }
+  return best;
+}
+
+#elif defined(FORB_SIMD_NEON)
+
+static int argminNEON(const unsigned char *query, const unsigned char *block,
+  int n, int &best_dist)
+{
+  const uint8x16_t q0 = vld1q_u8(query);
+  const uint8x16_t q1 = vld1q_u8(query + 16);
+
+  int best = 0;
+  best_dist = 257;
+  for(int i = 0; i < n; ++i)
+  {
+    const unsigned char *b = block + 32*i;
+    const uint8x16_t c0 = vcntq_u8(veorq_u8(q0, vld1q_u8(b)));
+    const uint8x16_t c1 = vcntq_u8(veorq_u8(q1, vld1q_u8(b + 16)));
+    const uint64x2_t s = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vaddq_u8(c0, c1))));
+    const int d = (int)(vgetq_lane_u64(s, 0) + vgetq_lane_u64(s, 1));
+    if(d < best_dist)
+    {
+      best_dist = d;
+      best = i;
+    }
+  }
+  return best;
+}
+
+#endif
+
+void FORB::availableDistanceKernels(std::vector<DistanceKernel> &kernels,
+  std::vector<std::string> &names)
+{
+  kernels.clear();
+  names.clear();
+
+  kernels.push_back(distanceSWAR);
+  names.push_back("swar");
+
+#if defined(FORB_SIMD_X86)
+  __builtin_cpu_init();
+  // ordered from slowest to fastest for a single pair: the AVX2 table
+  // lookup pays for the horizontal reduction, so four popcnt win
+  if(__builtin_cpu_supports("avx2"))
+  {
+    kernels.push_back(distanceAVX2);
+    names.push_back("avx2");
+  }
+  if(__builtin_cpu_supports("popcnt"))
+  {
+    kernels.push_back(distancePopcnt);
+    names.push_back("popcnt");
+  }
+  if(__builtin_cpu_supports("avx512vpopcntdq") && 
+    __builtin_cpu_supports("avx512vl"))
+  {
+    kernels.push_back(distanceAVX512);
+    names.push_back("avx512-vpopcntq");
+  }
+#elif defined(FORB_SIMD_NEON)
+  kernels.push_back(distanceNEON);
+  names.push_back("neon");
+#endif
+}
+
+// --------------------------------------------------------------------------
+
+void FORB::availableArgminKernels(std::vector<ArgminKernel> &kernels,
+  std::vector<std::string> &names)
+{
+  kernels.clear();
+  names.clear();
+
+  kernels.push_back(argminSWAR);
+  names.push_back("swar");
+
+#if defined(FORB_SIMD_X86)
+  __builtin_cpu_init();
+  // with the query kept in registers and four children per iteration,
+  // the AVX2 table lookup beats scalar popcnt on a block
+  if(__builtin_cpu_supports("popcnt"))
+  {
+    kernels.push_back(argminPopcnt);
+    names.push_back("popcnt");
+  }
+  if(__builtin_cpu_supports("avx2"))
+  {
+    kernels.push_back(argminAVX2);
+    names.push_back("avx2");
+  }
+  if(__builtin_cpu_supports("avx512vpopcntdq") && 
+    __builtin_cpu_supports("avx512vl"))
+  {
+    kernels.push_back(argminAVX512);
+    names.push_back("avx512-vpopcntq");
+  }
+#elif defined(FORB_SIMD_NEON)
+  kernels.push_back(argminNEON);
+  names.push_back("neon");
+#endif
+}
+
+// --------------------------------------------------------------------------
+
+// Selects the distance kernel once, at load time
+static FORB::DistanceKernel selectDistanceKernel()
+{
+  std::vector<FORB::DistanceKernel> kernels;
+  std::vector<std::string> names;
+  FORB::availableDistanceKernels(kernels, names);
+  return kernels.back();
+}
+
+static const FORB::DistanceKernel g_distance_kernel = selectDistanceKernel();
+
+static FORB::ArgminKernel selectArgminKernel()
+{
+  std::vector<FORB::ArgminKernel> kernels;
+  std::vector<std::string> names;
+  FORB::availableArgminKernels(kernels, names);
+  return kernels.back();
+}
+
+static const FORB::ArgminKernel g_argmin_kernel = selectArgminKernel();
+
+// --------------------------------------------------------------------------
+  
+int FORB::distance(const FORB::TDescriptor &a,
+  const FORB::TDescriptor &b)
+{
+  return g_distance_kernel(a.ptr<unsigned char>(), b.ptr<unsigned char>());
+}
+
+// --------------------------------------------------------------------------
+
+int FORB::distance(const unsigned char *a, const unsigned char *b)
+{
+  return g_distance_kernel(a, b);
+}
+
+// --------------------------------------------------------------------------
+
+int FORB::distanceArgmin(const unsigned char *query, 
+  const unsigned char *block, int n, int &best_dist)
+{
+  return g_argmin_kernel(query, block, n, best_dist);
+}
+
 // --------------------------------------------------------------------------
   
 std::string FORB::toString(const FORB::TDescriptor &a)
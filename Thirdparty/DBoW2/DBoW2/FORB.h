@@ -46,6 +46,56 @@ public:
    */
   static int distance(const TDescriptor &a, const TDescriptor &b);
 
+  /**
+   * Calculates the distance between two raw descriptors of L bytes.
+   * Uses the fastest popcount implementation the running CPU supports
+   * @param a
+   * @param b
+   * @return distance
+   */
+  static int distance(const unsigned char *a, const unsigned char *b);
+
+  /// Hamming distance implementation between two raw descriptors of L bytes
+  typedef int (*DistanceKernel)(const unsigned char *a, 
+    const unsigned char *b);
+
+  /**
+   * Returns all the distance implementations the running CPU can execute,
+   * with their names. The first one is the portable reference, the last
+   * one is the one used by distance
+   * @param kernels (out) implementations
+   * @param names (out) names
+   */
+  static void availableDistanceKernels(std::vector<DistanceKernel> &kernels,
+    std::vector<std::string> &names);
+
+  /**
+   * Compares one descriptor against a contiguous block of descriptors and
+   * returns the closest one. Ties are resolved in favour of the lowest
+   * index, as a sequential scan with distance would do
+   * @param query descriptor of L bytes
+   * @param block n descriptors of L bytes, one after another
+   * @param n number of descriptors in the block (> 0)
+   * @param best_dist (out) distance to the closest descriptor
+   * @return index of the closest descriptor in the block
+   */
+  static int distanceArgmin(const unsigned char *query, 
+    const unsigned char *block, int n, int &best_dist);
+
+  /// One-to-many implementation of distanceArgmin
+  typedef int (*ArgminKernel)(const unsigned char *query, 
+    const unsigned char *block, int n, int &best_dist);
+
+  /**
+   * Returns all the one-to-many implementations the running CPU can
+   * execute, with their names. The first one is the portable reference,
+   * the last one is the one used by distanceArgmin
+   * @param kernels (out) implementations
+   * @param names (out) names
+   */
+  static void availableArgminKernels(std::vector<ArgminKernel> &kernels,
+    std::vector<std::string> &names);
+
   /**
    * Returns a string version of the descriptor
    * @param a descriptor
@@ -18,6 +18,8 @@
 #define __D_T_TEMPLATED_VOCABULARY__
 
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
 
 #include <vector>
 #include <numeric>
@@ -26,17 +28,34 @@
 #include <algorithm>
 #include <opencv2/core/core.hpp>
 #include <limits>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <type_traits>
+#include <stdint.h>
 
 #include "FeatureVector.h"
 #include "BowVector.h"
 #include "ScoringObject.h"
 
 #include "../DUtils/Random.h"
+#include "../DUtils/MappedFile.h"
 
 using namespace std;
 
 namespace DBoW2 {
 
+/// Tells whether the descriptor functions F provide the one-to-many
+/// F::distanceArgmin over packed descriptors of F::L bytes
+template<class F>
+class HasDistanceArgmin
+{
+  template<class U> static char test(decltype(&U::distanceArgmin));
+  template<class U> static long test(...);
+public:
+  static const bool value = sizeof(test<F>(0)) == sizeof(char);
+};
+
 /// @param TDescriptor class of descriptor
 /// @param F class of descriptor functions
 template<class TDescriptor, class F>
@@ -240,12 +259,55 @@ public:
    */
   bool loadFromTextFile(const std::string &filename);
 
+  /**
+   * Loads the vocabulary from a text file like loadFromTextFile, but the
+   * file is memory-mapped and split into line-aligned chunks, the nodes of
+   * each chunk are parsed by a different thread, and the children are
+   * linked to their parents in a second, sequential pass. Blank lines are
+   * skipped
+   * @param filename
+   * @param nThreads number of threads, 0 to use one per hardware thread
+   * @return false if the file cannot be mapped or has a malformed line.
+   *   The vocabulary is not modified in that case
+   */
+  bool loadFromTextFileParallel(const std::string &filename, int nThreads = 0);
+
   /**
    * Saves the vocabulary into a text file
    * @param filename
    */
   void saveToTextFile(const std::string &filename) const;  
 
+  /**
+   * Loads the vocabulary from a binary file written by saveToBinaryFile.
+   * The file is memory-mapped read-only and used in place: nothing is
+   * parsed or copied, and processes that load the same file share its
+   * pages. Only the query functions (transform, score, size, getWord,
+   * getWordWeight, getParentNode, getWordsFromNode) can be used on the
+   * loaded vocabulary; it cannot be trained, saved to text or modified.
+   * Requires F to provide distanceArgmin
+   * @param filename
+   * @return false if the file cannot be mapped, does not match the format
+   *   version or the descriptor size, or its checksum is wrong. The
+   *   vocabulary is not modified in that case
+   */
+  bool loadFromBinaryFile(const std::string &filename);
+
+  /**
+   * Saves the vocabulary into a binary file that can be loaded with
+   * loadFromBinaryFile. The file is only readable on machines with the
+   * same byte order
+   * @param filename
+   * @return false if the file cannot be written or F does not provide
+   *   distanceArgmin
+   */
+  bool saveToBinaryFile(const std::string &filename) const;
+
+  /**
+   * Returns whether the vocabulary was loaded with loadFromBinaryFile
+   */
+  inline bool isMapped() const { return m_mapped.file != NULL; }
+
   /**
    * Saves the vocabulary into a file
    * @param filename
@@ -393,6 +455,32 @@ protected:
    * Create the words of the vocabulary once the tree has been built
    */
   void createWords();
+
+  /**
+   * Builds the flat, read-only copy of the tree used by transform. The
+   * children of every node take consecutive slots of m_flat_nodes (in
+   * breadth-first order), and their descriptors take the same slots of a
+   * 64-byte aligned buffer, each block of siblings starting on a cache
+   * line. Tree descent then compares a feature against all the children
+   * of a node with a single F::distanceArgmin call and reads nothing but
+   * these contiguous slots. Must be called whenever m_nodes or the
+   * weights change. Does nothing if F does not provide distanceArgmin.
+   * The flat variants are member templates on the tag so that they are
+   * only instantiated when F provides distanceArgmin
+   */
+  void createFlatTree();
+  void createFlatTree(std::false_type);
+  template<class Batched> void createFlatTree(Batched);
+
+  /**
+   * Propagates a feature down the tree, see transform. The first version
+   * walks m_nodes, the second one the flat tree
+   */
+  void descendTree(const TDescriptor &feature, WordId &word_id, 
+    WordValue &weight, NodeId *nid, int levelsup, std::false_type) const;
+  template<class Batched> void descendTree(const TDescriptor &feature, 
+    WordId &word_id, WordValue &weight, NodeId *nid, int levelsup, 
+    Batched) const;
   
   /**
    * Sets the weights of the nodes of tree according to the given features.
@@ -425,6 +513,141 @@ protected:
   /// Words of the vocabulary (tree leaves)
   /// this condition holds: m_words[wid]->word_id == wid
   std::vector<Node*> m_words;
+
+  /// Query-time record of a node in the flat tree
+  struct FlatNode
+  {
+    /// Node id
+    NodeId id;
+    /// Slot of the first child
+    unsigned int first;
+    /// Number of children (0 if the node is a word)
+    unsigned int nchildren;
+    /// Word id if the node is a word
+    WordId word_id;
+    /// Weight if the node is a word
+    WordValue weight;
+
+    FlatNode(): id(0), first(0), nchildren(0), word_id(0), weight(0){}
+  };
+
+  /// Tables of a vocabulary loaded with loadFromBinaryFile. They point
+  /// into the mapped file; m_nodes and m_words are empty in that case
+  struct MappedTables
+  {
+    /// Mapped file, shared by the copies of the vocabulary
+    std::shared_ptr<DUtils::MappedFile> file;
+    /// Number of words
+    unsigned int nwords;
+    /// Number of nodes
+    unsigned int nnodes;
+    /// Slot of each word in m_flat_nodes
+    const unsigned int *word_slots;
+    /// Slot of each node in m_flat_nodes
+    const unsigned int *node_slots;
+    /// Parent of each node (0 for the root)
+    const NodeId *node_parents;
+
+    MappedTables(): nwords(0), nnodes(0), word_slots(NULL), 
+      node_slots(NULL), node_parents(NULL){}
+  };
+
+  /// Header of a binary vocabulary file. It is followed by the sections
+  /// FlatNode[nslots], descriptors[nslots * F::L], word slots[nwords],
+  /// node slots[nnodes] and node parents[nnodes], each one starting at a
+  /// multiple of 64 bytes and padded with zeros
+  struct BinaryHeader
+  {
+    /// "DBoW2bin"
+    char magic[8];
+    /// Format version
+    uint32_t version;
+    /// 0x01020304 written in the byte order of the machine
+    uint32_t byte_order;
+    /// F::L
+    uint32_t descriptor_bytes;
+    /// sizeof(FlatNode)
+    uint32_t node_record_bytes;
+    /// Branching factor, depth levels, scoring and weighting type
+    int32_t k, L, scoring, weighting;
+    /// Number of slots, words and nodes
+    uint32_t nslots, nwords, nnodes;
+    /// Unused, 0
+    uint32_t reserved;
+    /// Checksum of everything after the header (see binaryChecksum)
+    uint64_t checksum;
+  };
+
+  /// Current version of the binary format
+  static const uint32_t BINARY_VERSION = 1;
+
+  /**
+   * Parses the next integer of a line of a text vocabulary
+   * @param p (in/out) position in the line, moved past the integer
+   * @param eol end of the line
+   * @param value (out)
+   * @return false if there is no integer before eol
+   */
+  static bool parseTextInt(const char *&p, const char *eol, int &value);
+
+  /**
+   * Parses a node line of a text vocabulary: parent id, leaf flag, F::L
+   * descriptor bytes and weight
+   * @param line
+   * @param eol end of the line
+   * @param node (out) parent, descriptor and weight are set
+   * @param isLeaf (out) leaf flag
+   * @return false if the line is malformed
+   */
+  static bool parseTextNode(const char *line, const char *eol, Node &node, 
+    bool &isLeaf);
+
+  /**
+   * Computes the offsets of the sections of a binary vocabulary file
+   * @param header
+   * @param offsets (out) start of the 5 sections and size of the file
+   */
+  static void binaryLayout(const BinaryHeader &header, size_t offsets[6]);
+
+  /**
+   * FNV-1a over 8-byte words of the given data
+   * @param data
+   * @param size number of bytes, multiple of 8
+   */
+  static uint64_t binaryChecksum(const unsigned char *data, size_t size);
+
+  /**
+   * Checks that every index stored in the sections of a binary vocabulary
+   * file is in range, so that queries on the mapped tables cannot read 
+   * outside the file or loop forever
+   * @param header
+   * @param base start of the file
+   * @param offsets sections of the file, as given by binaryLayout
+   * @return false if some index is wrong
+   */
+  static bool checkBinaryTables(const BinaryHeader &header, 
+    const unsigned char *base, const size_t offsets[6]);
+
+  /// Storage of the flat tree built from m_nodes
+  std::vector<FlatNode> m_flat_storage;
+
+  /// Storage of the descriptors of the flat tree built from m_nodes
+  std::vector<unsigned char> m_flat_buffer;
+
+  /// Flat tree: slot 0 holds the root and the children of each node take
+  /// consecutive slots (only used if F provides distanceArgmin). Points 
+  /// into m_flat_storage or into the mapped file
+  const FlatNode *m_flat_nodes;
+
+  /// Number of slots of m_flat_nodes
+  unsigned int m_flat_size;
+
+  /// 64-byte aligned descriptors of the flat tree, F::L bytes per slot of
+  /// m_flat_nodes. Points into m_flat_buffer or into the mapped file
+  const unsigned char *m_flat_descriptors;
+
+  /// Vocabulary loaded with loadFromBinaryFile
+  MappedTables m_mapped;
   
 };
 
@@ -434,7 +657,8 @@ template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
   (int k, int L, WeightingType weighting, ScoringType scoring)
   : m_k(k), m_L(L), m_weighting(weighting), m_scoring(scoring),
-  m_scoring_object(NULL)
+  m_scoring_object(NULL), m_flat_nodes(NULL), m_flat_size(0), 
+  m_flat_descriptors(NULL)
 {
   createScoringObject();
 }
@@ -443,7 +667,8 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const std::string &filename): m_scoring_object(NULL)
+  (const std::string &filename): m_scoring_object(NULL), 
+  m_flat_nodes(NULL), m_flat_size(0), m_flat_descriptors(NULL)
 {
   load(filename);
 }
@@ -452,7 +677,8 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const char *filename): m_scoring_object(NULL)
+  (const char *filename): m_scoring_object(NULL), 
+  m_flat_nodes(NULL), m_flat_size(0), m_flat_descriptors(NULL)
 {
   load(filename);
 }
@@ -516,7 +742,8 @@ void TemplatedVocabulary<TDescriptor,F>::setWeightingType(WeightingType type)
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary(
   const TemplatedVocabulary<TDescriptor, F> &voc)
-  : m_scoring_object(NULL)
+  : m_scoring_object(NULL), m_flat_nodes(NULL), m_flat_size(0), 
+  m_flat_descriptors(NULL)
 {
   *this = voc;
 }
@@ -548,6 +775,16 @@ TemplatedVocabulary<TDescriptor,F>::operator=
   
   this->m_nodes = voc.m_nodes;
   this->createWords();
+  this->createFlatTree();
+
+  // a mapped vocabulary shares the mapping
+  if(voc.isMapped())
+  {
+    this->m_mapped = voc.m_mapped;
+    this->m_flat_nodes = voc.m_flat_nodes;
+    this->m_flat_size = voc.m_flat_size;
+    this->m_flat_descriptors = voc.m_flat_descriptors;
+  }
   
   return *this;
 }
@@ -583,6 +820,8 @@ void TemplatedVocabulary<TDescriptor,F>::create(
 
   // and set the weight of each node of the tree
   setNodeWeights(training_features);
+
+  createFlatTree();
   
 }
 
@@ -939,6 +1178,103 @@ void TemplatedVocabulary<TDescriptor,F>::createWords()
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::createFlatTree()
+{
+  createFlatTree(std::integral_constant<bool, 
+    HasDistanceArgmin<F>::value>());
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::createFlatTree(std::false_type)
+{
+  m_flat_storage.clear();
+  m_flat_buffer.clear();
+  m_flat_nodes = NULL;
+  m_flat_size = 0;
+  m_flat_descriptors = NULL;
+  m_mapped = MappedTables();
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+template<class Batched>
+void TemplatedVocabulary<TDescriptor,F>::createFlatTree(Batched)
+{
+  createFlatTree(std::false_type());
+  if(m_nodes.empty()) return;
+
+  // number of slots whose descriptors fill whole cache lines, each block
+  // of siblings starts at a multiple of it
+  unsigned int align = 1;
+  while((align * F::L) % 64 != 0) ++align;
+
+  // first pass: number of slots, so that the records and the descriptors
+  // are allocated once and filled in place. The nodes are visited in the
+  // same breadth-first order as below
+  unsigned int nslots = 1; // slot 0 is the root, which has no descriptor
+  std::vector<unsigned int> pending(1, 0);
+  for(size_t q = 0; q < pending.size(); ++q)
+  {
+    const vector<NodeId> &children = m_nodes[pending[q]].children;
+    if(children.empty()) continue;
+    nslots = (nslots + align - 1) / align * align + children.size();
+    pending.insert(pending.end(), children.begin(), children.end());
+  }
+
+  m_flat_storage.resize(nslots);
+
+  // std::vector gives no alignment guarantee, so the descriptors are
+  // placed at the first 64-byte boundary of a slightly larger buffer.
+  // Padding slots and the root keep zero descriptors
+  m_flat_buffer.assign((size_t)nslots * F::L + 63, 0);
+  const size_t misalignment = 
+    reinterpret_cast<size_t>(&m_flat_buffer[0]) % 64;
+  unsigned char *descriptors = &m_flat_buffer[0] + 
+    (misalignment == 0 ? 0 : 64 - misalignment);
+
+  // breadth-first, so that the nodes of a level are also contiguous
+  unsigned int next = 1;
+  pending.assign(1, 0);
+  for(size_t q = 0; q < pending.size(); ++q)
+  {
+    const unsigned int slot = pending[q];
+    const vector<NodeId> &children = m_nodes[m_flat_storage[slot].id].children;
+    if(children.empty()) continue;
+
+    // padding slots are never reached, since distanceArgmin only returns
+    // indices below nchildren
+    const unsigned int first = (next + align - 1) / align * align;
+    next = first + children.size();
+
+    m_flat_storage[slot].first = first;
+    m_flat_storage[slot].nchildren = children.size();
+
+    for(size_t j = 0; j < children.size(); ++j)
+    {
+      const Node &child = m_nodes[children[j]];
+      FlatNode &flat = m_flat_storage[first + j];
+      flat.id = child.id;
+      flat.word_id = child.word_id;
+      flat.weight = child.weight;
+
+      const unsigned char *d = child.descriptor.template ptr<unsigned char>();
+      std::copy(d, d + F::L, descriptors + (size_t)(first + j) * F::L);
+
+      pending.push_back(first + j);
+    }
+  }
+
+  m_flat_nodes = &m_flat_storage[0];
+  m_flat_size = nslots;
+  m_flat_descriptors = descriptors;
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor,F>::setNodeWeights
   (const vector<vector<TDescriptor> > &training_features)
@@ -1000,7 +1336,7 @@ void TemplatedVocabulary<TDescriptor,F>::setNodeWeights
 template<class TDescriptor, class F>
 inline unsigned int TemplatedVocabulary<TDescriptor,F>::size() const
 {
-  return m_words.size();
+  return isMapped() ? m_mapped.nwords : m_words.size();
 }
 
 // --------------------------------------------------------------------------
@@ -1008,7 +1344,7 @@ inline unsigned int TemplatedVocabulary<TDescriptor,F>::size() const
 template<class TDescriptor, class F>
 inline bool TemplatedVocabulary<TDescriptor,F>::empty() const
 {
-  return m_words.empty();
+  return size() == 0;
 }
 
 // --------------------------------------------------------------------------
@@ -1017,6 +1353,17 @@ template<class TDescriptor, class F>
 float TemplatedVocabulary<TDescriptor,F>::getEffectiveLevels() const
 {
   long sum = 0;
+
+  if(isMapped())
+  {
+    for(unsigned int wid = 0; wid < m_mapped.nwords; ++wid)
+    {
+      NodeId id = m_flat_nodes[m_mapped.word_slots[wid]].id;
+      for(; id != 0; sum++) id = m_mapped.node_parents[id];
+    }
+    return (float)((double)sum / (double)m_mapped.nwords);
+  }
+
   typename std::vector<Node*>::const_iterator wit;
   for(wit = m_words.begin(); wit != m_words.end(); ++wit)
   {
@@ -1033,6 +1380,12 @@ float TemplatedVocabulary<TDescriptor,F>::getEffectiveLevels() const
 template<class TDescriptor, class F>
 TDescriptor TemplatedVocabulary<TDescriptor,F>::getWord(WordId wid) const
 {
+  if(isMapped())
+  {
+    const unsigned char *d = 
+      m_flat_descriptors + (size_t)m_mapped.word_slots[wid] * F::L;
+    return cv::Mat(1, F::L, CV_8U, const_cast<unsigned char*>(d)).clone();
+  }
   return m_words[wid]->descriptor;
 }
 
@@ -1041,6 +1394,8 @@ TDescriptor TemplatedVocabulary<TDescriptor,F>::getWord(WordId wid) const
 template<class TDescriptor, class F>
 WordValue TemplatedVocabulary<TDescriptor, F>::getWordWeight(WordId wid) const
 {
+  if(isMapped())
+    return m_flat_nodes[m_mapped.word_slots[wid]].weight;
   return m_words[wid]->weight;
 }
 
@@ -1239,10 +1594,19 @@ void TemplatedVocabulary<TDescriptor,F>::transform
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor,F>::transform(const TDescriptor &feature, 
   WordId &word_id, WordValue &weight, NodeId *nid, int levelsup) const
+{ 
+  descendTree(feature, word_id, weight, nid, levelsup, 
+    std::integral_constant<bool, HasDistanceArgmin<F>::value>());
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::descendTree(const TDescriptor &feature, 
+  WordId &word_id, WordValue &weight, NodeId *nid, int levelsup, 
+  std::false_type) const
 { 
   // propagate the feature down the tree
-  vector<NodeId> nodes;
-  typename vector<NodeId>::const_iterator nit;
 
   // level at which the node must be stored in nid, if given
   // m_L: depth levels, m_L = 6 in ORB-SLAM2
@@ -1257,14 +1621,15 @@ void TemplatedVocabulary<TDescriptor,F>::transform(const TDescriptor &feature,
   {
     // 更新树的深度
     ++current_level;
-    // 取出当前节点所有子节点的id
-    nodes = m_nodes[final_id].children;
+    // 在当前节点的所有子节点中找到和描述子距离最小的一个
+    const vector<NodeId> &nodes = m_nodes[final_id].children;
+
     // 取子节点中第1个的id，用于后面距离比较的初始值
     final_id = nodes[0];
-
-    // 取当前节点第一个子节点的描述子距离初始化最佳（小）距离
     double best_d = F::distance(feature, m_nodes[final_id].descriptor);
-    // 遍历nodes中所有的描述子，找到最小距离对应的描述子
+
+    // 遍历所有的子节点，找到最小距离对应的子节点
+    typename vector<NodeId>::const_iterator nit;
     for(nit = nodes.begin() + 1; nit != nodes.end(); ++nit)
     {
       NodeId id = *nit;
@@ -1290,10 +1655,56 @@ void TemplatedVocabulary<TDescriptor,F>::transform(const TDescriptor &feature,
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+template<class Batched>
+void TemplatedVocabulary<TDescriptor,F>::descendTree(const TDescriptor &feature, 
+  WordId &word_id, WordValue &weight, NodeId *nid, int levelsup, 
+  Batched) const
+{ 
+  const int nid_level = m_L - levelsup;
+  if(nid_level <= 0 && nid != NULL) *nid = 0; // root
+
+  const unsigned char *f = feature.template ptr<unsigned char>();
+  const FlatNode *node = m_flat_nodes; // root
+  int current_level = 0;
+
+  do
+  {
+    ++current_level;
+    // 当前节点的所有子节点的记录和描述子都连续存放，一次调用比较完所有子节点，
+    // 距离相同时取排在前面的子节点，和逐个比较的结果相同
+    int best_d;
+    const int best = F::distanceArgmin(f, 
+      m_flat_descriptors + (size_t)node->first * F::L, 
+      (int)node->nchildren, best_d);
+    node = &m_flat_nodes[node->first + best];
+
+    if(nid != NULL && current_level == nid_level)
+      *nid = node->id;
+
+  } while(node->nchildren > 0);
+
+  word_id = node->word_id;
+  weight = node->weight;
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 NodeId TemplatedVocabulary<TDescriptor,F>::getParentNode
   (WordId wid, int levelsup) const
 {
+  if(isMapped())
+  {
+    NodeId ret = m_flat_nodes[m_mapped.word_slots[wid]].id;
+    while(levelsup > 0 && ret != 0) // ret == 0 --> root
+    {
+      --levelsup;
+      ret = m_mapped.node_parents[ret];
+    }
+    return ret;
+  }
+
   NodeId ret = m_words[wid]->id; // node id
   while(levelsup > 0 && ret != 0) // ret == 0 --> root
   {
@@ -1310,6 +1721,33 @@ void TemplatedVocabulary<TDescriptor,F>::getWordsFromNode
   (NodeId nid, std::vector<WordId> &words) const
 {
   words.clear();
+
+  if(isMapped())
+  {
+    // same traversal as below, over the slots of the flat tree
+    vector<unsigned int> parents(1, m_mapped.node_slots[nid]);
+    if(m_flat_nodes[parents[0]].nchildren == 0)
+    {
+      words.push_back(m_flat_nodes[parents[0]].word_id);
+      return;
+    }
+
+    words.reserve(m_k);
+    while(!parents.empty())
+    {
+      const FlatNode &parent = m_flat_nodes[parents.back()];
+      parents.pop_back();
+
+      for(unsigned int c = parent.first; c < parent.first + parent.nchildren; ++c)
+      {
+        if(m_flat_nodes[c].nchildren == 0)
+          words.push_back(m_flat_nodes[c].word_id);
+        else
+          parents.push_back(c);
+      }
+    }
+    return;
+  }
   
   if(m_nodes[nid].isLeaf())
   {
@@ -1359,6 +1797,8 @@ int TemplatedVocabulary<TDescriptor,F>::stopWords(double minWeight)
       (*wit)->weight = 0;
     }
   }
+  // a mapped vocabulary has no m_words and is left as it is
+  if(c > 0) createFlatTree();
   return c;
 }
 
@@ -1412,6 +1852,9 @@ bool TemplatedVocabulary<TDescriptor,F>::loadFromTextFile(const std::string &fil
     {
         string snode;
         getline(f,snode);
+        // 跳过空行，文件末尾的换行符之后会读到一个空行
+        if(snode.find_first_not_of(" \t\r") == string::npos)
+            continue;
         stringstream ssnode;
         ssnode << snode;  
 
@@ -1465,12 +1908,234 @@ bool TemplatedVocabulary<TDescriptor,F>::loadFromTextFile(const std::string &fil
         }
     }
 
+    // 把每个节点的子节点描述子连续存放，用于下降时一次比较所有子节点
+    createFlatTree();
+
     return true;
 
 }
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::parseTextInt
+  (const char *&p, const char *eol, int &value)
+{
+  while(p < eol && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+
+  bool negative = false;
+  if(p < eol && *p == '-')
+  {
+    negative = true;
+    ++p;
+  }
+
+  const char *digits = p;
+  value = 0;
+  for(; p < eol && *p >= '0' && *p <= '9'; ++p)
+    value = value * 10 + (*p - '0');
+
+  if(negative) value = -value;
+  return p > digits;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::parseTextNode
+  (const char *line, const char *eol, Node &node, bool &isLeaf)
+{
+  const char *p = line;
+
+  int pid, nIsLeaf;
+  if(!parseTextInt(p, eol, pid) || !parseTextInt(p, eol, nIsLeaf) || pid < 0)
+    return false;
+  node.parent = pid;
+  isLeaf = nIsLeaf > 0;
+
+  // 和F::fromString一样，每个数字直接转为一个字节
+  node.descriptor.create(1, F::L, CV_8U);
+  unsigned char *d = node.descriptor.template ptr<unsigned char>();
+  for(int iD = 0; iD < F::L; ++iD)
+  {
+    int n;
+    if(!parseTextInt(p, eol, n)) return false;
+    d[iD] = (unsigned char)n;
+  }
+
+  // 权重可能是科学计数法，拷贝出来交给strtod，映射的文件不以'\0'结尾
+  while(p < eol && (*p == ' ' || *p == '\t')) ++p;
+  char buf[64];
+  size_t len = 0;
+  while(p + len < eol && len + 1 < sizeof(buf) && 
+    p[len] != ' ' && p[len] != '\t' && p[len] != '\r')
+  {
+    buf[len] = p[len];
+    ++len;
+  }
+  buf[len] = '\0';
+
+  char *end;
+  node.weight = strtod(buf, &end);
+  return len > 0 && end == buf + len;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::loadFromTextFileParallel
+  (const std::string &filename, int nThreads)
+{
+  DUtils::MappedFile file;
+  if(!file.open(filename))
+  {
+    std::cerr << "Vocabulary loading failure: cannot map " << filename << endl;
+    return false;
+  }
+
+  const char *begin = reinterpret_cast<const char*>(file.data());
+  const char *end = begin + file.size();
+
+  // 第一行是树的分支数、深度、评分方式和权重类型
+  const char *body = std::find(begin, end, '\n');
+  int k = -1, L = -1, n1 = -1, n2 = -1;
+  {
+    const char *p = begin;
+    if(!parseTextInt(p, body, k) || !parseTextInt(p, body, L) || 
+      !parseTextInt(p, body, n1) || !parseTextInt(p, body, n2))
+      k = -1;
+  }
+  if(body != end) ++body;
+
+  if(k<0 || k>20 || L<1 || L>10 || n1<0 || n1>5 || n2<0 || n2>3)
+  {
+    std::cerr << "Vocabulary loading failure: This is not a correct text file!" << endl;
+    return false;
+  }
+
+  if(nThreads <= 0) 
+    nThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+  // 在每个线程中执行job(线程编号)，当前线程执行第0个
+  auto run = [nThreads](const std::function<void(int)> &job)
+  {
+    vector<std::thread> threads;
+    for(int t = 1; t < nThreads; ++t)
+      threads.push_back(std::thread(job, t));
+    job(0);
+    for(size_t t = 0; t < threads.size(); ++t)
+      threads[t].join();
+  };
+
+  // 把文件分成nThreads块，每一块都从一行的开头开始
+  vector<const char*> chunks(nThreads + 1);
+  chunks[0] = body;
+  chunks[nThreads] = end;
+  for(int t = 1; t < nThreads; ++t)
+  {
+    const char *p = std::max(body + (end - body) / nThreads * t, chunks[t-1]);
+    p = std::find(p, end, '\n');
+    chunks[t] = p == end ? end : p + 1;
+  }
+
+  // 第一遍：统计每一块中的节点数（非空行），得到每一块第一个节点的id
+  vector<size_t> counts(nThreads, 0);
+  run([&](int t)
+  {
+    for(const char *line = chunks[t]; line < chunks[t+1]; )
+    {
+      const char *eol = std::find(line, chunks[t+1], '\n');
+      for(const char *p = line; p < eol; ++p)
+      {
+        if(*p != ' ' && *p != '\t' && *p != '\r')
+        {
+          ++counts[t];
+          break;
+        }
+      }
+      line = eol == chunks[t+1] ? eol : eol + 1;
+    }
+  });
+
+  vector<size_t> firsts(nThreads + 1, 1); // 0是根节点
+  for(int t = 0; t < nThreads; ++t)
+    firsts[t+1] = firsts[t] + counts[t];
+
+  // 第二遍：每个线程解析自己那一块的节点，写到各自的位置上
+  vector<Node> nodes(firsts[nThreads]);
+  vector<char> leaves(nodes.size(), 0);
+  vector<char> ok(nThreads, 1);
+  run([&](int t)
+  {
+    size_t nid = firsts[t];
+    for(const char *line = chunks[t]; line < chunks[t+1] && ok[t]; )
+    {
+      const char *eol = std::find(line, chunks[t+1], '\n');
+      const char *p = line;
+      while(p < eol && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+      if(p < eol)
+      {
+        Node &node = nodes[nid];
+        node.id = nid;
+        bool isLeaf;
+        if(parseTextNode(p, eol, node, isLeaf))
+        {
+          leaves[nid] = isLeaf;
+          if(!isLeaf) node.children.reserve(k);
+        }
+        else
+        {
+          std::cerr << "Vocabulary loading failure: malformed node " << nid << endl;
+          ok[t] = 0;
+        }
+        ++nid;
+      }
+      line = eol == chunks[t+1] ? eol : eol + 1;
+    }
+  });
+
+  if(std::find(ok.begin(), ok.end(), 0) != ok.end())
+    return false;
+
+  // 把子节点按id的顺序连接到父节点上，和逐行读取时的顺序相同
+  for(size_t nid = 1; nid < nodes.size(); ++nid)
+  {
+    const NodeId pid = nodes[nid].parent;
+    if(pid >= nid)
+    {
+      std::cerr << "Vocabulary loading failure: node " << nid 
+        << " has parent " << pid << endl;
+      return false;
+    }
+    nodes[pid].children.push_back(nid);
+  }
+
+  m_k = k;
+  m_L = L;
+  m_scoring = (ScoringType)n1;
+  m_weighting = (WeightingType)n2;
+  createScoringObject();
+
+  m_words.clear();
+  m_nodes.swap(nodes);
+
+  // 叶子（Word）按id的顺序分配Word id
+  for(size_t nid = 1; nid < m_nodes.size(); ++nid)
+  {
+    if(leaves[nid])
+    {
+      m_nodes[nid].word_id = m_words.size();
+      m_words.push_back(&m_nodes[nid]);
+    }
+  }
+
+  createFlatTree();
+
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor,F>::saveToTextFile(const std::string &filename) const
 {
@@ -1498,6 +2163,281 @@ void TemplatedVocabulary<TDescriptor,F>::saveToTextFile(const std::string &filen
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::binaryLayout
+  (const BinaryHeader &header, size_t offsets[6])
+{
+  static_assert(sizeof(BinaryHeader) == 64, "binary header must take 64 bytes");
+
+  const size_t sizes[5] = {
+    (size_t)header.nslots * header.node_record_bytes,
+    (size_t)header.nslots * header.descriptor_bytes,
+    (size_t)header.nwords * sizeof(unsigned int),
+    (size_t)header.nnodes * sizeof(unsigned int),
+    (size_t)header.nnodes * sizeof(NodeId)
+  };
+
+  size_t offset = sizeof(BinaryHeader);
+  for(int i = 0; i < 5; ++i)
+  {
+    offsets[i] = offset;
+    offset = (offset + sizes[i] + 63) / 64 * 64;
+  }
+  offsets[5] = offset;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+uint64_t TemplatedVocabulary<TDescriptor,F>::binaryChecksum
+  (const unsigned char *data, size_t size)
+{
+  // FNV-1a on 8 bytes at a time, the xor-shift carries the high bits of
+  // each step down to the low ones
+  uint64_t h = 14695981039346656037ULL;
+  for(size_t i = 0; i < size; i += 8)
+  {
+    uint64_t w;
+    memcpy(&w, data + i, 8);
+    h = (h ^ w) * 1099511628211ULL;
+    h ^= h >> 32;
+  }
+  return h;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::checkBinaryTables
+  (const BinaryHeader &header, const unsigned char *base, 
+  const size_t offsets[6])
+{
+  const FlatNode *nodes = reinterpret_cast<const FlatNode*>(base + offsets[0]);
+  const unsigned int *word_slots = 
+    reinterpret_cast<const unsigned int*>(base + offsets[2]);
+  const unsigned int *node_slots = 
+    reinterpret_cast<const unsigned int*>(base + offsets[3]);
+  const NodeId *node_parents = 
+    reinterpret_cast<const NodeId*>(base + offsets[4]);
+
+  if(nodes[0].id != 0 || nodes[0].nchildren == 0 || node_parents[0] != 0)
+    return false;
+
+  for(unsigned int slot = 0; slot < header.nslots; ++slot)
+  {
+    const FlatNode &node = nodes[slot];
+    if(node.id >= header.nnodes) return false;
+
+    if(node.nchildren == 0)
+    {
+      if(node.word_id >= header.nwords) return false;
+      continue;
+    }
+
+    // 子节点总是在父节点之后，这样沿着子节点向下查找一定会停止
+    if(node.first <= slot || 
+      (uint64_t)node.first + node.nchildren > header.nslots)
+      return false;
+
+    // 子节点的id要先检查，之后才能用它读取node_parents
+    for(unsigned int c = node.first; c < node.first + node.nchildren; ++c)
+    {
+      if(nodes[c].id >= header.nnodes || node_parents[nodes[c].id] != node.id) 
+        return false;
+    }
+  }
+
+  for(unsigned int wid = 0; wid < header.nwords; ++wid)
+  {
+    const unsigned int slot = word_slots[wid];
+    if(slot >= header.nslots || nodes[slot].nchildren != 0 || 
+      nodes[slot].word_id != wid)
+      return false;
+  }
+
+  // 父节点的id总是小于子节点的id，沿着父节点向上查找一定会到达根节点
+  for(NodeId nid = 0; nid < header.nnodes; ++nid)
+  {
+    const unsigned int slot = node_slots[nid];
+    if(slot >= header.nslots || nodes[slot].id != nid) return false;
+    if(nid > 0 && node_parents[nid] >= nid) return false;
+  }
+
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::saveToBinaryFile
+  (const std::string &filename) const
+{
+  if(!HasDistanceArgmin<F>::value || m_flat_nodes == NULL)
+  {
+    std::cerr << "Vocabulary saving failure: no flat tree to save" << endl;
+    return false;
+  }
+
+  BinaryHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "DBoW2bin", 8);
+  header.version = BINARY_VERSION;
+  header.byte_order = 0x01020304;
+  header.descriptor_bytes = F::L;
+  header.node_record_bytes = sizeof(FlatNode);
+  header.k = m_k;
+  header.L = m_L;
+  header.scoring = m_scoring;
+  header.weighting = m_weighting;
+  header.nslots = m_flat_size;
+  header.nwords = size();
+  header.nnodes = isMapped() ? m_mapped.nnodes : m_nodes.size();
+
+  // 由平铺的树得到每个单词和节点所在的位置以及每个节点的父节点，
+  // 这样从文本读取的词典和内存映射的词典都可以保存
+  vector<unsigned int> word_slots(header.nwords, 0);
+  vector<unsigned int> node_slots(header.nnodes, 0);
+  vector<NodeId> node_parents(header.nnodes, 0);
+  for(unsigned int slot = 0; slot < m_flat_size; ++slot)
+  {
+    const FlatNode &parent = m_flat_nodes[slot];
+    for(unsigned int c = parent.first; c < parent.first + parent.nchildren; ++c)
+    {
+      const FlatNode &child = m_flat_nodes[c];
+      node_slots[child.id] = c;
+      node_parents[child.id] = parent.id;
+      if(child.nchildren == 0)
+        word_slots[child.word_id] = c;
+    }
+  }
+
+  size_t offsets[6];
+  binaryLayout(header, offsets);
+
+  // 各段之间的填充都是0，保证同一个词典总是得到相同的文件
+  vector<unsigned char> payload(offsets[5] - sizeof(BinaryHeader), 0);
+  const unsigned char *sections[5] = {
+    reinterpret_cast<const unsigned char*>(m_flat_nodes),
+    m_flat_descriptors,
+    reinterpret_cast<const unsigned char*>(word_slots.data()),
+    reinterpret_cast<const unsigned char*>(node_slots.data()),
+    reinterpret_cast<const unsigned char*>(node_parents.data())
+  };
+  const size_t sizes[5] = {
+    (size_t)m_flat_size * sizeof(FlatNode),
+    (size_t)m_flat_size * F::L,
+    word_slots.size() * sizeof(unsigned int),
+    node_slots.size() * sizeof(unsigned int),
+    node_parents.size() * sizeof(NodeId)
+  };
+  for(int i = 0; i < 5; ++i)
+  {
+    if(sizes[i] > 0)
+      memcpy(&payload[offsets[i] - sizeof(BinaryHeader)], sections[i], sizes[i]);
+  }
+
+  header.checksum = binaryChecksum(payload.data(), payload.size());
+
+  ofstream f(filename.c_str(), ios_base::out | ios_base::binary);
+  f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  f.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+  f.close();
+
+  if(!f)
+  {
+    std::cerr << "Vocabulary saving failure: cannot write " << filename << endl;
+    return false;
+  }
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::loadFromBinaryFile
+  (const std::string &filename)
+{
+  if(!HasDistanceArgmin<F>::value)
+  {
+    std::cerr << "Vocabulary loading failure: binary vocabularies need F::distanceArgmin" << endl;
+    return false;
+  }
+
+  std::shared_ptr<DUtils::MappedFile> file(new DUtils::MappedFile);
+  if(!file->open(filename))
+  {
+    std::cerr << "Vocabulary loading failure: cannot map " << filename << endl;
+    return false;
+  }
+
+  // 检查文件头和文件大小，出错时不修改当前的词典
+  BinaryHeader header;
+  size_t offsets[6];
+  bool ok = file->size() >= sizeof(BinaryHeader);
+  if(ok)
+  {
+    memcpy(&header, file->data(), sizeof(BinaryHeader));
+    binaryLayout(header, offsets);
+    ok = memcmp(header.magic, "DBoW2bin", 8) == 0 &&
+      header.version == BINARY_VERSION &&
+      header.byte_order == 0x01020304 &&
+      header.descriptor_bytes == (uint32_t)F::L &&
+      header.node_record_bytes == sizeof(FlatNode) &&
+      header.k > 0 && header.L > 0 && 
+      header.scoring >= 0 && header.scoring <= 5 &&
+      header.weighting >= 0 && header.weighting <= 3 &&
+      header.nslots > 0 && header.nwords > 0 && header.nnodes > 0 &&
+      offsets[5] == file->size();
+  }
+  if(!ok)
+  {
+    std::cerr << "Vocabulary loading failure: This is not a correct binary file!" << endl;
+    return false;
+  }
+
+  // 校验一遍整个文件，这也是唯一一次读取所有的页
+  if(binaryChecksum(file->data() + sizeof(BinaryHeader), 
+    file->size() - sizeof(BinaryHeader)) != header.checksum)
+  {
+    std::cerr << "Vocabulary loading failure: wrong checksum in " << filename << endl;
+    return false;
+  }
+
+  // 校验和只能发现文件损坏，生成文件的程序出错时各个表中的下标也可能越界
+  if(!checkBinaryTables(header, file->data(), offsets))
+  {
+    std::cerr << "Vocabulary loading failure: wrong tables in " << filename << endl;
+    return false;
+  }
+
+  m_k = header.k;
+  m_L = header.L;
+  m_scoring = (ScoringType)header.scoring;
+  m_weighting = (WeightingType)header.weighting;
+  createScoringObject();
+
+  // 释放之前的树，所有的查询都直接使用映射的文件
+  vector<Node*>().swap(m_words);
+  vector<Node>().swap(m_nodes);
+  createFlatTree(std::false_type());
+
+  const unsigned char *base = file->data();
+  m_flat_nodes = reinterpret_cast<const FlatNode*>(base + offsets[0]);
+  m_flat_size = header.nslots;
+  m_flat_descriptors = base + offsets[1];
+
+  m_mapped.file = file;
+  m_mapped.nwords = header.nwords;
+  m_mapped.nnodes = header.nnodes;
+  m_mapped.word_slots = reinterpret_cast<const unsigned int*>(base + offsets[2]);
+  m_mapped.node_slots = reinterpret_cast<const unsigned int*>(base + offsets[3]);
+  m_mapped.node_parents = reinterpret_cast<const NodeId*>(base + offsets[4]);
+
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor,F>::save(const std::string &filename) const
 {
@@ -1667,6 +2607,8 @@ void TemplatedVocabulary<TDescriptor,F>::load(const cv::FileStorage &fs,
     m_nodes[nid].word_id = wid;
     m_words[wid] = &m_nodes[nid];
   }
+
+  createFlatTree();
 }
 
 // --------------------------------------------------------------------------
@@ -0,0 +1,58 @@
+/*
+ * File: MappedFile.cpp
+ * Project: DUtils library
+ * Description: read-only memory mapping of a whole file
+ * License: see the LICENSE.txt file
+ *
+ */
+
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+DUtils::MappedFile::MappedFile(): m_data(NULL), m_size(0)
+{
+}
+
+DUtils::MappedFile::~MappedFile()
+{
+  close();
+}
+
+bool DUtils::MappedFile::open(const std::string &filename)
+{
+  close();
+
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if(fd < 0) return false;
+
+  struct stat st;
+  if(fstat(fd, &st) != 0 || st.st_size <= 0)
+  {
+    ::close(fd);
+    return false;
+  }
+
+  // the mapping keeps its own reference to the file
+  void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if(p == MAP_FAILED) return false;
+
+  m_data = static_cast<const unsigned char*>(p);
+  m_size = (size_t)st.st_size;
+  return true;
+}
+
+void DUtils::MappedFile::close()
+{
+  if(m_data != NULL)
+    munmap(const_cast<unsigned char*>(m_data), m_size);
+
+  m_data = NULL;
+  m_size = 0;
+}
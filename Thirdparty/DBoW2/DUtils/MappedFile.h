@@ -0,0 +1,70 @@
+/*
+ * File: MappedFile.h
+ * Project: DUtils library
+ * Description: read-only memory mapping of a whole file
+ * License: see the LICENSE.txt file
+ *
+ */
+
+#ifndef __D_MAPPED_FILE__
+#define __D_MAPPED_FILE__
+
+#include <cstddef>
+#include <string>
+
+namespace DUtils {
+
+/// Read-only memory mapping of a whole file. The mapping is shared, so
+/// every process that maps the same file uses the same physical pages
+class MappedFile
+{
+public:
+
+  /**
+   * Creates an empty mapping
+   */
+  MappedFile();
+
+  /**
+   * Unmaps the file
+   */
+  ~MappedFile();
+
+  /**
+   * Maps the given file, unmapping the previous one
+   * @param filename
+   * @return false if the file could not be opened or mapped
+   */
+  bool open(const std::string &filename);
+
+  /**
+   * Unmaps the file
+   */
+  void close();
+
+  /**
+   * Returns the start of the mapped file (page aligned), or NULL
+   */
+  inline const unsigned char* data() const { return m_data; }
+
+  /**
+   * Returns the size of the mapped file in bytes
+   */
+  inline size_t size() const { return m_size; }
+
+private:
+
+  // non copyable
+  MappedFile(const MappedFile &);
+  MappedFile& operator=(const MappedFile &);
+
+  /// Start of the mapping
+  const unsigned char *m_data;
+
+  /// Size of the mapping
+  size_t m_size;
+};
+
+}
+
+#endif
@@ -4,39 +4,104 @@
 
 
 #include <vector>
-#include <list>
 #include <opencv/cv.h>
+#include <functional>
+#include <chrono>
+#include <memory>
+#include <cstdint>
+
+#include "ThreadPool.h"
+#include "ORBprofiler.h"
 
 //主要实现ORB特征点的提取以及数目的分配功能
 
 namespace ORB_SLAM2
 {
 
+//四叉树中的一个提取器节点。节点中的特征点不再单独存储，而是特征点索引数组中连续的一段[nBegin,nEnd)，
+//分裂节点时在原地把这一段划分成4段，所以分裂不会拷贝特征点，也不会分配内存
 class ExtractorNode
 {
 
 public:
-    ExtractorNode():bNoMore(false){}
+    ExtractorNode():nBegin(0),nEnd(0),bNoMore(false){}
 
-    void DivideNode(ExtractorNode &n1,ExtractorNode &n2,ExtractorNode &n3,ExtractorNode &n4);
-    
-    //保存当前节点的特征点
-    std::vector<cv::KeyPoint> vKeys;
-    //当前节点所对应的图像坐标的边界
-    cv::Point2i UL,UR,BL,BR;
+    /**
+     * @brief 将节点分裂成4个子节点，并把本节点的特征点索引稳定地（保持原有的先后顺序）划分给子节点
+     * @param[in] vKeys 所有待分配的特征点
+     * @param[in&out] vIndices 特征点索引数组，本节点对应的那一段会被重新排列成n1,n2,n3,n4四段
+     * @param[in] vScratch 临时缓存，大小不小于vIndices
+     */
+    void DivideNode(ExtractorNode &n1,ExtractorNode &n2,ExtractorNode &n3,ExtractorNode &n4,
+                    const std::vector<cv::KeyPoint> &vKeys,std::vector<int> &vIndices,std::vector<int> &vScratch);
+
+    //节点中特征点的数目
+    int inline size() const{
+        return nEnd-nBegin;
+    }
+
+    //当前节点所对应的图像区域的左上角和右下角
+    cv::Point2i UL,BR;
 
-    //存储提取器节点的列表（双向列表）的一个迭代器
-    //这个迭代器的提供了访问总结点列表的方式
-    std::list<ExtractorNode>::iterator lit;
+    //当前节点的特征点在索引数组中的范围
+    int nBegin,nEnd;
 
     //如果节点中只有一个特征点的话，说明这个节点不可以再分裂，这是一个标志位
-    //这个节点中如果没有了特征点，那么这个节点就会被删除
     bool bNoMore;
 
 };
 
+//分配特征点时使用的缓存，每层图像一份（各层可以并行分配），跨帧复用
+struct DistributionBuffer
+{
+    std::vector<ExtractorNode> vNodes;   //所有创建过的节点，节点之间通过在这里的下标引用
+    std::vector<int> vIndices;           //特征点索引数组，每个节点是其中连续的一段
+    std::vector<int> vScratch;           //分裂节点时划分索引用的临时缓存
+    std::vector<int> vOrder;             //当前所有节点的遍历顺序（对应原来std::list中的顺序）
+    std::vector<int> vOrderTmp;          //生成新顺序时的临时缓存
+    std::vector<int> vFront;             //一轮分裂中新生成的节点，对应原来push_front到list中的节点
+    std::vector<std::pair<int,int> > vSizeAndNode;      //可以继续分裂的节点的特征点数目和下标
+    std::vector<std::pair<int,int> > vPrevSizeAndNode;  //上一轮中可以继续分裂的节点
+
+    std::vector<int> vGrid;              //ANMS/SSC/网格分配时的网格（链表头、覆盖标志或者计数）
+    std::vector<int> vNext;              //ANMS中网格内链表的下一个元素
+    std::vector<float> vRadius;          //ANMS中每个特征点的抑制半径的平方
+};
+
 
+//结构数组（SoA）形式的特征点和描述子输出。每个数组都单独按64字节对齐，描述子是连续存放的N行（默认32字节），
+//方便匹配时用SIMD指令顺序扫描。内存在多帧之间复用，只有特征点数目超过之前的最大值时才会重新分配
+struct ORBFeatures
+{
+    ORBFeatures():N(0),nDescriptorBytes(32),x(NULL),y(NULL),angle(NULL),response(NULL),octave(NULL),descriptors(NULL){}
+
+    //各个指针指向自己的mvBuffer，直接拷贝的话会指向原来对象的内存，所以禁止拷贝
+    ORBFeatures(const ORBFeatures&)=delete;
+    ORBFeatures& operator=(const ORBFeatures&)=delete;
+
+    /**
+     * @brief 调整为可以存放n个特征点，数组中原有的内容不保留
+     * @param[in] n 特征点数目
+     * @param[in] nBytes 每个描述子的字节数
+     */
+    void Resize(const int &n,const int &nBytes=32);
 
+    //描述子矩阵（N行nDescriptorBytes列），和descriptors共享内存，不拷贝
+    cv::Mat GetDescriptors() const{
+        return cv::Mat(N,nDescriptorBytes,CV_8U,descriptors);
+    }
+
+    int N;                  //特征点数目
+    int nDescriptorBytes;   //每个描述子的字节数
+    float* x;               //第0层图像中的坐标
+    float* y;
+    float* angle;           //方向，单位度
+    float* response;        //响应值
+    int* octave;            //所在的金字塔层
+    uchar* descriptors;     //N*nDescriptorBytes字节的描述子，第i个特征点的描述子从descriptors+nDescriptorBytes*i开始
+
+    std::vector<uchar> mvBuffer;    //所有数组所在的内存
+};
 
 class ORBextractor
 {
@@ -46,19 +111,69 @@ public:
     //定义一个枚举类型用于表示是HARRIS_SCORE响应值还是FAST响应值
     enum {HARRIS_SCORE=0,FAST_SCORE=1};
 
+    //特征点的分配方式：四叉树、自适应非极大值抑制（ANMS）、正方形覆盖抑制（SSC）、固定网格取前k个
+    enum {DISTRIBUTE_OCTTREE=0,DISTRIBUTE_ANMS=1,DISTRIBUTE_SSC=2,DISTRIBUTE_GRID=3};
+
+    //描述子的计算方式：按精确角度旋转采样点、查找表加运行时选择的SIMD核函数、查找表加标量核函数
+    enum {DESCRIPTOR_EXACT=0,DESCRIPTOR_LUT=1,DESCRIPTOR_LUT_SCALAR=2};
 
-    ORBextractor(int nfeatures,float scaleFactor ,int nlevels,int iniThFAST,int minTHFAST);
+
+    /**
+     * @brief 构造函数
+     * @param[in] imageSize 输入图像的尺寸，给出时在构造阶段就分配好金字塔缓存；不给出时在第一帧分配
+     * @param[in] nDescriptorBytes 描述子的字节数，32（默认，256位）或16（128位）。16字节的描述子只使用
+     * 采样点集中的前128对点，不能和按256位训练的词典一起使用
+     */
+    ORBextractor(int nfeatures,float scaleFactor ,int nlevels,int iniThFAST,int minTHFAST,cv::Size imageSize=cv::Size(),
+                 int nDescriptorBytes=32);
     ~ORBextractor(){}
 
 
+    /**
+     * @brief 提取特征点并计算描述子
+     * @param[in] image 单通道灰度图像
+     * @param[in] mask 和image同样大小的单通道掩码，只在非0的像素上提取特征点，为空时不使用掩码。
+     * 掩码会缩放到金字塔的每一层，全部被遮挡的网格不进行FAST检测，各层的特征点数目也按未被遮挡的面积重新分配，总数不变
+     * @param[out] keypoints 特征点
+     * @param[out] descriptors 描述子，每行对应一个特征点
+     */
     void operator()(cv::InputArray image,cv::InputArray mask,std::vector<cv::KeyPoint>& keypoints,cv::OutputArray descriptors);
 
+    /**
+     * @brief 提取特征点，以结构数组的形式输出
+     * @details 各层计算完描述子之后直接把特征点写到features的各个数组中，描述子直接写到features的描述子内存中，
+     * 不经过输出的vector<cv::KeyPoint>和描述子矩阵。特征点的顺序、坐标和描述子与另一个operator()的输出相同
+     * @param[out] features 输出的特征点和描述子
+     */
+    void operator()(cv::InputArray image,cv::InputArray mask,ORBFeatures &features);
+
+    /**
+     * @brief 同时提取多幅图像（双目的左右图像、多相机）的特征点
+     * @details 所有图像的同一步骤（构建金字塔、所有网格的FAST检测、所有层的分配、所有层的描述子）合并成一批任务在同一个线程池中执行，
+     * 这样一幅图像的层数不足以占满所有线程时，其它图像的任务可以填补空闲的线程。每幅图像使用自己的提取器（各自的缓存、参数和统计），
+     * 结果和分别调用各提取器的operator()完全相同
+     * @param[in] vpExtractors 每幅图像使用的提取器，不能重复
+     * @param[in] vImages 单通道灰度图像，为空的图像输出空的结果
+     * @param[out] vvKeypoints 每幅图像的特征点
+     * @param[out] vDescriptors 每幅图像的描述子
+     * @param[in] pThreadPool 线程池，为NULL时串行执行
+     * @param[in] vMasks 每幅图像的掩码，为空时都不使用掩码
+     */
+    static void ExtractBatch(const std::vector<ORBextractor*> &vpExtractors,const std::vector<cv::Mat> &vImages,
+                             std::vector<std::vector<cv::KeyPoint> > &vvKeypoints,std::vector<cv::Mat> &vDescriptors,
+                             ThreadPool* pThreadPool,const std::vector<cv::Mat> &vMasks=std::vector<cv::Mat>());
+
 
     //返回图像金字塔的层数
     int inline GetLevels(){
         return nlevels;
     }
 
+    //返回描述子的字节数
+    int inline GetDescriptorBytes(){
+        return mnDescriptorBytes;
+    }
+
     //获取当前提取器所在图像的缩放因子，这个不带s的因子表示是想临近层之间的
     float inline GetScaleFactor(){
         return scaleFactor;
@@ -93,6 +208,154 @@ public:
         return mvInvLevelSigma2;
     }
 
+    /**
+     * @brief 设置并行提取时使用的线程池
+     * @details 设置之后，金字塔各层的特征点提取、高斯模糊和描述子计算会作为相互独立的任务在线程池中并行执行，
+     * 输出的特征点顺序和描述子与串行时完全一致。线程池由调用者创建和释放，可以被多个提取器共享
+     * @param[in] pThreadPool 线程池，为NULL时（默认）串行执行
+     */
+    void SetThreadPool(ThreadPool* pThreadPool);
+
+    /**
+     * @brief 设置描述子的计算方式
+     * @details 默认使用预先旋转好的采样点查找表（特征点方向离散到30个区间）和SIMD核函数计算描述子，
+     * 并且只对特征点附近的区域做定点的高斯模糊；设置为true时使用GaussianBlur模糊整层图像，
+     * 再逐个特征点按精确角度旋转采样点的原始方式，主要用于对比
+     * @param[in] bExact 是否使用原始的精确旋转方式
+     */
+    void SetExactDescriptors(bool bExact);
+
+    /**
+     * @brief 不经过金字塔和特征点提取，直接计算一幅（已经模糊的）图像上特征点的描述子，用于单独测试和对比各种计算方式
+     * @details 特征点到图像边界的距离要大于EDGE_THRESHOLD。查找表的两种方式结果完全相同；特征点的方向正好是12度的整数倍时，
+     * 查找表方式和精确方式的结果也完全相同
+     * @param[in] image 单通道灰度图像
+     * @param[in] keypoints 特征点，需要已经计算好方向
+     * @param[out] descriptors 描述子，每行对应一个特征点
+     * @param[in] method DESCRIPTOR_EXACT、DESCRIPTOR_LUT或DESCRIPTOR_LUT_SCALAR
+     */
+    static void ComputeDescriptors(const cv::Mat &image,const std::vector<cv::KeyPoint> &keypoints,cv::Mat &descriptors,const int &method);
+
+    /**
+     * @brief 设置金字塔的构建方式
+     * @details 默认分别调用resize、copyMakeBorder构建金字塔，在计算描述子前再对每层做GaussianBlur；
+     * 设置为true时每层只按行扫描一遍，同时完成缩放、补边和模糊。缩放和模糊都是定点运算，金字塔图像和模糊图像
+     * 可能与默认方式有±1的差别，因此检测到的特征点也可能不完全相同
+     * @param[in] bFused 是否使用融合的构建方式
+     */
+    void SetFusedPyramid(bool bFused);
+
+    /**
+     * @brief 设置每层图像中特征点的分配方式
+     * @param[in] method DISTRIBUTE_OCTTREE（默认）、DISTRIBUTE_ANMS、DISTRIBUTE_SSC或DISTRIBUTE_GRID
+     */
+    void SetDistributionMethod(int method);
+
+    //获取当前的特征点分配方式
+    int inline GetDistributionMethod(){
+        return mnDistributionMethod;
+    }
+
+    /**
+     * @brief 设置分配特征点时使用的角点响应值
+     * @details FAST_SCORE（默认）直接使用FAST检测时的响应值；HARRIS_SCORE在分配之前，对每层所有的候选角点
+     * 一次扫描计算Harris响应值（7x7窗口，k=0.04），分配时按Harris响应值排序和挑选，输出特征点的response也是Harris响应值
+     * @param[in] scoreType HARRIS_SCORE或FAST_SCORE
+     */
+    void SetScoreType(int scoreType);
+
+    //获取当前使用的角点响应值
+    int inline GetScoreType(){
+        return mnScoreType;
+    }
+
+    /**
+     * @brief 获取最近一帧中，当前分配方式在各层上所用时间之和，单位ms
+     * @details 各层并行时这里是各层时间之和，而不是墙上时间
+     */
+    double GetLastDistributionTime();
+
+    /**
+     * @brief 设置每帧的时间预算（时间预算模式）
+     * @details 大于0时，根据之前各帧各层各阶段的耗时，调整下一帧每层要提取的特征点数目和每层的FAST阈值，使每帧的提取时间保持在预算之内。
+     * 超出预算时迅速减少特征点，有余量时缓慢恢复，特征点数目不超过构造时的nfeatures。设置时会恢复构造时的特征点数目和阈值
+     * @param[in] dBudget 每帧的时间预算，单位ms，小于等于0时（默认）关闭
+     */
+    void SetTimeBudget(double dBudget);
+
+    //获取每帧的时间预算，单位ms，0表示没有开启
+    double inline GetTimeBudget(){
+        return mdTimeBudget;
+    }
+
+    //获取下一帧要提取的特征点总数，没有开启时间预算模式时就是nfeatures
+    int inline GetBudgetFeatures(){
+        return mnBudgetFeatures;
+    }
+
+    //获取最近一帧提取所用的时间，单位ms，只在开启时间预算模式或者耗时统计时记录
+    double inline GetLastFrameTime(){
+        return mdFrameTime;
+    }
+
+    /**
+     * @brief 设置视频模式
+     * @details 视频模式下记录每个网格上次检测FAST角点时的内容（均匀采样的8x8个像素），之后每帧先比较网格内容的平均绝对差，
+     * 只有变化超过阈值或者网格内掩码有变化的网格才重新检测，其余网格直接复用上次的角点，适合相机基本静止、大部分画面不变的场景。
+     * 为了避免误差累积，每个网格至少每nRefresh帧重新检测一次（各网格错开）
+     * @param[in] bVideo 是否开启
+     * @param[in] fThreshold 平均每个像素的灰度差超过这个值时认为网格内容发生了变化
+     * @param[in] nRefresh 强制重新检测的周期，单位帧
+     */
+    void SetVideoMode(bool bVideo,float fThreshold=4.f,int nRefresh=10);
+
+    //获取最近一帧中复用了上次检测结果的网格数目
+    int GetLastReusedCells();
+
+    /**
+     * @brief 获取最近一帧中，提取器内部缓存（金字塔、模糊图像以及所有跨帧复用的容器）发生堆内存分配的次数
+     * @details 只有第一帧或者图像尺寸变化时才会分配，预热之后每帧都应该为0。
+     * 容器按容量是否变化统计，一帧内同一个容器多次扩容只记一次
+     */
+    int inline GetLastFrameAllocations(){
+        return mnFrameAllocations;
+    }
+
+    //获取自构造以来内部缓存发生堆内存分配的总次数
+    long unsigned int inline GetTotalAllocations(){
+        return mnTotalAllocations;
+    }
+
+    /**
+     * @brief 获取各阶段的耗时统计
+     * @details 编译时定义了ORB_PROFILING才会记录每帧中构建金字塔、检测、分配、方向、模糊、描述子各阶段在各层上的耗时和特征点数目，
+     * 可以用Snapshot取出原始记录，或者用Dump输出各阶段的百分位数
+     */
+    ORBprofiler& GetProfiler(){
+        return mProfiler;
+    }
+
+    /**
+     * @brief 开启或者关闭耗时统计
+     * @details 只有编译时定义了ORB_PROFILING才有效，此时默认开启；用于在同一个程序中比较统计本身的开销
+     * @param[in] bProfiling 是否记录各阶段的耗时
+     */
+    void SetProfiling(const bool &bProfiling);
+
+    /**
+     * @brief 获取最近一帧每层模糊后的图像（不带边界），是指向内部缓存的浅拷贝
+     * @details 只有融合的构建方式或者精确描述子方式下才是整层模糊的结果，默认方式下只有特征点附近的区域被模糊
+     */
+    std::vector<cv::Mat> inline GetBlurPyramid(){
+        return mvBlurPyramid;
+    }
+
+    //编译期特化的核函数类型，构造时按描述子的字节数指向相应配置（见ORBextractor.cc中的ORBConfig）的实例
+    typedef void (*OrientationFunc)(const cv::Mat &image,std::vector<cv::KeyPoint> &keypoints);
+    typedef void (*DescriptorFunc)(const cv::Mat &image,const std::vector<cv::KeyPoint> &keypoints,cv::Mat &descriptors);
+    typedef void (*DescriptorLUTFunc)(const cv::Mat &image,const std::vector<cv::KeyPoint> &keypoints,cv::Mat &descriptors,
+                                      const std::vector<int> &vOffsets);
+
     //用于存储图像金子塔的变量，一个元素存储一个图像
     std::vector<cv::Mat> mvImagePyramid;
 
@@ -105,6 +368,54 @@ protected:
     */
     void ComputerPyramid(cv::Mat image);
 
+    /**
+     * @brief 根据图像尺寸一次性分配金字塔及其模糊图像的缓存，之后各帧复用
+     * @param[in] imageSize 第0层图像的尺寸
+    */
+    void AllocatePyramid(const cv::Size &imageSize);
+
+    /**
+     * @brief 开始处理一帧：清零本帧的统计，构建图像金字塔和掩码金字塔
+    */
+    void BeginFrame(const cv::Mat &image,const cv::Mat &mask);
+
+    /**
+     * @brief 有掩码时，按照各层未被遮挡的面积比例重新分配各层的特征点数目，在所有网格检测完之后调用
+    */
+    void ComputeMaskedFeaturesPerLevel();
+
+    /**
+     * @brief 创建存放整个金字塔描述子的矩阵，并计算每层描述子的起始行
+    */
+    void PrepareDescriptors(cv::OutputArray _descriptors);
+
+    /**
+     * @brief 对某一层图像进行高斯模糊，计算该层特征点的描述子，并把特征点坐标恢复到第0层，各层之间可以并行调用
+    */
+    void ComputeDescriptorsLevel(const int &level);
+
+    /**
+     * @brief 按层的顺序输出特征点，和描述子矩阵的行一一对应
+    */
+    void CollectKeyPoints(std::vector<cv::KeyPoint> &_keypoints);
+
+    /**
+     * @brief 把某一层的特征点写到结构数组中该层对应的位置，各层之间可以并行调用
+    */
+    void CollectKeyPointsLevel(const int &level,ORBFeatures &features);
+
+    /**
+     * @brief 结束一帧：更新统计和时间预算
+    */
+    void EndFrame();
+
+    /**
+     * @brief 按固定的顺序遍历所有跨帧复用的容器，记录或者比较它们的容量
+     * @param[in] bRecord 为true时记录当前的容量，为false时和记录的容量比较
+     * @return 比较时容量发生变化的容器个数
+    */
+    int TrackBufferCapacities(const bool &bRecord);
+
     /**
      * @brief 以八叉树分配特征点的方式，计算图像的金字塔中的特征点
      * @details 这里两层vector表示，第一个表示图像中的所有特征点，第二层表示存储图像金字塔中所有图像的vector of keypoints
@@ -112,13 +423,90 @@ protected:
     */
     void ComputeKeyPointsOctTree(std::vector<std::vector<cv::KeyPoint>> & allKeypoints);
 
+    /**
+     * @brief 计算金字塔中某一层的特征点，各层之间相互独立，可以并行调用
+     * @param[in] level 金字塔层
+     * @param[out] keypoints 该层提取到的特征点
+    */
+    void ComputeKeyPointsOctTreeLevel(const int &level,std::vector<cv::KeyPoint> &keypoints);
+
+    /**
+     * @brief 在某一层的一个网格中检测FAST角点，先使用iniThFAST，检测不到时再使用minThFAST
+     * @details 结果写到该网格自己的缓存mvvCellKeys[cell]中，所有网格之间可以并行调用
+     * @param[in] level 金字塔层
+     * @param[in] cell 网格在所有层的网格中的编号
+    */
+    void ComputeCellKeyPoints(const int &level,const int &cell);
+
+    /**
+     * @brief 根据各层图像的尺寸划分检测FAST角点的网格
+    */
+    void ComputeCellGrid();
+
+    /**
+     * @brief 按照等比数列把nFeatures个特征点分配到每层图像
+     * @param[in] nFeatures 整个金字塔中要提取的特征点数目
+     * @param[out] vFeaturesPerLevel 每层要提取的特征点数目
+    */
+    void ComputeFeaturesPerLevel(const int &nFeatures,std::vector<int> &vFeaturesPerLevel);
+
+    /**
+     * @brief 时间预算模式下，根据本帧的耗时调整下一帧每层的特征点数目和FAST阈值
+     * @param[in] nKeys 本帧提取到的特征点数目
+    */
+    void UpdateBudget(const int &nKeys);
+
+    /**
+     * @brief 执行f(0)...f(n-1)，设置了线程池时并行执行，否则串行执行
+    */
+    void RunParallel(const int &n,const std::function<void(int)> &f);
+
     /**
      * @brief 对于某一图层，分配其特征点，通过八叉树的方式
+     * @details 节点和特征点索引都存放在该层的DistributionBuffer中，不同层可以并行调用
      * @param[in] vToDistributeKeys 等待分发的特征点
+     * @param[in] level 金字塔图层，用于选择该层的缓存
+     * @param[out] vResultKeys 分配后保留下来的特征点
+    */
+    void DistributeOctTree(
+        const std::vector<cv::KeyPoint> &vToDistributeKeys,const int &minX,const int &maxX,const int &minY,const int &maxY,
+        const int &nFeatures,const int &level,std::vector<cv::KeyPoint> &vResultKeys
+    );
+
+    /**
+     * @brief 按照mnDistributionMethod选择的方式分配某一层的特征点，并记录所用的时间
+     * @details 参数和DistributeOctTree相同，特征点的坐标是相对于(minX,minY)的
+    */
+    void DistributeKeyPoints(
+        const std::vector<cv::KeyPoint> &vToDistributeKeys,const int &minX,const int &maxX,const int &minY,const int &maxY,
+        const int &nFeatures,const int &level,std::vector<cv::KeyPoint> &vResultKeys
+    );
+
+    /**
+     * @brief 自适应非极大值抑制（ANMS）：每个特征点的抑制半径是它到最近的响应值更大的特征点的距离，保留半径最大的nFeatures个
+     * @details 按响应值从大到小把特征点插入网格，在网格中由近及远地搜索最近点，平均复杂度O(n log n)
+    */
+    void DistributeANMS(
+        const std::vector<cv::KeyPoint> &vToDistributeKeys,const int &minX,const int &maxX,const int &minY,const int &maxY,
+        const int &nFeatures,const int &level,std::vector<cv::KeyPoint> &vResultKeys
+    );
+
+    /**
+     * @brief 正方形覆盖抑制（SSC）：二分查找抑制宽度，每个宽度下按响应值从大到小贪心选择未被覆盖的特征点，
+     * 并用边长为宽度一半的网格标记其周围被覆盖的区域，直到选出的数目接近nFeatures
+    */
+    void DistributeSSC(
+        const std::vector<cv::KeyPoint> &vToDistributeKeys,const int &minX,const int &maxX,const int &minY,const int &maxY,
+        const int &nFeatures,const int &level,std::vector<cv::KeyPoint> &vResultKeys
+    );
+
+    /**
+     * @brief 固定网格：把图像分成大约nFeatures个网格，每个网格保留响应值最大的前k个特征点，
+     * 多了按响应值截断，少了用剩下的特征点中响应值大的补足
     */
-    std::vector<cv::KeyPoint> DistributeOctTree(
+    void DistributeGrid(
         const std::vector<cv::KeyPoint> &vToDistributeKeys,const int &minX,const int &maxX,const int &minY,const int &maxY,
-        const int &nFeatures,const int &level 
+        const int &nFeatures,const int &level,std::vector<cv::KeyPoint> &vResultKeys
     );
 
     /**
@@ -126,7 +514,6 @@ protected:
     */
    void ComputeKeyPOintsold(std::vector<std::vector<cv::KeyPoint>> & allkeypoints);
 
-   std::vector<cv::Point> pattern;//用于计算描述自的随机采样点的集合
 
    int nfeatures;               //整个金字塔中，要提取到的特征点的数目
    double scaleFactor;          //图像金字塔层与层之间的缩放因子
@@ -137,13 +524,90 @@ protected:
 
    std::vector<int> mvFeaturesPerLevel;  //分配到每层图像中，要提取的特征点的数目
 
-   std::vector<int> umax;       //计算特整点的方向时，要有一个圆形区域，这个vetcor中存储了每一行的边界
+   OrientationFunc mpfnOrientation;       //编译期特化的方向计算，umax由配置决定
+   DescriptorFunc mpfnDescriptors;        //编译期特化的精确方式描述子计算，随机采样点由配置决定
+   DescriptorLUTFunc mpfnDescriptorsLUT;  //编译期特化的查找表方式描述子计算，描述子的字节数由配置决定
+   int mnDescriptorBytes;                 //描述子的字节数
 
    std::vector<float> mvScaleFactor; //每层图像的缩放因子
    std::vector<float> mvInvScaleFactor;   //，每层缩放因子的倒数
    std::vector<float> mvLevelSigma2;     //存储每层的sigam^2，即上面每层图像相对于底层图像缩放的倍数的平方
    std::vector<float> mvInvLevelSigma2;   //倒数
 
+   ThreadPool* mpThreadPool;              //并行提取时使用的线程池，为NULL时串行提取
+
+   bool mbExactDescriptors;               //是否按照精确角度旋转采样点计算描述子，否则使用查找表
+
+   cv::Size mImageSize;                   //当前金字塔缓存所对应的图像尺寸
+   cv::Mat mPyramidArena;                 //存放所有层带边界图像的一整块内存
+   cv::Mat mBlurArena;                    //存放所有层模糊后图像的一整块内存，布局和mPyramidArena相同
+   std::vector<cv::Mat> mvPyramidBorder;       //每层带边界的图像，mPyramidArena的ROI
+   std::vector<cv::Mat> mvBlurPyramidBorder;   //每层带边界的模糊图像，mBlurArena的ROI
+   std::vector<cv::Mat> mvBlurPyramid;         //每层模糊图像中不带边界的部分
+   std::shared_ptr<const std::vector<int> > mpPatternOffsets;   //按金字塔缓存的行步长计算的描述子查找表地址偏移，行步长相同的提取器共享
+
+   bool mbFusedPyramid;                   //是否使用融合了缩放、补边和模糊的金字塔构建方式
+   std::vector<int> mvFusedBuffer;        //融合构建金字塔时的临时缓存
+
+   std::vector<std::vector<cv::KeyPoint> > mvvKeypoints;  //每层的特征点，跨帧复用
+   std::vector<size_t> mvBufferCapacity;       //提取前所有跨帧复用的容器的容量，用于判断是否发生了重新分配
+   std::vector<int> mvLevelRowOffsets;         //每层描述子在输出矩阵中的起始行
+   cv::Mat mDescriptors;                       //当前帧的描述子矩阵（指向输出的内存），只在PrepareDescriptors和EndFrame之间有效
+   std::vector<DistributionBuffer> mvDistributionBuffers;  //每层分配特征点时使用的缓存
+   std::vector<std::vector<uchar> > mvvBlurTiles;          //每层稀疏模糊时标记需要模糊的块
+
+   std::vector<int> mvnCellCols;          //每层检测FAST角点的网格列数
+   std::vector<int> mvnCellRows;          //每层网格的行数
+   std::vector<int> mvnCellWidth;         //每层网格的宽度
+   std::vector<int> mvnCellHeight;        //每层网格的高度
+   std::vector<int> mvnCellStart;         //每层第一个网格的编号，最后一个元素为网格总数
+   std::vector<int> mvCellLevel;          //每个网格所在的层
+   std::vector<std::vector<cv::KeyPoint> > mvvCellKeys;         //每个网格中检测到的角点，跨帧复用
+   std::vector<std::vector<cv::KeyPoint> > mvvToDistributeKeys; //每层等待分配的角点，跨帧复用
+
+   int mnDistributionMethod;              //特征点的分配方式
+   int mnScoreType;                       //分配特征点时使用的角点响应值
+   std::vector<std::vector<int> > mvvHarrisBuffers;        //每层计算Harris响应值时的缓存
+   std::vector<double> mvDistributionTime;     //最近一帧每层分配特征点所用的时间，单位ms
+
+   bool mbProfiling;                      //是否记录各阶段的耗时统计，只有定义了ORB_PROFILING时才可能为true
+   ORBprofiler mProfiler;                 //各阶段的耗时统计，没有定义ORB_PROFILING时不分配缓冲区
+   int mnFrameId;                         //已经处理的帧数，作为耗时统计中帧的编号
+   std::vector<double> mvCellTime;        //每个网格检测FAST角点所用的时间，单位ms
+
+   bool mbMaskActive;                     //当前帧是否使用掩码
+   std::vector<cv::Mat> mvMaskPyramid;    //每层的掩码，跨帧复用
+   std::vector<int> mvCellArea;           //最近一帧每个网格的检测区域面积
+   std::vector<int> mvCellValidArea;      //最近一帧每个网格中未被遮挡的像素数
+   std::vector<uint64_t> mvCellMaskSignature; //视频模式下每个网格上次检测时掩码内容的哈希，没有掩码时为0
+   std::vector<float> mvLevelValidRatio;  //每层未被遮挡的面积比例
+   std::vector<int> mvMaskedFeaturesPerLevel;  //按掩码调整之后每层要提取的特征点数目
+
+   bool mbVideoMode;                      //是否开启视频模式
+   float mfVideoThreshold;                //视频模式下判断网格内容变化的阈值
+   int mnVideoRefresh;                    //视频模式下强制重新检测的周期
+   std::vector<uchar> mvCellSignature;    //每个网格上次检测时的内容采样
+   std::vector<int> mvCellThFAST;         //每个网格上次检测时使用的FAST阈值，-1表示没有可以复用的结果
+   std::vector<uchar> mvCellReused;       //最近一帧每个网格是否复用了上次的结果
+
+   bool mbMeasureTime;                    //本帧是否记录各阶段的耗时
+   double mdTimeBudget;                   //每帧的时间预算，单位ms，小于等于0表示没有开启
+   int mnBudgetFeatures;                  //时间预算模式下，下一帧要提取的特征点总数
+   std::vector<int> mviniThFAST;          //每层的初始FAST阈值，时间预算模式下会被提高
+   std::vector<int> mvminThFAST;          //每层的最小FAST阈值
+   std::vector<int> mvnDetectedKeys;      //最近一帧每层检测到的角点数目
+   std::vector<double> mvDetectTime;      //最近一帧每层检测FAST角点的耗时（各网格之和），单位ms
+   std::vector<double> mvOrientationTime; //最近一帧每层计算方向的耗时
+   std::vector<double> mvBlurTime;        //最近一帧每层高斯模糊的耗时
+   std::vector<double> mvDescriptorTime;  //最近一帧每层计算描述子的耗时
+   std::chrono::steady_clock::time_point mtFrameStart;    //当前帧开始处理的时间
+   double mdPyramidTime;                  //最近一帧构建金字塔的耗时
+   double mdFrameTime;                    //最近一帧的总耗时
+   double mdFixedTimeEst;                 //与特征点数目无关部分的耗时估计
+   double mdKeyTimeEst;                   //每个特征点的耗时估计
+
+   int mnFrameAllocations;                //最近一帧内部缓存的分配次数
+   long unsigned int mnTotalAllocations;  //内部缓存分配的总次数
 
 
 };
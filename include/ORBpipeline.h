@@ -0,0 +1,136 @@
+#ifndef ORBPIPELINE_H
+#define ORBPIPELINE_H
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <opencv/cv.h>
+
+#include "ORBextractor.h"
+
+//异步的特征点提取：图像帧放入有界队列，由单独的线程按顺序提取，结果通过future或者回调函数返回。
+//这样跟踪线程处理第N帧的同时，第N+1帧的特征点已经在提取了
+
+namespace ORB_SLAM2
+{
+
+//一帧的提取结果
+struct ExtractedFrame
+{
+    ExtractedFrame():nFrameId(-1),dTimestamp(0),bDropped(false){}
+
+    long nFrameId;                          //Push时分配的帧编号，从0开始连续递增
+    double dTimestamp;                      //Push时给出的时间戳，原样返回
+    bool bDropped;                          //是否因为队列已满被丢弃，丢弃的帧没有特征点
+    std::vector<cv::KeyPoint> vKeys;        //特征点
+    cv::Mat descriptors;                    //描述子
+};
+
+class ORBpipeline
+{
+public:
+
+    //队列已满时的处理方式：阻塞等待（反压）、丢弃新的帧、丢弃队列中最早的帧
+    enum {QUEUE_BLOCK=0,QUEUE_DROP_NEWEST=1,QUEUE_DROP_OLDEST=2};
+
+    /**
+     * @brief 构造函数，创建提取线程
+     * @param[in] pExtractor 提取器，由调用者管理，之后只能由提取线程使用
+     * @param[in] nCapacity 队列中最多等待提取的帧数，会向上取整到2的幂次
+     * @param[in] policy 队列已满时的处理方式
+     */
+    ORBpipeline(ORBextractor* pExtractor,int nCapacity=2,int policy=QUEUE_DROP_OLDEST);
+
+    //析构时等待正在提取的帧完成，队列中还没有提取的帧作为丢弃的帧返回
+    ~ORBpipeline();
+
+    /**
+     * @brief 放入一帧图像
+     * @details 只保存图像的Mat头，不拷贝像素，所以在这一帧的结果返回之前，调用者不能改写图像和掩码的内容。
+     * 只能由一个线程调用
+     * @param[in] image 灰度图像
+     * @param[in] mask 掩码，可以为空
+     * @param[in] dTimestamp 时间戳，原样放在结果中
+     * @return 这一帧的结果。帧被丢弃时结果中bDropped为true
+     */
+    std::future<ExtractedFrame> Push(const cv::Mat &image,const cv::Mat &mask,const double &dTimestamp=0);
+
+    /**
+     * @brief 设置回调函数，每一帧提取完成（或被丢弃）时在提取线程中按帧的顺序调用，之后future才变为就绪
+     * @details 回调函数中不应该做耗时的操作，否则会拖慢后面的帧
+     */
+    void SetCallback(const std::function<void(const ExtractedFrame&)> &callback);
+
+    //目前在队列中等待提取的帧数
+    int GetQueueSize();
+
+    //已经丢弃的帧数
+    long inline GetDroppedFrames(){
+        return mnDropped.load();
+    }
+
+protected:
+
+    //队列中的一帧
+    struct Job
+    {
+        long nFrameId;
+        double dTimestamp;
+        cv::Mat image;
+        cv::Mat mask;
+        std::shared_ptr<std::promise<ExtractedFrame> > pPromise;
+    };
+
+    //环形队列中的一个位置。nSeq等于位置编号时可以写入，等于位置编号+1时可以读出（有界的无锁多生产者多消费者队列）
+    struct Slot
+    {
+        std::atomic<unsigned long> nSeq;
+        Job job;
+    };
+
+    //无锁地放入一个job，队列已满时返回false
+    bool TryEnqueue(Job &job);
+
+    //无锁地取出最早的job，队列为空时返回false
+    bool TryDequeue(Job &job);
+
+    //返回一帧的结果：先调用回调函数，再设置future
+    void Finish(Job &job,ExtractedFrame &frame);
+
+    //把job作为丢弃的帧返回
+    void Drop(Job &job);
+
+    //提取线程的主循环
+    void Run();
+
+    ORBextractor* mpExtractor;
+
+    std::vector<Slot> mvSlots;
+    unsigned long mnMask;                      //容量减1，用于取模
+    std::atomic<unsigned long> mnEnqueuePos;   //下一次写入的位置编号
+    std::atomic<unsigned long> mnDequeuePos;   //下一次读出的位置编号
+
+    int mnPolicy;
+    long mnNextFrameId;                        //下一帧的编号，只由Push使用
+    std::atomic<long> mnDropped;
+
+    std::function<void(const ExtractedFrame&)> mCallback;
+    std::mutex mMutexCallback;
+
+    //队列本身是无锁的，这里的锁和条件变量只用于队列为空或者已满时的等待
+    std::atomic<bool> mbStop;
+    std::mutex mMutex;
+    std::condition_variable mCondFrame;        //有新的帧时通知提取线程
+    std::condition_variable mCondSpace;        //队列有空位时通知阻塞的Push
+
+    std::thread mThread;                       //提取线程，放在最后，保证启动时其他成员都已经初始化
+};
+
+}//namespace ORB_SLAM2
+
+#endif
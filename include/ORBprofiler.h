@@ -0,0 +1,103 @@
+#ifndef ORBPROFILER_H
+#define ORBPROFILER_H
+
+#include <vector>
+#include <atomic>
+#include <ostream>
+
+//ORB特征点提取各个阶段的耗时统计。编译时定义ORB_PROFILING（例如-DORB_PROFILING）时，提取器在每帧结束后写入记录，
+//否则提取器不会计时（除非开启了时间预算模式）也不会写入，统计接口仍然可以调用，只是没有记录
+
+namespace ORB_SLAM2
+{
+
+class ORBprofiler
+{
+public:
+
+    //提取过程中的各个阶段
+    enum {
+        STAGE_PYRAMID=0,        //构建图像金字塔
+        STAGE_DETECT=1,         //FAST角点检测
+        STAGE_DISTRIBUTE=2,     //特征点分配
+        STAGE_ORIENTATION=3,    //计算特征点方向
+        STAGE_BLUR=4,           //高斯模糊
+        STAGE_DESCRIPTOR=5,     //计算描述子
+        STAGE_TOTAL=6,          //整帧
+        NUM_STAGES=7
+    };
+
+    //一条记录
+    struct Record
+    {
+        int nFrame;             //帧的编号
+        int nStage;             //阶段
+        int nLevel;             //金字塔层，整帧的阶段（构建金字塔、整帧）为-1
+        int nKeys;              //该阶段输出的特征点数目，没有意义时为-1
+        double dTime;           //耗时，单位ms
+    };
+
+    //某个阶段在某一层上的耗时统计
+    struct Statistics
+    {
+        int nStage;
+        int nLevel;
+        int nCount;             //记录的条数
+        double dMean;           //平均耗时，单位ms
+        double dP50;            //中位数
+        double dP90;
+        double dP99;
+        double dMax;
+        double dMeanKeys;       //平均特征点数目
+    };
+
+    /**
+     * @brief 构造函数
+     * @param[in] nCapacity 环形缓冲区的容量，会向上取整到2的幂次；写满之后覆盖最早的记录。
+     * 小于等于0时不分配缓冲区，写入的记录直接丢弃
+     */
+    ORBprofiler(int nCapacity=8192);
+
+    /**
+     * @brief 写入一条记录
+     * @details 无锁，多个线程可以同时写入（各层并行提取时就是这样）
+     */
+    void Push(const int &nFrame,const int &nStage,const int &nLevel,const int &nKeys,const double &dTime);
+
+    /**
+     * @brief 取出当前缓冲区中所有完整的记录，按写入的先后排列
+     * @details 可以在提取的同时调用，正在被写入或者已经被覆盖的记录会被跳过
+     */
+    std::vector<Record> Snapshot();
+
+    /**
+     * @brief 按照(阶段,层)分组统计当前缓冲区中的记录
+     */
+    std::vector<Statistics> ComputeStatistics();
+
+    //以表格的形式输出ComputeStatistics的结果
+    void Dump(std::ostream &os);
+
+    //清空所有记录
+    void Clear();
+
+    //阶段的名字
+    static const char* GetStageName(const int &nStage);
+
+protected:
+
+    //环形缓冲区中的一个位置。nSeq为奇数表示正在写入，为偶数时等于2*(写入序号+1)，用于读取时判断记录是否完整
+    struct Slot
+    {
+        std::atomic<unsigned long> nSeq;
+        Record record;
+    };
+
+    std::vector<Slot> mvSlots;
+    unsigned long mnMask;                  //容量减1，用于取模
+    std::atomic<unsigned long> mnHead;     //下一条记录的写入序号
+};
+
+}//namespace ORB_SLAM2
+
+#endif
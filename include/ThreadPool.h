@@ -0,0 +1,71 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//一个简单的常驻线程池，用于把特征点提取等工作拆分成若干个相互独立的任务并行执行
+
+namespace ORB_SLAM2
+{
+
+class ThreadPool
+{
+public:
+
+    /**
+     * @brief 构造线程池
+     * @param[in] nThreads 参与计算的线程总数（包括调用ParallelFor的线程本身），小于等于1时不创建工作线程，所有任务串行执行
+     */
+    ThreadPool(int nThreads);
+    ~ThreadPool();
+
+    /**
+     * @brief 并行执行f(0)...f(n-1)，阻塞直到所有任务完成
+     * @details 调用线程自己也会领取任务执行，所以在任务内部再次调用ParallelFor（嵌套并行）不会死锁。
+     * job放在调用线程的栈上，通过侵入式链表交给工作线程，整个调用过程不申请堆内存
+     * @param[in] n 任务的个数
+     * @param[in] f 任务函数，参数为任务的编号
+     */
+    void ParallelFor(int n,const std::function<void(int)> &f);
+
+    //返回参与计算的线程总数
+    int inline GetNumThreads(){
+        return (int)mvThreads.size()+1;
+    }
+
+protected:
+
+    //一次ParallelFor调用对应的一批任务
+    struct Job
+    {
+        const std::function<void(int)>* pFunc;   //任务函数
+        int n;                                   //任务总数
+        std::atomic<int> next;                   //下一个待领取的任务编号
+        int nWorkers;                            //正在执行这个job的工作线程个数，由mMutex保护
+        Job* pNext;                              //mpJobs链表中的下一个job
+    };
+
+    //工作线程的主循环
+    void Run();
+
+    //不断从job中领取任务并执行，直到job中的任务都被领取完
+    void RunJob(Job &job);
+
+    std::vector<std::thread> mvThreads;            //工作线程
+    Job* mpJobs;                                   //还有任务没有被领取的job组成的链表，由mMutex保护
+
+    bool mbStop;                                   //析构时通知工作线程退出
+
+    std::mutex mMutex;
+    std::condition_variable mCondJob;              //有新的job时通知工作线程
+    std::condition_variable mCondDone;             //有工作线程离开job时通知等待的ParallelFor
+};
+
+}//namespace ORB_SLAM2
+
+#endif
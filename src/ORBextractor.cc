@@ -3,11 +3,25 @@
 #include <opencv2/features2d/features2d.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <vector>
+#include <algorithm>
 #include <iterator>
+#include <chrono>
+#include <limits>
+#include <map>
+#include <mutex>
 
 #include "include/ORBextractor.h"
 #include <iostream>
 
+//用于描述子计算的SIMD指令集，x86平台上在运行时根据CPU支持情况选择，ARM平台上NEON是必备的
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ORB_SIMD_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define ORB_SIMD_NEON
+#endif
+
 using namespace cv;
 using namespace std;
 
@@ -18,25 +32,196 @@ const int PATCH_SIZE=31;
 const int HALF_PATCH_SIZE=15;
 const int EDGE_THRESHOLD=19;
 
+//视频模式下每个网格内容采样的像素数
+const int CELL_SIGNATURE_SIZE=64;
+
+//耗时统计环形缓冲区的容量，没有定义ORB_PROFILING时不写入记录，也就不分配缓冲区
+#ifdef ORB_PROFILING
+const int PROFILER_CAPACITY=8192;
+#else
+const int PROFILER_CAPACITY=0;
+#endif
+
+/**
+ * @brief 在网格[iniX,maxX)x[iniY,maxY)内均匀采样8x8个像素，并计算和上次采样的平均绝对差
+ * @param[in] image 金字塔中某一层的图像
+ * @param[in] prev 上次的采样
+ * @param[out] signature 本次的采样
+ * @return 平均每个采样点的灰度差
+ */
+static float ComputeCellSignature(const Mat &image,const int &iniX,const int &iniY,const int &maxX,const int &maxY,
+                                  const uchar* prev,uchar* signature)
+{
+    int sad=0;
+    for (int r = 0; r < 8; ++r)
+    {
+        const uchar* row=image.ptr<uchar>(iniY+(maxY-iniY-1)*r/7);
+        for (int c = 0; c < 8; ++c)
+        {
+            const uchar v=row[iniX+(maxX-iniX-1)*c/7];
+            signature[r*8+c]=v;
+            sad+=std::abs((int)v-(int)prev[r*8+c]);
+        }
+    }
+    return (float)sad/CELL_SIGNATURE_SIZE;
+}
+
+/**
+ * @brief 计算网格[iniX,maxX)x[iniY,maxY)内掩码内容的哈希（FNV-1a，每次8个字节）
+ * @details 只比较未被遮挡的像素数时，掩码在网格内移动但面积不变就会被当成没有变化，复用的角点可能落在新遮挡的区域
+ * @param[in] mask 本层的掩码
+ * @return 掩码内容的哈希
+ */
+static uint64_t ComputeMaskSignature(const Mat &mask,const int &iniX,const int &iniY,const int &maxX,const int &maxY)
+{
+    uint64_t h=14695981039346656037ULL;
+    for (int y = iniY; y < maxY; ++y)
+    {
+        const uchar* row=mask.ptr<uchar>(y);
+        int x=iniX;
+        for (; x+8 <= maxX; x+=8)
+        {
+            uint64_t w;
+            memcpy(&w,row+x,8);
+            h=(h^w)*1099511628211ULL;
+        }
+        for (; x < maxX; ++x)
+            h=(h^row[x])*1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * @brief 去掉落在掩码为0的像素上的角点
+ * @param[in] mask 本层的掩码
+ * @param[in] iniX,iniY 角点坐标所在网格的左上角在本层图像中的坐标
+ * @param[in&out] vKeys 网格中的角点
+ */
+static void FilterKeyPointsByMask(const Mat &mask,const int &iniX,const int &iniY,vector<KeyPoint> &vKeys)
+{
+    size_t n=0;
+    for (size_t i = 0; i < vKeys.size(); ++i)
+    {
+        if(mask.at<uchar>(iniY+cvRound(vKeys[i].pt.y),iniX+cvRound(vKeys[i].pt.x)))
+            vKeys[n++]=vKeys[i];
+    }
+    vKeys.resize(n);
+}
+
+//从t开始到现在经过的时间，单位ms
+static inline double ElapsedTime(const std::chrono::steady_clock::time_point &t)
+{
+    return std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(std::chrono::steady_clock::now()-t).count();
+}
+
+/**
+ * @brief 编译期确定的ORB配置
+ * @details 方向计算的圆形区域半径和描述子的字节数作为模板参数，相关的循环次数在编译期就是常数，
+ * 编译器可以完全展开；umax和方向SIMD核函数使用的权重表只依赖于这些参数，每种配置只计算一次。
+ * 实例化了DefaultORBConfig（32字节描述子）和CompactORBConfig（16字节描述子，使用bit_pattern_31_中的前128对点），
+ * 构造ORBextractor时按描述子的字节数选择，方向、精确方式描述子和默认的查找表描述子都使用所选配置的实例。
+ * bit_pattern_31_是按31x31的区域设计的，所以两种配置的半径都是HALF_PATCH_SIZE；金字塔层数仍然是运行时参数
+ * @tparam HALF_PATCH 计算方向的圆形区域的半径
+ * @tparam DESC_BYTES 描述子的字节数，每个字节对应bit_pattern_31_中的8对点
+ */
+template<int HALF_PATCH,int DESC_BYTES>
+struct ORBConfig
+{
+    static_assert(HALF_PATCH>0 && HALF_PATCH<=15,"方向计算的圆形区域每行最多读取32个像素");
+    static_assert(DESC_BYTES>0 && DESC_BYTES<=32,"bit_pattern_31_中只有256对点");
+    static_assert(DESC_BYTES%2==0,"SSE2和NEON描述子核函数一次输出两个字节");
+
+    enum {HalfPatch=HALF_PATCH,PatchSize=2*HALF_PATCH+1,DescBytes=DESC_BYTES};
+
+    struct Tables
+    {
+        int umax[HALF_PATCH+1];                     //每行u坐标的边界
+        alignas(32) schar weightsU[PatchSize*32];   //方向SIMD核函数中每行32个像素的u权重，圆形区域之外为0
+        alignas(32) schar weightsV[PatchSize*32];   //每行32个像素的v权重
+    };
+
+    //获取本配置的表，第一次调用时计算
+    static const Tables& GetTables()
+    {
+        static const Tables tables=ComputeTables();
+        return tables;
+    }
+
+    static Tables ComputeTables()
+    {
+        Tables t;
+        int* umax=t.umax;
+
+        //计算圆的最大行号，+1应该是把中间行也会考虑进去
+        int v,v0,vmax=cvFloor(HALF_PATCH*sqrt(2.f)/2+1);//cvFloor用于浮点数向下取整
+
+        int vmin=cvCeil(HALF_PATCH*sqrt(2.f)/2);//向上取整
+        //半径的平方
+        const double hp2=HALF_PATCH*HALF_PATCH;
+
+        //利用圆的方程计算每行像素的u坐标边界max
+        for (v = 0; v <=vmax; ++v)
+        {
+            umax[v]=cvRound(sqrt(hp2-v*v));//结果都是大于0的结果，表示x坐标在这一行的边界
+        }
+        //这里其实是使用了对称的方式计算四分之一圆上的umax，目的是为了保持严格的对称
+        //因为按照常规的做法cvRound会出现不对称的情况
+        //同时随机采样的特征带你也不能够满足旋转之后的采样不变性
+        for(v=HALF_PATCH,v0=0;v>=vmin;--v){
+            while (umax[v0]==umax[v0+1])
+            {
+                ++v0;
+            }
+            umax[v]=v0;
+            ++v0;
+        }
+
+        //根据umax生成每行的权重，圆形区域之外的像素权重为0
+        for (int v = -HALF_PATCH,r=0; v <= HALF_PATCH; ++v,++r)
+        {
+            const int d=umax[std::abs(v)];
+            for (int k = 0; k < 32; ++k)
+            {
+                const int u=k-HALF_PATCH;
+                const bool bInside= u>=-d && u<=d;
+                t.weightsU[r*32+k]=(schar)(bInside?u:0);
+                t.weightsV[r*32+k]=(schar)(bInside?v:0);
+            }
+        }
+        return t;
+    }
+};
+
+//ORBextractor默认使用的配置，和词典、ORBmatcher中的256位描述子一致
+typedef ORBConfig<HALF_PATCH_SIZE,32> DefaultORBConfig;
+//128位描述子的配置，匹配的计算量和描述子的内存减半，但不能和按256位训练的词典一起使用
+typedef ORBConfig<HALF_PATCH_SIZE,16> CompactORBConfig;
+
 //灰度质心法
-static float IC_Angle(const Mat &image,Point2f pt,const vector<int> &u_max)
+template<class Config>
+static float IC_AngleT(const Mat &image,Point2f pt)
 {
-    int m_01=0,m_10=0;
-    const uchar* center=&image.at<uchar>(cvRound(pt.x),cvRound(pt.y));
+    const int* u_max=Config::GetTables().umax;
 
-    int step = (int)image.step1();
+    int m_01=0,m_10=0;
+    const uchar* center=&image.at<uchar>(cvRound(pt.y),cvRound(pt.x));
 
-    for(int u;u>-HALF_PATCH_SIZE && u<HALF_PATCH_SIZE;++u){
+    //v=0的中心行单独计算
+    for(int u=-Config::HalfPatch;u<=Config::HalfPatch;++u){
         m_10+=u*center[u];
     }
 
-    for(int v=1;v<HALF_PATCH_SIZE;++v){
+    int step = (int)image.step1();
+
+    //上下对称的两行一起计算
+    for(int v=1;v<=Config::HalfPatch;++v){
         int v_sum=0;
         int d=u_max[v];
 
-        for(int u;u<d;++d){
-            v_sum+=(center[d+v*step]-center[d-v*step]);
-            m_10=u*(center[d+v*step]+center[d-v*step]);
+        for(int u=-d;u<=d;++u){
+            int val_plus=center[u+v*step],val_minus=center[u-v*step];
+            v_sum+=(val_plus-val_minus);
+            m_10+=u*(val_plus+val_minus);
         }
 
         m_01+=v*v_sum;
@@ -46,22 +231,154 @@ static float IC_Angle(const Mat &image,Point2f pt,const vector<int> &u_max)
 
 }
 
+/**
+ * @brief 批量计算一层图像上所有特征点方向的核函数类型
+ * @details 圆形区域的每一行都按32个像素（u=-15...16）处理，weightsU/weightsV中存储了每行每个像素对应的u、v权重，
+ * 圆以外的像素权重为0。这样每行的m_10、m_01就是像素与权重的点积，和行边界umax无关，便于向量化。
+ * 所有计算都是整数运算，结果和IC_Angle完全一致
+ * @param[in] image 图像
+ * @param[in&out] keypoints 特征点
+ * @param[in] weightsU PATCH_SIZE行，每行32个u权重
+ * @param[in] weightsV PATCH_SIZE行，每行32个v权重
+ */
+typedef void (*OrientationKernel)(const Mat& image,vector<KeyPoint>& keypoints,const schar* weightsU,const schar* weightsV);
+
+#if defined(ORB_SIMD_X86)
+
+//对4个int32求和
+__attribute__((target("ssse3")))
+static inline int HorizontalSum(__m128i v)
+{
+    v=_mm_add_epi32(v,_mm_shuffle_epi32(v,_MM_SHUFFLE(1,0,3,2)));
+    v=_mm_add_epi32(v,_mm_shuffle_epi32(v,_MM_SHUFFLE(2,3,0,1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+//SSSE3版本，每行两次16字节的maddubs
+__attribute__((target("ssse3")))
+static void computeOrientationSSSE3(const Mat& image,vector<KeyPoint>& keypoints,const schar* weightsU,const schar* weightsV)
+{
+    const int step=(int)image.step1();
+    const __m128i ones=_mm_set1_epi16(1);
+    for (vector<KeyPoint>::iterator keypoint=keypoints.begin();keypoint!=keypoints.end();++keypoint)
+    {
+        const uchar* center=&image.at<uchar>(cvRound(keypoint->pt.y),cvRound(keypoint->pt.x));
+        __m128i acc10=_mm_setzero_si128(),acc01=_mm_setzero_si128();
+        for (int v = -HALF_PATCH_SIZE,r=0; v <= HALF_PATCH_SIZE; ++v,++r)
+        {
+            const uchar* row=center+v*step-HALF_PATCH_SIZE;
+            __m128i p0=_mm_loadu_si128((const __m128i*)row);
+            __m128i p1=_mm_loadu_si128((const __m128i*)(row+16));
+            //相邻两个像素乘权重后相加，最大为2*15*255，不会溢出int16
+            __m128i m10=_mm_add_epi16(_mm_maddubs_epi16(p0,_mm_load_si128((const __m128i*)(weightsU+r*32))),
+                                      _mm_maddubs_epi16(p1,_mm_load_si128((const __m128i*)(weightsU+r*32+16))));
+            __m128i m01=_mm_add_epi16(_mm_maddubs_epi16(p0,_mm_load_si128((const __m128i*)(weightsV+r*32))),
+                                      _mm_maddubs_epi16(p1,_mm_load_si128((const __m128i*)(weightsV+r*32+16))));
+            acc10=_mm_add_epi32(acc10,_mm_madd_epi16(m10,ones));
+            acc01=_mm_add_epi32(acc01,_mm_madd_epi16(m01,ones));
+        }
+        keypoint->angle=fastAtan2((float)HorizontalSum(acc01),(float)HorizontalSum(acc10));
+    }
+}
+
+//AVX2版本，每行一次32字节的maddubs
+__attribute__((target("avx2")))
+static void computeOrientationAVX2(const Mat& image,vector<KeyPoint>& keypoints,const schar* weightsU,const schar* weightsV)
+{
+    const int step=(int)image.step1();
+    const __m256i ones=_mm256_set1_epi16(1);
+    for (vector<KeyPoint>::iterator keypoint=keypoints.begin();keypoint!=keypoints.end();++keypoint)
+    {
+        const uchar* center=&image.at<uchar>(cvRound(keypoint->pt.y),cvRound(keypoint->pt.x));
+        __m256i acc10=_mm256_setzero_si256(),acc01=_mm256_setzero_si256();
+        for (int v = -HALF_PATCH_SIZE,r=0; v <= HALF_PATCH_SIZE; ++v,++r)
+        {
+            __m256i p=_mm256_loadu_si256((const __m256i*)(center+v*step-HALF_PATCH_SIZE));
+            __m256i m10=_mm256_maddubs_epi16(p,_mm256_load_si256((const __m256i*)(weightsU+r*32)));
+            __m256i m01=_mm256_maddubs_epi16(p,_mm256_load_si256((const __m256i*)(weightsV+r*32)));
+            acc10=_mm256_add_epi32(acc10,_mm256_madd_epi16(m10,ones));
+            acc01=_mm256_add_epi32(acc01,_mm256_madd_epi16(m01,ones));
+        }
+        __m128i m10=_mm_add_epi32(_mm256_castsi256_si128(acc10),_mm256_extracti128_si256(acc10,1));
+        __m128i m01=_mm_add_epi32(_mm256_castsi256_si128(acc01),_mm256_extracti128_si256(acc01,1));
+        keypoint->angle=fastAtan2((float)HorizontalSum(m01),(float)HorizontalSum(m10));
+    }
+}
+
+#elif defined(ORB_SIMD_NEON)
+
+//NEON版本，像素扩展为int16之后与权重相乘累加到int32
+static void computeOrientationNEON(const Mat& image,vector<KeyPoint>& keypoints,const schar* weightsU,const schar* weightsV)
+{
+    const int step=(int)image.step1();
+    for (vector<KeyPoint>::iterator keypoint=keypoints.begin();keypoint!=keypoints.end();++keypoint)
+    {
+        const uchar* center=&image.at<uchar>(cvRound(keypoint->pt.y),cvRound(keypoint->pt.x));
+        int32x4_t acc10=vdupq_n_s32(0),acc01=vdupq_n_s32(0);
+        for (int v = -HALF_PATCH_SIZE,r=0; v <= HALF_PATCH_SIZE; ++v,++r)
+        {
+            const uchar* row=center+v*step-HALF_PATCH_SIZE;
+            for (int k = 0; k < 32; k+=16)
+            {
+                uint8x16_t p=vld1q_u8(row+k);
+                int8x16_t wu=vld1q_s8(weightsU+r*32+k);
+                int8x16_t wv=vld1q_s8(weightsV+r*32+k);
+                int16x8_t pl=vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(p)));
+                int16x8_t ph=vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(p)));
+                int16x8_t wul=vmovl_s8(vget_low_s8(wu)),wuh=vmovl_s8(vget_high_s8(wu));
+                int16x8_t wvl=vmovl_s8(vget_low_s8(wv)),wvh=vmovl_s8(vget_high_s8(wv));
+                acc10=vmlal_s16(acc10,vget_low_s16(pl),vget_low_s16(wul));
+                acc10=vmlal_s16(acc10,vget_high_s16(pl),vget_high_s16(wul));
+                acc10=vmlal_s16(acc10,vget_low_s16(ph),vget_low_s16(wuh));
+                acc10=vmlal_s16(acc10,vget_high_s16(ph),vget_high_s16(wuh));
+                acc01=vmlal_s16(acc01,vget_low_s16(pl),vget_low_s16(wvl));
+                acc01=vmlal_s16(acc01,vget_high_s16(pl),vget_high_s16(wvl));
+                acc01=vmlal_s16(acc01,vget_low_s16(ph),vget_low_s16(wvh));
+                acc01=vmlal_s16(acc01,vget_high_s16(ph),vget_high_s16(wvh));
+            }
+        }
+        int m_10=vgetq_lane_s32(acc10,0)+vgetq_lane_s32(acc10,1)+vgetq_lane_s32(acc10,2)+vgetq_lane_s32(acc10,3);
+        int m_01=vgetq_lane_s32(acc01,0)+vgetq_lane_s32(acc01,1)+vgetq_lane_s32(acc01,2)+vgetq_lane_s32(acc01,3);
+        keypoint->angle=fastAtan2((float)m_01,(float)m_10);
+    }
+}
+
+#endif
+
+//在运行时选择方向计算的核函数，返回NULL表示没有可用的SIMD版本，使用IC_Angle逐点计算
+static OrientationKernel SelectOrientationKernel()
+{
+#if defined(ORB_SIMD_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return computeOrientationAVX2;
+    if(__builtin_cpu_supports("ssse3"))
+        return computeOrientationSSSE3;
+#elif defined(ORB_SIMD_NEON)
+    return computeOrientationNEON;
+#endif
+    return NULL;
+}
+
+static const OrientationKernel gOrientationKernel=SelectOrientationKernel();
+
 
 //乘数因子，一个弧度对应的多少弧度
 const float factorPI=(float)(CV_PI/180.f);
 
-//就散orb特征点的描述子
-static void computerOrbDescriptor(const KeyPoint& kpt,const Mat &image,const Point* pattern,uchar* desc){
+//就散orb特征点的描述子，描述子的字节数由配置决定
+template<class Config>
+static void computerOrbDescriptorT(const KeyPoint& kpt,const Mat &image,const Point* pattern,uchar* desc){
     float angle=(float)kpt.angle*factorPI;
     float a = (float)cos(angle);
     float b = (float)sin(angle);
 
     int step=(int)image.step1();
-    const uchar* center=&image.at<uchar>(cvRound(kpt.pt.x),cvRound(kpt.pt.y));
+    const uchar* center=&image.at<uchar>(cvRound(kpt.pt.y),cvRound(kpt.pt.x));
 
-    #define GET_VALUE(idx) center[cvRound(pattern[idx].x*b+pattern[idx].y*a)*step+cvRound(pattern[idx].x*a-cvRound(pattern[idx].y*b))]
+    #define GET_VALUE(idx) center[cvRound(pattern[idx].x*b+pattern[idx].y*a)*step+cvRound(pattern[idx].x*a-pattern[idx].y*b)]
 
-    for(int i=0;i<32;++i,pattern+=16){
+    for(int i=0;i<Config::DescBytes;++i,pattern+=16){
         int t0,t1,val;
         t0=GET_VALUE(0);t1=GET_VALUE(1);
         val=t0<t1;
@@ -353,19 +670,276 @@ static int bit_pattern_31_[256*4] =
 };
 
 
+//描述子查找表中角度离散化的区间个数，每个区间12度
+const int ANGLE_BINS=30;
+
+/**
+ * @brief 预先将bit_pattern_31_旋转到每个角度区间的中心角度上
+ * @details 存储格式为ANGLE_BINS组，每组的前256个点是每对点中的第一个点，后256个点是第二个点，
+ * 这样计算描述子时可以连续地读取一组比较对，便于向量化
+ * @return const vector<Point>& 所有提取器共享的只读表
+ */
+static const vector<Point>& GetRotatedPatterns()
+{
+    //C++11保证局部静态变量的初始化是线程安全的，并且只会进行一次
+    static const vector<Point> vRotated=[]{
+        vector<Point> v(ANGLE_BINS*512);
+        const Point* pattern0=(const Point*)bit_pattern_31_;
+        for (int bin = 0; bin < ANGLE_BINS; ++bin)
+        {
+            float angle=(float)bin*(360.f/ANGLE_BINS)*factorPI;
+            float a=(float)cos(angle);
+            float b=(float)sin(angle);
+            for (int j = 0; j < 256; ++j)
+            {
+                const Point &p0=pattern0[2*j],&p1=pattern0[2*j+1];
+                //和computerOrbDescriptor中GET_VALUE的旋转方式相同
+                v[bin*512+j]=Point(cvRound(p0.x*a-p0.y*b),cvRound(p0.x*b+p0.y*a));
+                v[bin*512+256+j]=Point(cvRound(p1.x*a-p1.y*b),cvRound(p1.x*b+p1.y*a));
+            }
+        }
+        return v;
+    }();
+    return vRotated;
+}
+
+/**
+ * @brief 把查找表中的点坐标转换成行步长为step的图像中相对于特征点的地址偏移量
+ * @param[in] step 图像的行步长
+ * @param[out] vOffsets 地址偏移量，布局和GetRotatedPatterns()相同
+ */
+static void ComputePatternOffsets(const int &step,vector<int> &vOffsets)
+{
+    const vector<Point>& vRotated=GetRotatedPatterns();
+    vOffsets.resize(vRotated.size());
+    for (size_t i = 0; i < vRotated.size(); ++i)
+    {
+        vOffsets[i]=vRotated[i].y*step+vRotated[i].x;
+    }
+}
+
+/**
+ * @brief 获取行步长为step时描述子查找表的地址偏移量
+ * @details 所有提取器共享同一个缓存，行步长相同的提取器（例如双目的左右两个提取器）拿到的是同一张只读表，
+ * 只在第一次遇到某个行步长时计算；没有提取器再使用时表会被释放
+ * @param[in] step 图像的行步长
+ * @return 布局和GetRotatedPatterns()相同的地址偏移量
+ */
+static shared_ptr<const vector<int> > GetPatternOffsets(const int &step)
+{
+    static mutex mutexCache;
+    static map<int,weak_ptr<const vector<int> > > mCache;
+
+    unique_lock<mutex> lock(mutexCache);
+    weak_ptr<const vector<int> > &wpOffsets=mCache[step];
+    shared_ptr<const vector<int> > pOffsets=wpOffsets.lock();
+    if(!pOffsets)
+    {
+        shared_ptr<vector<int> > pNew=make_shared<vector<int> >();
+        ComputePatternOffsets(step,*pNew);
+        pOffsets=pNew;
+        wpOffsets=pOffsets;
+    }
+    return pOffsets;
+}
+
+//根据特征点的方向得到其在查找表中所对应的角度区间
+static inline int GetAngleBin(float angle)
+{
+    int bin=cvRound(angle*(ANGLE_BINS/360.f));
+    if(bin>=ANGLE_BINS)
+        bin-=ANGLE_BINS;
+    if(bin<0)
+        bin+=ANGLE_BINS;
+    return bin;
+}
+
+/**
+ * @brief 使用查找表计算一个描述子的核函数类型
+ * @param[in] center 特征点在（模糊后）图像中的地址
+ * @param[in] ofsA 256对点中第一个点相对于center的偏移量
+ * @param[in] ofsB 256对点中第二个点相对于center的偏移量
+ * @param[in] nBytes 描述子的字节数（偶数），只使用前8*nBytes对点
+ * @param[out] desc nBytes字节的描述子
+ */
+typedef void (*DescriptorKernel)(const uchar* center,const int* ofsA,const int* ofsB,const int nBytes,uchar* desc);
+
+//标量版本，在不支持SIMD的平台上使用，也是其他版本结果的参考
+static void computeOrbDescriptorScalar(const uchar* center,const int* ofsA,const int* ofsB,const int nBytes,uchar* desc)
+{
+    for (int i = 0; i < nBytes; ++i,ofsA+=8,ofsB+=8)
+    {
+        int val=0;
+        for (int j = 0; j < 8; ++j)
+        {
+            val|=(center[ofsA[j]]<center[ofsB[j]])<<j;
+        }
+        desc[i]=(uchar)val;
+    }
+}
+
+#if defined(ORB_SIMD_X86)
+
+//SSE2版本，一次比较16对点，得到两个字节的描述子
+__attribute__((target("sse2")))
+static void computeOrbDescriptorSSE(const uchar* center,const int* ofsA,const int* ofsB,const int nBytes,uchar* desc)
+{
+    //SSE2中只有有符号的字节比较，所以先翻转符号位
+    const __m128i signBit=_mm_set1_epi8((char)0x80);
+    for (int i = 0; i < 8*nBytes; i+=16)
+    {
+        alignas(16) uchar va[16],vb[16];
+        for (int j = 0; j < 16; ++j)
+        {
+            va[j]=center[ofsA[i+j]];
+            vb[j]=center[ofsB[i+j]];
+        }
+        __m128i a=_mm_xor_si128(_mm_load_si128((const __m128i*)va),signBit);
+        __m128i b=_mm_xor_si128(_mm_load_si128((const __m128i*)vb),signBit);
+        //第j个字节的比较结果对应掩码的第j位，和标量版本中的位顺序一致
+        int mask=_mm_movemask_epi8(_mm_cmplt_epi8(a,b));
+        desc[i/8]=(uchar)(mask&0xFF);
+        desc[i/8+1]=(uchar)(mask>>8);
+    }
+}
+
+//AVX2版本，用gather一次取出8个点，比较之后的掩码正好是一个字节的描述子
+//gather读取的是4个字节，会多读3个字节，这些字节都落在图像的EDGE_THRESHOLD边界之内
+__attribute__((target("avx2")))
+static void computeOrbDescriptorAVX2(const uchar* center,const int* ofsA,const int* ofsB,const int nBytes,uchar* desc)
+{
+    const __m256i lowByte=_mm256_set1_epi32(0xFF);
+    const int* base=(const int*)center;
+    for (int i = 0; i < nBytes; ++i,ofsA+=8,ofsB+=8)
+    {
+        __m256i ia=_mm256_loadu_si256((const __m256i*)ofsA);
+        __m256i ib=_mm256_loadu_si256((const __m256i*)ofsB);
+        __m256i a=_mm256_and_si256(_mm256_i32gather_epi32(base,ia,1),lowByte);
+        __m256i b=_mm256_and_si256(_mm256_i32gather_epi32(base,ib,1),lowByte);
+        desc[i]=(uchar)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(b,a)));
+    }
+}
+
+#elif defined(ORB_SIMD_NEON)
+
+//NEON版本，一次比较16对点，通过按位加权再水平求和得到两个字节的描述子
+static void computeOrbDescriptorNEON(const uchar* center,const int* ofsA,const int* ofsB,const int nBytes,uchar* desc)
+{
+    static const uint8_t bits[16]={1,2,4,8,16,32,64,128,1,2,4,8,16,32,64,128};
+    const uint8x16_t vBits=vld1q_u8(bits);
+    for (int i = 0; i < 8*nBytes; i+=16)
+    {
+        uint8_t va[16],vb[16];
+        for (int j = 0; j < 16; ++j)
+        {
+            va[j]=center[ofsA[i+j]];
+            vb[j]=center[ofsB[i+j]];
+        }
+        uint8x16_t lt=vandq_u8(vcltq_u8(vld1q_u8(va),vld1q_u8(vb)),vBits);
+        uint8x8_t sum=vpadd_u8(vget_low_u8(lt),vget_high_u8(lt));
+        sum=vpadd_u8(sum,sum);
+        sum=vpadd_u8(sum,sum);
+        desc[i/8]=vget_lane_u8(sum,0);
+        desc[i/8+1]=vget_lane_u8(sum,1);
+    }
+}
+
+#endif
+
+//在运行时选择当前CPU所支持的最快的描述子核函数
+static DescriptorKernel SelectDescriptorKernel()
+{
+#if defined(ORB_SIMD_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return computeOrbDescriptorAVX2;
+    if(__builtin_cpu_supports("sse2"))
+        return computeOrbDescriptorSSE;
+#elif defined(ORB_SIMD_NEON)
+    return computeOrbDescriptorNEON;
+#endif
+    return computeOrbDescriptorScalar;
+}
+
+static const DescriptorKernel gDescriptorKernel=SelectDescriptorKernel();
+
+
+
+/**
+ * @brief 批量计算一层图像上所有特征点的方向
+ * @details 每行像素的读取范围是u=-15...16，比圆形区域多读一个像素，这个像素落在图像的EDGE_THRESHOLD边界之内。
+ * SIMD核函数是按HALF_PATCH_SIZE的行数写的，其它配置使用IC_Angle逐点计算
+ */
+template<class Config>
+static void computeOrientationT(const Mat& image,std::vector<KeyPoint> &keypoints){
+    if(Config::HalfPatch!=HALF_PATCH_SIZE || !gOrientationKernel)
+    {
+        //遍历所有的特征点，为特征点添加方向信息
+        for (std::vector<KeyPoint>::iterator KeyPoint=keypoints.begin();KeyPoint!=keypoints.end();++KeyPoint)
+        {
+            KeyPoint->angle=IC_AngleT<Config>(image,KeyPoint->pt);
+            //KeyPoint->pt表示特征点在图像中的坐标
+        }
+        return;
+    }
+
+    const typename Config::Tables &tables=Config::GetTables();
+    gOrientationKernel(image,keypoints,tables.weightsU,tables.weightsV);
+
+}
+
+//注意这是一个不属于任何类的全局静态函数，static修饰符限定只能够被本文件中的函数调用
+/**
+ * @brief 计算某层金字塔上特征点的描述子
+*/
+template<class Config>
+static void computeDescriptorsT(const cv::Mat& image,const vector<KeyPoint>& KeyPoints,cv::Mat& descriptors)
+{
+    //descriptors是调用者的描述子矩阵中属于这一层的若干行，直接写入，不能重新分配
+    CV_Assert(descriptors.rows==(int)KeyPoints.size() && descriptors.cols==Config::DescBytes && descriptors.type()==CV_8UC1);
+    for (size_t i = 0; i < KeyPoints.size(); i++)
+    {
+        computerOrbDescriptorT<Config>(KeyPoints[i],
+                            image,
+                            (const Point*)bit_pattern_31_,//随机点集的首地址
+                            descriptors.ptr((int) i));//取出来的描述子保存的位置
+    }
+
+}//computeDescriptorsT
+
+template<class Config>
+static void computeDescriptorsLUTDefaultT(const cv::Mat& image,const vector<KeyPoint>& KeyPoints,cv::Mat& descriptors,const vector<int>& vOffsets);
+
+//让提取器的各个函数指针指向某个配置的特化版本
+template<class Config>
+static void SelectORBConfig(ORBextractor::OrientationFunc &pfnOrientation,ORBextractor::DescriptorFunc &pfnDescriptors,
+                            ORBextractor::DescriptorLUTFunc &pfnDescriptorsLUT)
+{
+    pfnOrientation=computeOrientationT<Config>;
+    pfnDescriptors=computeDescriptorsT<Config>;
+    pfnDescriptorsLUT=computeDescriptorsLUTDefaultT<Config>;
+}
+
 ORBextractor::ORBextractor(
     int _nfeatures,
     float _scaleFactor,
     int _nlevels,
     int _iniThFAST,
-    int _minThFAST):
+    int _minThFAST,
+    cv::Size _imageSize,
+    int _nDescriptorBytes):
     nfeatures(_nfeatures),scaleFactor(_scaleFactor),nlevels(_nlevels),
-    iniThFAST(_iniThFAST),minThFAST(_minThFAST)
+    iniThFAST(_iniThFAST),minThFAST(_minThFAST),mpThreadPool(NULL),mbExactDescriptors(false),
+    mbFusedPyramid(false),mnDistributionMethod(DISTRIBUTE_OCTTREE),mnScoreType(FAST_SCORE),mbProfiling(PROFILER_CAPACITY>0),mProfiler(PROFILER_CAPACITY),mnFrameId(0),mbMaskActive(false),mbVideoMode(false),mfVideoThreshold(4),mnVideoRefresh(10),
+    mbMeasureTime(false),mdTimeBudget(0),mnBudgetFeatures(_nfeatures),
+    mdPyramidTime(0),mdFrameTime(0),mdFixedTimeEst(0),mdKeyTimeEst(0),mnFrameAllocations(0),mnTotalAllocations(0)
 {
     //存储每层图像缩放系数的vector调整为符合图像数目的大小
     mvScaleFactor.resize(nlevels);
+    mvInvScaleFactor.resize(nlevels);
     //
     mvLevelSigma2.resize(nlevels);
+    mvInvLevelSigma2.resize(nlevels);
 
     mvScaleFactor[0]=1.0f;
     mvLevelSigma2[0]=1.0f;
@@ -386,522 +960,1793 @@ ORBextractor::ORBextractor(
     mvImagePyramid.resize(nlevels);
     mvFeaturesPerLevel.resize(nlevels);
 
-    //图像降采样的缩放系数的倒数
-    float factor=1.0f/scaleFactor;
-
-    //第0层的图像对应分配特征带你的个数
-    float nDesiredFeaturesPerScale = nfeatures*(1-factor)/(1-(float)((double)factor*(
-    double)factor,(double)nlevels));
-
-    int sumFeatures=0;
-
-    for (size_t i = 0; i < nlevels-1; i++)
-    {
-        mvFeaturesPerLevel[i]= cvRound(nDesiredFeaturesPerScale);
-        sumFeatures+=nDesiredFeaturesPerScale;
-        nDesiredFeaturesPerScale=nDesiredFeaturesPerScale*factor;
-    }
-
-    mvFeaturesPerLevel[nlevels]=std::max(nfeatures-sumFeatures,0);
-
-    //成员变量pattern的长度，也就是点的个数，这里点的个数512表示512个点
-    const int npoints=512;
-    //获取用于计算BRIEF描述子的随机采样点点集头指针
-    //注意到pattern0数据类型为Point*,bit_pattern_31_是int型，所以这里要进行强制类型转换
-    const Point* pattern0 = (const Point*)bit_pattern_31_;
-    //back_inserter的作用是可以快速的覆盖掉之前这个容器的pattern之前的数据
-    //这里操作，是在全局变量区域的，int格式的随机采样点以cv::point格式复制到当前类对象中的成员变量中
-    std::copy(pattern0,pattern0+npoints,std::back_inserter(pattern));
-
-
-    //接下来的内容与计算旋转有关
-    umax.resize(HALF_PATCH_SIZE+1);
-
-    //计算圆的最大行号，+1应该是把中间行也会考虑进去
-    int v,v0,vmax=cvFloor(HALF_PATCH_SIZE*sqrt(2.f)/2+1);//cvFloor用于浮点数向下取整
-
-
-    int vmin=cvCeil(HALF_PATCH_SIZE*sqrt(2.f)/2);//向上取整
-    //半径的平方
-    const double hp2=HALF_PATCH_SIZE*HALF_PATCH_SIZE;
-
-    //利用圆的方程计算每行像素的u坐标边界max
-    for (v = 0; v <=vmax; ++v)
+    //跨帧复用的每层特征点容器和描述子行偏移
+    mvvKeypoints.resize(nlevels);
+    mvLevelRowOffsets.resize(nlevels);
+    mvDistributionBuffers.resize(nlevels);
+    mvvBlurTiles.resize(nlevels);
+    mvvHarrisBuffers.resize(nlevels);
+    mvDistributionTime.resize(nlevels,0);
+
+    //各阶段的耗时，只在开启时间预算模式或者耗时统计时记录
+    mvDetectTime.resize(nlevels,0);
+    mvOrientationTime.resize(nlevels,0);
+    mvBlurTime.resize(nlevels,0);
+    mvDescriptorTime.resize(nlevels,0);
+    mvnDetectedKeys.resize(nlevels,0);
+
+    //掩码金字塔和按掩码调整之后的每层特征点数目
+    mvMaskPyramid.resize(nlevels);
+    mvMaskedFeaturesPerLevel.resize(nlevels,0);
+    mvLevelValidRatio.resize(nlevels,1.f);
+
+    //每层的FAST阈值，时间预算模式下会被调整
+    mviniThFAST.resize(nlevels,iniThFAST);
+    mvminThFAST.resize(nlevels,minThFAST);
+
+    //按照等比数列把特征点分配到每层
+    ComputeFeaturesPerLevel(nfeatures,mvFeaturesPerLevel);
+
+    //按描述子的字节数选择配置，方向和两种方式的描述子都使用这个配置的特化版本，umax和循环次数都是编译期确定的
+    CV_Assert(_nDescriptorBytes==DefaultORBConfig::DescBytes || _nDescriptorBytes==CompactORBConfig::DescBytes);
+    mnDescriptorBytes=_nDescriptorBytes;
+    if(mnDescriptorBytes==CompactORBConfig::DescBytes)
+        SelectORBConfig<CompactORBConfig>(mpfnOrientation,mpfnDescriptors,mpfnDescriptorsLUT);
+    else
+        SelectORBConfig<DefaultORBConfig>(mpfnOrientation,mpfnDescriptors,mpfnDescriptorsLUT);
+
+    //如果构造时已经知道图像尺寸，那么就在这里预先分配好金字塔缓存，第一帧就不需要再分配了
+    if(_imageSize.area()>0)
     {
-        umax[v]=cvRound(sqrt(hp2-v*v));//结果都是大于0的结果，表示x坐标在这一行的边界
+        AllocatePyramid(_imageSize);
+        mnTotalAllocations+=mnFrameAllocations;
+        mnFrameAllocations=0;
     }
-    //这里其实是使用了对称的方式计算四分之一圆上的umax，目的是为了保持严格的对称
-    //因为按照常规的做法cvRound会出现不对称的情况
-    //同时随机采样的特征带你也不能够满足旋转之后的采样不变性
-    for(v=HALF_PATCH_SIZE,v0=0;v>=vmin;--v){
-        while (umax[v0]==umax[v0+1])
-        {
-            ++v0;
-        }
-        umax[v]=v0;
-        ++v0;    
-
-    }
-
-}
 
-static void computeOrientation(const Mat& image,std::vector<KeyPoint> &keypoints,const std::vector<int> &umax){
-    //遍历所有的特征点，为特征点添加方向信息
-    for (std::vector<KeyPoint>::iterator KeyPoint=keypoints.begin();KeyPoint!=keypoints.end();++KeyPoint)
-    {
-        KeyPoint->angle=IC_Angle(image,KeyPoint->pt,umax);
-        //KeyPoint->pt表示特征点在图像中的坐标
-    }
-    
 }
 
 /**
  * @brief 将提取器节点分成4个节点，同时完成图像区域的划分、特征点归属的划分，以及相关标志位的置位
 */
-void ExtractorNode::DivideNode(ExtractorNode &n1,ExtractorNode &n2,ExtractorNode &n3,ExtractorNode &n4){
+void ExtractorNode::DivideNode(ExtractorNode &n1,ExtractorNode &n2,ExtractorNode &n3,ExtractorNode &n4,
+                               const vector<cv::KeyPoint> &vKeys,vector<int> &vIndices,vector<int> &vScratch){
     //得到提取器结果的一般宽度
-    const int halfX=ceil(static_cast<float>(UR.x-UL.x)/2);
+    const int halfX=ceil(static_cast<float>(BR.x-UL.x)/2);
     //得到提取器节点的一般高度
-    const int halfY=ceil(static_cast<float>(BR.y-UR.y)/2);
+    const int halfY=ceil(static_cast<float>(BR.y-UL.y)/2);
 
-    //n1的区域
+    //n1 左上区域
     n1.UL=UL;
-    n1.UR=cv::Point2i(UL.x+halfX,UL.y);
-    n1.BL=cv::Point2i(UL.x,UL.y+halfY);
     n1.BR=cv::Point2i(UL.x+halfX,UL.y+halfY);
 
-    //用来存储在该节点对应的图像网格中提取出来的特征点的vector
-    n1.vKeys.reserve(vKeys.size());
-
-    //n2
-    n2.UL=n1.UR;
-    n2.UR=UR;
-    n2.BL=n1.BR;
-    n2.BR=cv::Point2i(UL.x,UL.y+halfY);
-    n2.vKeys.reserve(vKeys.size());
-
-    //n3 存储左下区域的边界
-    n3.UL = n1.BL;
-    n3.UR = n1.BR;
-    n3.BL = BL;
-    n3.BR = cv::Point2i(n1.BR.x,BL.y);
-    n3.vKeys.reserve(vKeys.size());
-
-    //n4 存储右下区域的边界
-    n4.UL = n3.UR;
-    n4.UR = n2.BR;
-    n4.BL = n3.BR;
-    n4.BR = BR;
-    n4.vKeys.reserve(vKeys.size());
-
-    //遍历提取器节点的vkeys中存储的特征点,并将特征点放到对应的提取器节点内
-    for(size_t i=0;i<vKeys.size();++i){
-        const cv::KeyPoint &kp=vKeys[i];
-
-        if(kp.pt.x<n1.UR.x){
-            if(kp.pt.y<n1.UL.y){
-                n1.vKeys.push_back(kp);
-            }
-            else{
-                n3.vKeys.push_back(kp);
-            }
-        }else{
-            if(kp.pt.y<n1.UR.y){
-                n2.vKeys.push_back(kp);
-            }else{
-                n4.vKeys.push_back(kp);
-            }
-        }
+    //n2 右上区域
+    n2.UL=cv::Point2i(UL.x+halfX,UL.y);
+    n2.BR=cv::Point2i(BR.x,UL.y+halfY);
+
+    //n3 左下区域
+    n3.UL=cv::Point2i(UL.x,UL.y+halfY);
+    n3.BR=cv::Point2i(UL.x+halfX,BR.y);
+
+    //n4 右下区域
+    n4.UL=n1.BR;
+    n4.BR=BR;
+
+    //第一遍：统计每个子节点中的特征点数目
+    int count[4]={0,0,0,0};
+    for(int i=nBegin;i<nEnd;++i){
+        const cv::KeyPoint &kp=vKeys[vIndices[i]];
+        count[(kp.pt.x<n1.BR.x?0:1)+(kp.pt.y<n1.BR.y?0:2)]++;
+    }
+
+    n1.nBegin=nBegin;
+    n1.nEnd=n2.nBegin=n1.nBegin+count[0];
+    n2.nEnd=n3.nBegin=n2.nBegin+count[1];
+    n3.nEnd=n4.nBegin=n3.nBegin+count[2];
+    n4.nEnd=nEnd;
+
+    //第二遍：按照子节点的顺序把索引写到临时缓存中，再拷贝回来。这样每个子节点中特征点的先后顺序和在母节点中一致
+    int pos[4]={n1.nBegin,n2.nBegin,n3.nBegin,n4.nBegin};
+    for(int i=nBegin;i<nEnd;++i){
+        const cv::KeyPoint &kp=vKeys[vIndices[i]];
+        vScratch[pos[(kp.pt.x<n1.BR.x?0:1)+(kp.pt.y<n1.BR.y?0:2)]++]=vIndices[i];
     }
+    std::copy(vScratch.begin()+nBegin,vScratch.begin()+nEnd,vIndices.begin()+nBegin);
+
     //判断每个特征点提取器节点所在的图像中的特征带你数目（就是分配给子节点的特征点数目），然后做标记
     //这里判断是否数目等于1的目的是确定这个节点是否可以继续向下分裂
-    if(n1.vKeys.size()==1){
-        n1.bNoMore=true;
-    }
-    if(n2.vKeys.size()==1){
-        n2.bNoMore=true;
-    }
-    if(n3.vKeys.size()==1){
-        n3.bNoMore=true;
-    }
-    if(n4.vKeys.size()==1){
-        n4.bNoMore=true;
-    }
+    n1.bNoMore=(n1.size()==1);
+    n2.bNoMore=(n2.size()==1);
+    n3.bNoMore=(n3.size()==1);
+    n4.bNoMore=(n4.size()==1);
 
 }
 /**
  * @brief 
+ * @details 这里的实现和使用std::list的实现的选择结果相同：节点的分裂顺序、停止条件以及最后的遍历顺序都一样。
+ * 原来push_front到list前面的节点在这里记录在vFront中，最后逆序放到遍历顺序的前面；被删除的节点把其索引范围置空。
+ * 唯一的区别是，对需要分裂的节点排序时，原来数目相同的节点按照指针地址排序（结果不确定），这里按照节点的创建顺序排序
  * @param N  希望提出的特征点的个数
- * @param level 制定金字塔图层，但是并未使用
+ * @param level 金字塔图层，用于选择该层的缓存
 */
-vector<cv::KeyPoint> ORBextractor::DistributeOctTree(const vector<cv::KeyPoint> &vToDistributeKeys,const int &minX,const int &maxX,const int &minY,const int &maxY,const int &N,const int &level)
+void ORBextractor::DistributeOctTree(const vector<cv::KeyPoint> &vToDistributeKeys,const int &minX,const int &maxX,const int &minY,const int &maxY,const int &N,const int &level,vector<cv::KeyPoint> &vResultKeys)
 {
-    // Compute how many initial nodes
+    DistributionBuffer &buffer=mvDistributionBuffers[level];
+    vector<ExtractorNode> &vNodes=buffer.vNodes;
+    vector<int> &vIndices=buffer.vIndices;
+    vector<int> &vScratch=buffer.vScratch;
+    vector<int> &vOrder=buffer.vOrder;
+    vector<int> &vFront=buffer.vFront;
+    vector<pair<int,int> > &vSizeAndNode=buffer.vSizeAndNode;
+
+    vNodes.clear();
+    vOrder.clear();
+    vResultKeys.clear();
+
+    const int nKeys=(int)vToDistributeKeys.size();
+    if(nKeys==0)
+        return;
+
     // Step 1 根据宽高比确定初始节点数目
 	//计算应该生成的初始节点个数，根节点的数量nIni是根据边界的宽高比值确定的，一般是1或者2
-    // ! bug: 如果宽高比小于0.5，nIni=0, 后面hx会报错
-    const int nIni = round(static_cast<float>(maxX-minX)/(maxY-minY));
+    //宽高比小于0.5时round的结果为0，这里至少保留一个初始节点，避免后面除0
+    const int nIni = std::max(1,(int)round(static_cast<float>(maxX-minX)/(maxY-minY)));
 
 	//一个初始的节点的x方向有多少个像素
     const float hX = static_cast<float>(maxX-minX)/nIni;
 
-	//存储有提取器节点的链表
-    list<ExtractorNode> lNodes;
-
-	//存储初始提取器节点指针的vector
-    vector<ExtractorNode*> vpIniNodes;
-
-	//重新设置其大小
-    vpIniNodes.resize(nIni);
-
-	// Step 2 生成初始提取器节点
+    // Step 2 生成初始提取器节点
+	//注意这里和提取FAST角点区域相同，都是“半径扩充图像”，特征点坐标从0 开始 
     for(int i=0; i<nIni; i++)
-    {      
-		//生成一个提取器节点
+    {
         ExtractorNode ni;
-
-		//设置提取器节点的图像边界
-		//注意这里和提取FAST角点区域相同，都是“半径扩充图像”，特征点坐标从0 开始 
-        ni.UL = cv::Point2i(hX*static_cast<float>(i),0);    //UpLeft
-        ni.UR = cv::Point2i(hX*static_cast<float>(i+1),0);  //UpRight
-		ni.BL = cv::Point2i(ni.UL.x,maxY-minY);		        //BottomLeft
-        ni.BR = cv::Point2i(ni.UR.x,maxY-minY);             //BottomRight
-
-		//重设vkeys大小
-        ni.vKeys.reserve(vToDistributeKeys.size());
-
-		//将刚才生成的提取节点添加到链表中
-		//虽然这里的ni是局部变量，但是由于这里的push_back()是拷贝参数的内容到一个新的对象中然后再添加到列表中
-		//所以当本函数退出之后这里的内存不会成为“野指针”
-        lNodes.push_back(ni);
-		//存储这个初始的提取器节点句柄
-        vpIniNodes[i] = &lNodes.back();
+        ni.UL = cv::Point2i(hX*static_cast<float>(i),0);            //UpLeft
+        ni.BR = cv::Point2i(hX*static_cast<float>(i+1),maxY-minY);  //BottomRight
+        vNodes.push_back(ni);
     }
 
-    //Associate points to childs
-    // Step 3 将特征点分配到子提取器节点中
-    for(size_t i=0;i<vToDistributeKeys.size();i++)
+    // Step 3 将特征点分配到初始节点中，这里是一个稳定的计数排序：先统计每个节点的特征点数目，再按顺序放置索引
+    vIndices.resize(nKeys);
+    vScratch.resize(nKeys);
+    for(int i=0;i<nKeys;i++)
     {
-		//获取这个特征点对象
-        const cv::KeyPoint &kp = vToDistributeKeys[i];
-		//按特征点的横轴位置，分配给属于那个图像区域的提取器节点（最初的提取器节点）
-        vpIniNodes[kp.pt.x/hX]->vKeys.push_back(kp);
+        //按特征点的横轴位置，分配给属于那个图像区域的提取器节点（最初的提取器节点）
+        const int id=std::min((int)(vToDistributeKeys[i].pt.x/hX),nIni-1);
+        vScratch[i]=id;
+        vNodes[id].nEnd++;
     }
-    
-	// Step 4 遍历此提取器节点列表，标记那些不可再分裂的节点，删除那些没有分配到特征点的节点
-    // ? 这个步骤是必要的吗？感觉可以省略，通过判断nIni个数和vKeys.size() 就可以吧
-    list<ExtractorNode>::iterator lit = lNodes.begin();
-    while(lit!=lNodes.end())
+    for(int i=0,start=0;i<nIni;i++)
     {
-		//如果初始的提取器节点所分配到的特征点个数为1
-        if(lit->vKeys.size()==1)
-        {
-			//那么就标志位置位，表示此节点不可再分
-            lit->bNoMore=true;
-			//更新迭代器
-            lit++;
-        }
-        ///如果一个提取器节点没有被分配到特征点，那么就从列表中直接删除它
-        else if(lit->vKeys.empty())
-            //注意，由于是直接删除了它，所以这里的迭代器没有必要更新；否则反而会造成跳过元素的情况
-            lit = lNodes.erase(lit);			
-        else
-			//如果上面的这些情况和当前的特征点提取器节点无关，那么就只是更新迭代器 
-            lit++;
+        vNodes[i].nBegin=start;
+        start+=vNodes[i].nEnd;
+        vNodes[i].nEnd=vNodes[i].nBegin;
+    }
+    for(int i=0;i<nKeys;i++)
+    {
+        vIndices[vNodes[vScratch[i]].nEnd++]=i;
+    }
+
+	// Step 4 标记那些不可再分裂的节点，没有分配到特征点的节点不放入遍历顺序中（相当于删除）
+    for(int i=0;i<nIni;i++)
+    {
+        if(vNodes[i].size()==1)
+            vNodes[i].bNoMore=true;
+        if(vNodes[i].size()>0)
+            vOrder.push_back(i);
     }
 
     //结束标志位清空
     bool bFinish = false;
 
-	//记录迭代次数，只是记录，并未起到作用
-    int iteration = 0;
-
-	//声明一个vector用于存储节点的vSize和句柄对
-	//这个变量记录了在一次分裂循环中，那些可以再继续进行分裂的节点中包含的特征点数目和其句柄
-    vector<pair<int,ExtractorNode*> > vSizeAndPointerToNode;
+    //将节点id分裂，非空的子节点加入vFront，可以继续分裂的子节点加入vSizeAndNode；返回非空子节点的个数
+    auto divide=[&](const int &id){
+        ExtractorNode n[4];
+        vNodes[id].DivideNode(n[0],n[1],n[2],n[3],vToDistributeKeys,vIndices,vScratch);
+        int nAdded=0;
+        for(int q=0;q<4;q++)
+        {
+            if(n[q].size()>0)
+            {
+                vNodes.push_back(n[q]);
+                const int childId=(int)vNodes.size()-1;
+                vFront.push_back(childId);
+                nAdded++;
+                if(n[q].size()>1)
+                    vSizeAndNode.push_back(make_pair(n[q].size(),childId));
+            }
+        }
+        return nAdded;
+    };
 
-	//调整大小，这里的意思是一个初始化节点将“分裂”成为四个
-    vSizeAndPointerToNode.reserve(lNodes.size()*4);
+    //遍历顺序更新为：逆序的新节点（原来是push_front），然后是vOrder中剩下的节点
+    auto mergeOrder=[&](){
+        buffer.vOrderTmp.assign(vFront.rbegin(),vFront.rend());
+        buffer.vOrderTmp.insert(buffer.vOrderTmp.end(),vOrder.begin(),vOrder.end());
+        vOrder.swap(buffer.vOrderTmp);
+        vFront.clear();
+    };
 
     // Step 5 利用四叉树方法对图像进行划分区域，均匀分配特征点
     while(!bFinish)
     {
-		//更新迭代次数计数器，只是记录，并未起到作用
-        iteration++;
-
-		//保存当前节点个数，prev在这里理解为“保留”比较好
-        int prevSize = lNodes.size();
+		//保存当前节点个数
+        int prevSize = vOrder.size();
 
-		//重新定位迭代器指向列表头部
-        lit = lNodes.begin();
-
-		//需要展开的节点计数，这个一直保持累计，不清零
+		//需要展开的节点计数
         int nToExpand = 0;
 
-		//因为是在循环中，前面的循环体中可能污染了这个变量，所以清空
-		//这个变量也只是统计了某一个循环中的点
-		//这个变量记录了在一次分裂循环中，那些可以再继续进行分裂的节点中包含的特征点数目和其句柄
-        vSizeAndPointerToNode.clear();
+		//这个变量记录了在一次分裂循环中，那些可以再继续进行分裂的节点中包含的特征点数目和其下标
+        vSizeAndNode.clear();
+        vFront.clear();
 
-        // 将目前的子区域进行划分
-		//开始遍历列表中所有的提取器节点，并进行分解或者保留
-        while(lit!=lNodes.end())
+        //遍历所有节点，只有一个特征点的节点保留下来，其他的节点分裂成子节点，母节点被删除
+        int nKept=0;
+        for(size_t i=0;i<vOrder.size();i++)
         {
-			//如果提取器节点只有一个特征点，
-            if(lit->bNoMore)
+            const int id=vOrder[i];
+            if(vNodes[id].bNoMore)
             {
-                // If node only contains one point do not subdivide and continue
-				//那么就没有必要再进行细分了
-                lit++;
-				//跳过当前节点，继续下一个
+                vOrder[nKept++]=id;
                 continue;
             }
-            else
-            {
-                // If more than one point, subdivide
-				//如果当前的提取器节点具有超过一个的特征点，那么就要进行继续分裂
-                ExtractorNode n1,n2,n3,n4;
-
-				//再细分成四个子区域
-                lit->DivideNode(n1,n2,n3,n4); 
-
-                // Add childs if they contain points
-				//如果这里分出来的子区域中有特征点，那么就将这个子区域的节点添加到提取器节点的列表中
-				//注意这里的条件是，有特征点即可
-                if(n1.vKeys.size()>0)
-                {
-					//注意这里也是添加到列表前面的
-                    lNodes.push_front(n1);   
-
-					//再判断其中子提取器节点中的特征点数目是否大于1
-                    if(n1.vKeys.size()>1)
-                    {
-						//如果有超过一个的特征点，那么待展开的节点计数加1
-                        nToExpand++;
-
-						//保存这个特征点数目和节点指针的信息
-                        vSizeAndPointerToNode.push_back(make_pair(n1.vKeys.size(),&lNodes.front()));
-
-						//?这个访问用的句柄貌似并没有用到？
-                        // lNodes.front().lit 和前面的迭代的lit 不同，只是名字相同而已
-                        // lNodes.front().lit是node结构体里的一个指针用来记录节点的位置
-                        // 迭代的lit 是while循环里作者命名的遍历的指针名称
-                        lNodes.front().lit = lNodes.begin();
-                    }
-                }
-                //后面的操作都是相同的，这里不再赘述
-                if(n2.vKeys.size()>0)
-                {
-                    lNodes.push_front(n2);
-                    if(n2.vKeys.size()>1)
-                    {
-                        nToExpand++;
-                        vSizeAndPointerToNode.push_back(make_pair(n2.vKeys.size(),&lNodes.front()));
-                        lNodes.front().lit = lNodes.begin();
-                    }
-                }
-                if(n3.vKeys.size()>0)
-                {
-                    lNodes.push_front(n3);
-                    if(n3.vKeys.size()>1)
-                    {
-                        nToExpand++;
-                        vSizeAndPointerToNode.push_back(make_pair(n3.vKeys.size(),&lNodes.front()));
-                        lNodes.front().lit = lNodes.begin();
-                    }
-                }
-                if(n4.vKeys.size()>0)
-                {
-                    lNodes.push_front(n4);
-                    if(n4.vKeys.size()>1)
-                    {
-                        nToExpand++;
-                        vSizeAndPointerToNode.push_back(make_pair(n4.vKeys.size(),&lNodes.front()));
-                        lNodes.front().lit = lNodes.begin();
-                    }
-                }
-
-                //当这个母节点expand之后就从列表中删除它了，能够进行分裂操作说明至少有一个子节点的区域中特征点的数量是>1的
-                // 分裂方式是后加的节点先分裂，先加的后分裂
-                lit=lNodes.erase(lit);
-
-				//继续下一次循环，其实这里加不加这句话的作用都是一样的
-                continue;
-            }//判断当前遍历到的节点中是否有超过一个的特征点
-        }//遍历列表中的所有提取器节点
+            const size_t nPrevExpand=vSizeAndNode.size();
+            divide(id);
+            nToExpand+=(int)(vSizeAndNode.size()-nPrevExpand);
+        }
+        vOrder.resize(nKept);
+        mergeOrder();
 
         // Finish if there are more nodes than required features or all nodes contain just one point
         //停止这个过程的条件有两个，满足其中一个即可：
         //1、当前的节点数已经超过了要求的特征点数
         //2、当前所有的节点中都只包含一个特征点
-        //prevSize中保存的是分裂之前的节点个数，如果分裂之前和分裂之后的总节点个数一样，说明当前所有的节点区域中只有一个特征点，已经不能够再细分了
-        if((int)lNodes.size()>=N || (int)lNodes.size()==prevSize)	
+        if((int)vOrder.size()>=N || (int)vOrder.size()==prevSize)
         {
-			//停止标志置位
             bFinish = true;
         }
-
         // Step 6 当再划分之后所有的Node数大于要求数目时,就慢慢划分直到使其刚刚达到或者超过要求的特征点个数
         //可以展开的子节点个数nToExpand x3，是因为一分四之后，会删除原来的主节点，所以乘以3
-        /**
-		 * //?BUG 但是我觉得这里有BUG，虽然最终作者也给误打误撞、稀里糊涂地修复了
-		 * 注意到，这里的nToExpand变量在前面的执行过程中是一直处于累计状态的，如果因为特征点个数太少，跳过了下面的else-if，又进行了一次上面的遍历
-		 * list的操作之后，lNodes.size()增加了，但是nToExpand也增加了，尤其是在很多次操作之后，下面的表达式：
-		 * ((int)lNodes.size()+nToExpand*3)>N
-		 * 会很快就被满足，但是此时只进行一次对vSizeAndPointerToNode中点进行分裂的操作是肯定不够的；
-		 * 理想中，作者下面的for理论上只要执行一次就能满足，不过作者所考虑的“不理想情况”应该是分裂后出现的节点所在区域可能没有特征点，因此将for
-		 * 循环放在了一个while循环里面，通过再次进行for循环、再分裂一次解决这个问题。而我所考虑的“不理想情况”则是因为前面的一次对vSizeAndPointerToNode
-		 * 中的特征点进行for循环不够，需要将其放在另外一个循环（也就是作者所写的while循环）中不断尝试直到达到退出条件。 
-		 * */
-        else if(((int)lNodes.size()+nToExpand*3)>N)
+        else if(((int)vOrder.size()+nToExpand*3)>N)
         {
-			//如果再分裂一次那么数目就要超了，这里想办法尽可能使其刚刚达到或者超过要求的特征点个数时就退出
-			//这里的nToExpand和vSizeAndPointerToNode不是一次循环对一次循环的关系，而是前者是累计计数，后者只保存某一个循环的
-			//一直循环，直到结束标志位被置位
+            //当前的节点总数
+            int nNodes=vOrder.size();
+
             while(!bFinish)
             {
-				//获取当前的list中的节点个数
-                prevSize = lNodes.size();
+                prevSize = nNodes;
 
-				//保留那些还可以分裂的节点的信息, 这里是深拷贝
-                vector<pair<int,ExtractorNode*> > vPrevSizeAndPointerToNode = vSizeAndPointerToNode;
-				//清空
-                vSizeAndPointerToNode.clear();
+				//保留那些还可以分裂的节点的信息
+                buffer.vPrevSizeAndNode.assign(vSizeAndNode.begin(),vSizeAndNode.end());
+                vSizeAndNode.clear();
 
-                // 对需要划分的节点进行排序，对pair对的第一个元素进行排序，默认是从小到大排序
-				// 优先分裂特征点多的节点，使得特征点密集的区域保留更少的特征点
-                //! 注意这里的排序规则非常重要！会导致每次最后产生的特征点都不一样。建议使用 stable_sort
-                sort(vPrevSizeAndPointerToNode.begin(),vPrevSizeAndPointerToNode.end());
+                // 对需要划分的节点进行排序，优先分裂特征点多的节点；数目相同时按照节点的创建顺序，结果是确定的
+                sort(buffer.vPrevSizeAndNode.begin(),buffer.vPrevSizeAndNode.end());
 
 				//遍历这个存储了pair对的vector，注意是从后往前遍历
-                for(int j=vPrevSizeAndPointerToNode.size()-1;j>=0;j--)
+                for(int j=(int)buffer.vPrevSizeAndNode.size()-1;j>=0;j--)
                 {
-                    ExtractorNode n1,n2,n3,n4;
-					//对每个需要进行分裂的节点进行分裂
-                    vPrevSizeAndPointerToNode[j].second->DivideNode(n1,n2,n3,n4);
+                    const int id=buffer.vPrevSizeAndNode[j].second;
+                    nNodes+=divide(id);
 
-                    // Add childs if they contain points
-					//其实这里的节点可以说是二级子节点了，执行和前面一样的操作
-                    if(n1.vKeys.size()>0)
-                    {
-                        lNodes.push_front(n1);
-                        if(n1.vKeys.size()>1)
-                        {
-							//因为这里还有对于vSizeAndPointerToNode的操作，所以前面才会备份vSizeAndPointerToNode中的数据
-							//为可能的、后续的又一次for循环做准备
-                            vSizeAndPointerToNode.push_back(make_pair(n1.vKeys.size(),&lNodes.front()));
-                            lNodes.front().lit = lNodes.begin();
-                        }
-                    }
-                    if(n2.vKeys.size()>0)
-                    {
-                        lNodes.push_front(n2);
-                        if(n2.vKeys.size()>1)
-                        {
-                            vSizeAndPointerToNode.push_back(make_pair(n2.vKeys.size(),&lNodes.front()));
-                            lNodes.front().lit = lNodes.begin();
-                        }
-                    }
-                    if(n3.vKeys.size()>0)
-                    {
-                        lNodes.push_front(n3);
-                        if(n3.vKeys.size()>1)
-                        {
-                            vSizeAndPointerToNode.push_back(make_pair(n3.vKeys.size(),&lNodes.front()));
-                            lNodes.front().lit = lNodes.begin();
-                        }
-                    }
-                    if(n4.vKeys.size()>0)
-                    {
-                        lNodes.push_front(n4);
-                        if(n4.vKeys.size()>1)
-                        {
-                            vSizeAndPointerToNode.push_back(make_pair(n4.vKeys.size(),&lNodes.front()));
-                            lNodes.front().lit = lNodes.begin();
-                        }
-                    }
+                    //删除母节点：把它的索引范围置空，最后遍历时会跳过
+                    vNodes[id].nEnd=vNodes[id].nBegin;
+                    nNodes--;
 
-                    //删除母节点，在这里其实应该是一级子节点
-                    lNodes.erase(vPrevSizeAndPointerToNode[j].second->lit);
-
-					//判断是是否超过了需要的特征点数？是的话就退出，不是的话就继续这个分裂过程，直到刚刚达到或者超过要求的特征点个数
-					//作者的思想其实就是这样的，再分裂了一次之后判断下一次分裂是否会超过N，如果不是那么就放心大胆地全部进行分裂（因为少了一个判断因此
-					//其运算速度会稍微快一些），如果会那么就引导到这里进行最后一次分裂
-                    if((int)lNodes.size()>=N)
+					//判断是是否超过了需要的特征点数？是的话就退出
+                    if(nNodes>=N)
                         break;
-                }//遍历vPrevSizeAndPointerToNode并对其中指定的node进行分裂，直到刚刚达到或者超过要求的特征点个数
+                }
 
-                //这里理想中应该是一个for循环就能够达成结束条件了，但是作者想的可能是，有些子节点所在的区域会没有特征点，因此很有可能一次for循环之后
-				//的数目还是不能够满足要求，所以还是需要判断结束条件并且再来一次
                 //判断是否达到了停止条件
-                if((int)lNodes.size()>=N || (int)lNodes.size()==prevSize)
-                    bFinish = true;				
-            }//一直进行nToExpand累加的节点分裂过程，直到分裂后的nodes数目刚刚达到或者超过要求的特征点数目
-        }//当本次分裂后达不到结束条件但是再进行一次完整的分裂之后就可以达到结束条件时
+                if(nNodes>=N || nNodes==prevSize)
+                    bFinish = true;
+            }
+
+            mergeOrder();
+        }
     }// 根据兴趣点分布,利用4叉树方法对图像进行划分区域
 
     // Retain the best point in each node
     // Step 7 保留每个区域响应值最大的一个兴趣点
-    //使用这个vector来存储我们感兴趣的特征点的过滤结果
-    vector<cv::KeyPoint> vResultKeys;
+    for(size_t i=0;i<vOrder.size();i++)
+    {
+        const ExtractorNode &node=vNodes[vOrder[i]];
+        //被删除的节点
+        if(node.size()==0)
+            continue;
+
+        const cv::KeyPoint* pKP=&vToDistributeKeys[vIndices[node.nBegin]];
+        float maxResponse=pKP->response;
+        for(int k=node.nBegin+1;k<node.nEnd;k++){
+            const cv::KeyPoint &kp=vToDistributeKeys[vIndices[k]];
+            if (kp.response>maxResponse)
+            {
+                pKP=&kp;
+                maxResponse=kp.response;
+            }
+        }
+        vResultKeys.push_back(*pKP);
+    }
+
+}//ORBextractor::DistributeOctTree
+
+//按响应值从大到小排列特征点的索引，响应值相同时按索引排列，保证结果确定（std::sort不会分配内存）
+static void SortByResponse(const vector<cv::KeyPoint> &vKeys,vector<int> &vIndices)
+{
+    vIndices.resize(vKeys.size());
+    for (size_t i = 0; i < vKeys.size(); ++i)
+    {
+        vIndices[i]=(int)i;
+    }
+    sort(vIndices.begin(),vIndices.end(),[&vKeys](const int &a,const int &b){
+        if(vKeys[a].response!=vKeys[b].response)
+            return vKeys[a].response>vKeys[b].response;
+        return a<b;
+    });
+}
+
+void ORBextractor::DistributeKeyPoints(const vector<cv::KeyPoint> &vToDistributeKeys,const int &minX,const int &maxX,const int &minY,const int &maxY,const int &N,const int &level,vector<cv::KeyPoint> &vResultKeys)
+{
+    std::chrono::steady_clock::time_point t1=std::chrono::steady_clock::now();
+
+    switch(mnDistributionMethod)
+    {
+    case DISTRIBUTE_ANMS:
+        DistributeANMS(vToDistributeKeys,minX,maxX,minY,maxY,N,level,vResultKeys);
+        break;
+    case DISTRIBUTE_SSC:
+        DistributeSSC(vToDistributeKeys,minX,maxX,minY,maxY,N,level,vResultKeys);
+        break;
+    case DISTRIBUTE_GRID:
+        DistributeGrid(vToDistributeKeys,minX,maxX,minY,maxY,N,level,vResultKeys);
+        break;
+    default:
+        DistributeOctTree(vToDistributeKeys,minX,maxX,minY,maxY,N,level,vResultKeys);
+    }
+
+    mvDistributionTime[level]=ElapsedTime(t1);
+
+}//ORBextractor::DistributeKeyPoints
+
+void ORBextractor::DistributeANMS(const vector<cv::KeyPoint> &vToDistributeKeys,const int &minX,const int &maxX,const int &minY,const int &maxY,const int &N,const int &level,vector<cv::KeyPoint> &vResultKeys)
+{
+    DistributionBuffer &buffer=mvDistributionBuffers[level];
+    vector<int> &vIndices=buffer.vIndices;
+    vector<int> &vGrid=buffer.vGrid;
+    vector<int> &vNext=buffer.vNext;
+    vector<float> &vRadius=buffer.vRadius;
+    vector<int> &vOrder=buffer.vOrder;
+
+    vResultKeys.clear();
+    const int n=(int)vToDistributeKeys.size();
+    if(n==0 || N<=0)
+        return;
+
+    SortByResponse(vToDistributeKeys,vIndices);
+
+    //特征点不多于要求的数目，全部保留
+    if(n<=N)
+    {
+        for (int k = 0; k < n; ++k)
+            vResultKeys.push_back(vToDistributeKeys[vIndices[k]]);
+        return;
+    }
+
+    //网格的边长，使得平均每个网格中有一个特征点
+    const int W=maxX-minX,H=maxY-minY;
+    const int cell=std::max(1,cvRound(sqrt((float)W*H/n)));
+    const int gridCols=W/cell+1,gridRows=H/cell+1;
+    vGrid.assign(gridCols*gridRows,-1);
+    vNext.resize(n);
+    vRadius.resize(n);
+
+    //按响应值从大到小插入网格，每个特征点插入之前，网格中的点都是响应值不小于它的点
+    for (int k = 0; k < n; ++k)
+    {
+        const cv::KeyPoint &kp=vToDistributeKeys[vIndices[k]];
+        const int cx=std::min(std::max((int)(kp.pt.x/cell),0),gridCols-1);
+        const int cy=std::min(std::max((int)(kp.pt.y/cell),0),gridRows-1);
+
+        //由近及远地搜索以(cx,cy)为中心的第r圈网格。第r+1圈及以外的点距离至少为r*cell，已经找到更近的点时就可以停止
+        float best=std::numeric_limits<float>::max();
+        const int maxRing=std::max(gridCols,gridRows);
+        for (int r = 0; r <= maxRing; ++r)
+        {
+            for (int gy = std::max(cy-r,0); gy <= std::min(cy+r,gridRows-1); ++gy)
+            {
+                //只访问这一圈上的网格
+                const int step=(gy==cy-r || gy==cy+r)?1:2*r;
+                for (int gx = cx-r; gx <= cx+r; gx+=std::max(step,1))
+                {
+                    if(gx<0 || gx>=gridCols)
+                        continue;
+                    for (int j = vGrid[gy*gridCols+gx]; j != -1; j=vNext[j])
+                    {
+                        const cv::KeyPoint &other=vToDistributeKeys[vIndices[j]];
+                        const float dx=other.pt.x-kp.pt.x,dy=other.pt.y-kp.pt.y;
+                        best=std::min(best,dx*dx+dy*dy);
+                    }
+                }
+            }
+            if(best<=(float)(r*cell)*(r*cell))
+                break;
+        }
+        vRadius[k]=best;
+
+        //插入到网格的链表中
+        vNext[k]=vGrid[cy*gridCols+cx];
+        vGrid[cy*gridCols+cx]=k;
+    }
+
+    //保留抑制半径最大的N个特征点，半径相同时保留响应值大的
+    vOrder.resize(n);
+    for (int k = 0; k < n; ++k)
+        vOrder[k]=k;
+    nth_element(vOrder.begin(),vOrder.begin()+N,vOrder.end(),[&vRadius](const int &a,const int &b){
+        if(vRadius[a]!=vRadius[b])
+            return vRadius[a]>vRadius[b];
+        return a<b;
+    });
+    //按响应值从大到小输出
+    sort(vOrder.begin(),vOrder.begin()+N);
+    for (int i = 0; i < N; ++i)
+    {
+        vResultKeys.push_back(vToDistributeKeys[vIndices[vOrder[i]]]);
+    }
+
+}//ORBextractor::DistributeANMS
+
+void ORBextractor::DistributeSSC(const vector<cv::KeyPoint> &vToDistributeKeys,const int &minX,const int &maxX,const int &minY,const int &maxY,const int &N,const int &level,vector<cv::KeyPoint> &vResultKeys)
+{
+    DistributionBuffer &buffer=mvDistributionBuffers[level];
+    vector<int> &vIndices=buffer.vIndices;
+    vector<int> &vGrid=buffer.vGrid;
+    vector<int> &vSelected=buffer.vOrder;
+    vector<int> &vBest=buffer.vOrderTmp;
+
+    vResultKeys.clear();
+    const int n=(int)vToDistributeKeys.size();
+    if(n==0 || N<=0)
+        return;
+
+    SortByResponse(vToDistributeKeys,vIndices);
+
+    if(n<=N)
+    {
+        for (int k = 0; k < n; ++k)
+            vResultKeys.push_back(vToDistributeKeys[vIndices[k]]);
+        return;
+    }
+
+    const int W=maxX-minX,H=maxY-minY;
+    //允许选出的数目和N相差10%
+    const int tolerance=std::max(1,N/10);
+    int low=1,high=std::max(W,H);
+    vBest.clear();
+
+    //二分查找抑制宽度：宽度越大，选出的特征点越少
+    while(low<=high)
+    {
+        const int width=(low+high)/2;
+        const int c=std::max(1,width/2);
+        const int gridCols=W/c+1,gridRows=H/c+1;
+        const int nCover=width/c;
+        vGrid.assign(gridCols*gridRows,0);
+        vSelected.clear();
+
+        for (int k = 0; k < n; ++k)
+        {
+            const int i=vIndices[k];
+            const int col=std::min(std::max((int)(vToDistributeKeys[i].pt.x/c),0),gridCols-1);
+            const int row=std::min(std::max((int)(vToDistributeKeys[i].pt.y/c),0),gridRows-1);
+            if(vGrid[row*gridCols+col])
+                continue;
+
+            //选中这个特征点，并覆盖它周围宽度为width的正方形区域
+            vSelected.push_back(i);
+            for (int r = std::max(row-nCover,0); r <= std::min(row+nCover,gridRows-1); ++r)
+            {
+                for (int q = std::max(col-nCover,0); q <= std::min(col+nCover,gridCols-1); ++q)
+                {
+                    vGrid[r*gridCols+q]=1;
+                }
+            }
+        }
+
+        const int nSelected=(int)vSelected.size();
+        //记录选出的数目不少于N的结果中最接近N的一个
+        if(nSelected>=N && (vBest.empty() || nSelected<(int)vBest.size()))
+            vBest.assign(vSelected.begin(),vSelected.end());
+
+        if(std::abs(nSelected-N)<=tolerance)
+            break;
+        else if(nSelected>N)
+            low=width+1;
+        else
+            high=width-1;
+    }
+
+    //优先使用数目不少于N的结果，按响应值从大到小保留N个
+    const vector<int> &vResult=vBest.empty()?vSelected:vBest;
+    for (size_t i = 0; i < vResult.size() && (int)i < N; ++i)
+    {
+        vResultKeys.push_back(vToDistributeKeys[vResult[i]]);
+    }
+
+}//ORBextractor::DistributeSSC
+
+void ORBextractor::DistributeGrid(const vector<cv::KeyPoint> &vToDistributeKeys,const int &minX,const int &maxX,const int &minY,const int &maxY,const int &N,const int &level,vector<cv::KeyPoint> &vResultKeys)
+{
+    DistributionBuffer &buffer=mvDistributionBuffers[level];
+    vector<int> &vIndices=buffer.vIndices;
+    vector<int> &vGrid=buffer.vGrid;
+    vector<int> &vRejected=buffer.vOrder;
+
+    vResultKeys.clear();
+    const int n=(int)vToDistributeKeys.size();
+    if(n==0 || N<=0)
+        return;
+
+    SortByResponse(vToDistributeKeys,vIndices);
+
+    //网格的边长，使得网格数大约为N
+    const int W=maxX-minX,H=maxY-minY;
+    const int cell=std::max(1,cvRound(sqrt((float)W*H/N)));
+    const int gridCols=W/cell+1,gridRows=H/cell+1;
+    //每个网格保留的特征点数
+    const int k=std::max(1,(N+gridCols*gridRows-1)/(gridCols*gridRows));
+    vGrid.assign(gridCols*gridRows,0);
+    vRejected.clear();
+
+    //按响应值从大到小遍历，网格未满时保留，否则放入候补
+    for (int j = 0; j < n; ++j)
+    {
+        const cv::KeyPoint &kp=vToDistributeKeys[vIndices[j]];
+        const int col=std::min(std::max((int)(kp.pt.x/cell),0),gridCols-1);
+        const int row=std::min(std::max((int)(kp.pt.y/cell),0),gridRows-1);
+        int &count=vGrid[row*gridCols+col];
+        if(count<k && (int)vResultKeys.size()<N)
+        {
+            count++;
+            vResultKeys.push_back(kp);
+        }
+        else
+        {
+            vRejected.push_back(vIndices[j]);
+        }
+    }
+
+    //数目不够时，用候补中响应值大的补足
+    for (size_t j = 0; j < vRejected.size() && (int)vResultKeys.size() < N; ++j)
+    {
+        vResultKeys.push_back(vToDistributeKeys[vRejected[j]]);
+    }
+
+}//ORBextractor::DistributeGrid
+
+//向上取整到64字节的整数倍
+static inline size_t AlignSize(const size_t &n)
+{
+    return (n+63)&~(size_t)63;
+}
+
+void ORBFeatures::Resize(const int &n,const int &nBytes)
+{
+    N=n;
+    nDescriptorBytes=nBytes;
+
+    //各个数组依次排列，每个数组的大小都取整到64字节，所以只要第一个数组对齐，后面的数组也都是对齐的
+    const size_t floatBytes=AlignSize(sizeof(float)*n);
+    const size_t intBytes=AlignSize(sizeof(int)*n);
+    const size_t descBytes=AlignSize((size_t)nBytes*n);
+    const size_t total=4*floatBytes+intBytes+descBytes;
+
+    //多分配64字节用于对齐起始地址。容量足够时resize不会重新分配内存
+    if(mvBuffer.size()<total+64)
+        mvBuffer.resize(total+64);
+
+    uchar* ptr=mvBuffer.data();
+    ptr+=(64-((size_t)ptr&63))&63;
+
+    x=(float*)ptr;
+    ptr+=floatBytes;
+    y=(float*)ptr;
+    ptr+=floatBytes;
+    angle=(float*)ptr;
+    ptr+=floatBytes;
+    response=(float*)ptr;
+    ptr+=floatBytes;
+    octave=(int*)ptr;
+    ptr+=intBytes;
+    descriptors=ptr;
+}
+
+void ORBextractor::SetThreadPool(ThreadPool* pThreadPool)
+{
+    mpThreadPool=pThreadPool;
+}
+
+void ORBextractor::SetProfiling(const bool &bProfiling)
+{
+#ifdef ORB_PROFILING
+    mbProfiling=bProfiling;
+#else
+    (void)bProfiling;
+#endif
+}
+
+void ORBextractor::SetExactDescriptors(bool bExact)
+{
+    mbExactDescriptors=bExact;
+}
+
+void ORBextractor::SetFusedPyramid(bool bFused)
+{
+    mbFusedPyramid=bFused;
+}
+
+void ORBextractor::SetDistributionMethod(int method)
+{
+    mnDistributionMethod=method;
+}
+
+void ORBextractor::SetScoreType(int scoreType)
+{
+    mnScoreType=scoreType;
+}
+
+void ORBextractor::ComputeFeaturesPerLevel(const int &nFeatures,vector<int> &vFeaturesPerLevel)
+{
+    vFeaturesPerLevel.resize(nlevels);
+
+    //图像降采样的缩放系数的倒数
+    float factor=1.0f/scaleFactor;
+
+    //第0层的图像对应分配特征带你的个数
+    //等比数列求和：nFeatures=n0*(1-factor^nlevels)/(1-factor)
+    float nDesiredFeaturesPerScale = nFeatures*(1-factor)/(1-(float)pow((double)factor,(double)nlevels));
+
+    int sumFeatures=0;
+
+    for (int i = 0; i < nlevels-1; i++)
+    {
+        vFeaturesPerLevel[i]= cvRound(nDesiredFeaturesPerScale);
+        sumFeatures+=vFeaturesPerLevel[i];
+        nDesiredFeaturesPerScale=nDesiredFeaturesPerScale*factor;
+    }
+
+    //最后一层分配剩下的特征点
+    vFeaturesPerLevel[nlevels-1]=std::max(nFeatures-sumFeatures,0);
+}
+
+void ORBextractor::SetTimeBudget(double dBudget)
+{
+    mdTimeBudget=dBudget;
+
+    //重新开始估计耗时，并恢复构造时的特征点数目和FAST阈值
+    mdFixedTimeEst=0;
+    mdKeyTimeEst=0;
+    mnBudgetFeatures=nfeatures;
+    ComputeFeaturesPerLevel(nfeatures,mvFeaturesPerLevel);
+    std::fill(mviniThFAST.begin(),mviniThFAST.end(),iniThFAST);
+    std::fill(mvminThFAST.begin(),mvminThFAST.end(),minThFAST);
+}
+
+/**
+ * @brief 时间预算模式下，根据本帧的耗时调整下一帧每层的特征点数目和FAST阈值
+ * @details 把本帧的耗时分成两部分：与特征点数目无关的部分（构建金字塔、检测、模糊）和与保留的特征点数目成正比的部分
+ * （分配、方向、描述子）。各层并行时各阶段的耗时之和大于实际经过的时间，所以按两部分耗时之和的比例来分配实际的帧耗时。
+ * 估计值在变大时直接取新值，变小时缓慢下降，这样对耗时的突增反应迅速，偏向于保证尾部延迟。
+ * 特征点数目超出预算时乘性减少，有余量时加性增加；如果与特征点数目无关的部分就已经占了预算的大部分，
+ * 就提高检测耗时最多的那一层的FAST阈值，反之在余量充足时逐步恢复原来的阈值
+ * @param[in] nKeys 本帧提取到的特征点数目
+ */
+void ORBextractor::UpdateBudget(const int &nKeys)
+{
+    //留出一部分余量给帧间的耗时波动
+    const double usableTime=0.85*mdTimeBudget;
+
+    double fixedWork=mdPyramidTime,keyWork=0;
+    for (int level = 0; level < nlevels; ++level)
+    {
+        fixedWork+=mvDetectTime[level]+mvBlurTime[level];
+        keyWork+=mvDistributionTime[level]+mvOrientationTime[level]+mvDescriptorTime[level];
+    }
+    if(fixedWork+keyWork<=0)
+        return;
+
+    const double fixedTime=mdFrameTime*fixedWork/(fixedWork+keyWork);
+    const double keyTime=nKeys>0? mdFrameTime*keyWork/(fixedWork+keyWork)/nKeys : 0;
+
+    //变大时立即跟随，变小时缓慢衰减
+    const double alpha=0.2;
+    mdFixedTimeEst=fixedTime>mdFixedTimeEst? fixedTime : mdFixedTimeEst+alpha*(fixedTime-mdFixedTimeEst);
+    mdKeyTimeEst=keyTime>mdKeyTimeEst? keyTime : mdKeyTimeEst+alpha*(keyTime-mdKeyTimeEst);
+
+    //调整FAST阈值：检测部分占用过多时，提高检测最慢的那一层的阈值；余量充足时，降低被提高最多的那一层的阈值
+    if(mdFixedTimeEst>0.7*usableTime)
+    {
+        int worst=0;
+        for (int level = 1; level < nlevels; ++level)
+        {
+            if(mvDetectTime[level]>mvDetectTime[worst])
+                worst=level;
+        }
+        //阈值最多提高到原来的3倍
+        if(mviniThFAST[worst]<3*iniThFAST)
+        {
+            mviniThFAST[worst]+=2;
+            mvminThFAST[worst]=std::min(mvminThFAST[worst]+1,mviniThFAST[worst]);
+        }
+    }
+    else if(mdFixedTimeEst<0.4*usableTime)
+    {
+        int raised=0;
+        for (int level = 1; level < nlevels; ++level)
+        {
+            if(mviniThFAST[level]-iniThFAST>mviniThFAST[raised]-iniThFAST)
+                raised=level;
+        }
+        if(mviniThFAST[raised]>iniThFAST)
+        {
+            mviniThFAST[raised]=std::max(mviniThFAST[raised]-2,iniThFAST);
+            mvminThFAST[raised]=std::max(mvminThFAST[raised]-1,minThFAST);
+        }
+    }
+
+    //剩下的时间可以容纳的特征点数目
+    int nTarget=nfeatures;
+    if(mdKeyTimeEst>0)
+        nTarget=(int)std::max((usableTime-mdFixedTimeEst)/mdKeyTimeEst,0.0);
+
+    if(mdFrameTime>mdTimeBudget)
+        //超出预算：至少减少30%
+        nTarget=std::min(nTarget,(int)(0.7*mnBudgetFeatures));
+    else
+        //没有超出：每帧最多恢复nfeatures的5%
+        nTarget=std::min(nTarget,mnBudgetFeatures+std::max(nfeatures/20,1));
+
+    //至少保留nfeatures的10%，不超过构造时的nfeatures
+    mnBudgetFeatures=std::min(std::max(nTarget,std::max(nfeatures/10,nlevels)),nfeatures);
+
+    ComputeFeaturesPerLevel(mnBudgetFeatures,mvFeaturesPerLevel);
+}
+
+/**
+ * @brief 有掩码时，按照各层未被遮挡的面积比例重新分配各层的特征点数目
+ * @details 每层的权重是原来的特征点数目乘以该层未被遮挡的面积比例，总数保持不变，
+ * 所以被遮挡的区域越多，未被遮挡区域中的特征点越密集；完全被遮挡的层不分配特征点
+*/
+void ORBextractor::ComputeMaskedFeaturesPerLevel()
+{
+    if(!mbMaskActive)
+        return;
+
+    int nTotal=0;
+    double sumWeight=0;
+    for (int level = 0; level < nlevels; ++level)
+    {
+        long area=0,valid=0;
+        for (int cell = mvnCellStart[level]; cell < mvnCellStart[level+1]; ++cell)
+        {
+            area+=mvCellArea[cell];
+            valid+=mvCellValidArea[cell];
+        }
+        mvLevelValidRatio[level]=area>0? (float)valid/area : 0.f;
+        sumWeight+=mvFeaturesPerLevel[level]*mvLevelValidRatio[level];
+        nTotal+=mvFeaturesPerLevel[level];
+    }
+
+    //按累积的权重取整，保证各层之和正好等于总数
+    double cumWeight=0;
+    int nAssigned=0;
+    for (int level = 0; level < nlevels; ++level)
+    {
+        cumWeight+=mvFeaturesPerLevel[level]*mvLevelValidRatio[level];
+        const int n=sumWeight>0? cvRound(cumWeight/sumWeight*nTotal) : 0;
+        mvMaskedFeaturesPerLevel[level]=n-nAssigned;
+        nAssigned=n;
+    }
+}
+
+void ORBextractor::SetVideoMode(bool bVideo,float fThreshold,int nRefresh)
+{
+    mbVideoMode=bVideo;
+    mfVideoThreshold=fThreshold;
+    mnVideoRefresh=std::max(nRefresh,1);
+
+    //下一帧所有网格重新检测
+    std::fill(mvCellThFAST.begin(),mvCellThFAST.end(),-1);
+}
+
+int ORBextractor::GetLastReusedCells()
+{
+    int n=0;
+    for (size_t i = 0; i < mvCellReused.size(); ++i)
+    {
+        n+=mvCellReused[i];
+    }
+    return n;
+}
+
+double ORBextractor::GetLastDistributionTime()
+{
+    double t=0;
+    for (int level = 0; level < nlevels; ++level)
+    {
+        t+=mvDistributionTime[level];
+    }
+    return t;
+}
+
+void ORBextractor::RunParallel(const int &n,const std::function<void(int)> &f)
+{
+    if(mpThreadPool)
+    {
+        mpThreadPool->ParallelFor(n,f);
+    }
+    else
+    {
+        for (int i = 0; i < n; ++i)
+            f(i);
+    }
+}
+
+//Harris响应值的窗口边长和系数，和OpenCV中ORB的设置相同
+const int HARRIS_BLOCK_SIZE=7;
+const float HARRIS_K=0.04f;
+
+/**
+ * @brief 计算一行像素的Sobel梯度乘积Ix*Ix、Iy*Iy、Ix*Iy，并更新最近HARRIS_BLOCK_SIZE行的列和
+ * @details dst、sums、old中三种乘积各占一段，每段相距stride个int。old是离开窗口的那一行的乘积，可以和dst相同，为NULL时不减
+ * @param[in] src 这一行的第一个像素，要求上下左右各1个像素都可以访问
+ * @param[in] step 图像的行步长
+ * @param[in] n 像素个数
+ */
+typedef void (*HarrisRowKernel)(const uchar* src,const int &step,const int &n,const int &stride,int* dst,int* sums,const int* old);
+
+static void harrisRowScalar(const uchar* src,const int &step,const int &n,const int &stride,int* dst,int* sums,const int* old)
+{
+    for (int c = 0; c < n; ++c)
+    {
+        const uchar* p=src+c;
+        const int ix=(p[1]-p[-1])*2+(p[-step+1]-p[-step-1])+(p[step+1]-p[step-1]);
+        const int iy=(p[step]-p[-step])*2+(p[step-1]-p[-step-1])+(p[step+1]-p[-step+1]);
+        const int xx=ix*ix,yy=iy*iy,xy=ix*iy;
+        //先读出旧的值，dst和old可能是同一块内存
+        if(old)
+        {
+            sums[c]-=old[c];
+            sums[stride+c]-=old[stride+c];
+            sums[2*stride+c]-=old[2*stride+c];
+        }
+        dst[c]=xx;
+        dst[stride+c]=yy;
+        dst[2*stride+c]=xy;
+        sums[c]+=xx;
+        sums[stride+c]+=yy;
+        sums[2*stride+c]+=xy;
+    }
+}
+
+#if defined(ORB_SIMD_X86)
+
+//AVX2版本，一次处理8个像素，每个像素扩展成32位整数
+__attribute__((target("avx2")))
+static void harrisRowAVX2(const uchar* src,const int &step,const int &n,const int &stride,int* dst,int* sums,const int* old)
+{
+    int c=0;
+    for (; c+8 <= n; c+=8)
+    {
+        const uchar* p=src+c;
+#define HARRIS_LOAD(q) _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(q)))
+        const __m256i ul=HARRIS_LOAD(p-step-1),u=HARRIS_LOAD(p-step),ur=HARRIS_LOAD(p-step+1);
+        const __m256i l=HARRIS_LOAD(p-1),r=HARRIS_LOAD(p+1);
+        const __m256i dl=HARRIS_LOAD(p+step-1),d=HARRIS_LOAD(p+step),dr=HARRIS_LOAD(p+step+1);
+#undef HARRIS_LOAD
+        const __m256i ix=_mm256_add_epi32(_mm256_slli_epi32(_mm256_sub_epi32(r,l),1),
+                                          _mm256_add_epi32(_mm256_sub_epi32(ur,ul),_mm256_sub_epi32(dr,dl)));
+        const __m256i iy=_mm256_add_epi32(_mm256_slli_epi32(_mm256_sub_epi32(d,u),1),
+                                          _mm256_add_epi32(_mm256_sub_epi32(dl,ul),_mm256_sub_epi32(dr,ur)));
+        const __m256i prod[3]={_mm256_mullo_epi32(ix,ix),_mm256_mullo_epi32(iy,iy),_mm256_mullo_epi32(ix,iy)};
+
+        for (int k = 0; k < 3; ++k)
+        {
+            __m256i sum=_mm256_loadu_si256((const __m256i*)(sums+k*stride+c));
+            if(old)
+                sum=_mm256_sub_epi32(sum,_mm256_loadu_si256((const __m256i*)(old+k*stride+c)));
+            _mm256_storeu_si256((__m256i*)(dst+k*stride+c),prod[k]);
+            _mm256_storeu_si256((__m256i*)(sums+k*stride+c),_mm256_add_epi32(sum,prod[k]));
+        }
+    }
+    //剩下的像素，三段都要偏移c
+    if(c<n)
+    {
+        int tail[3*8],tailSums[3*8],tailOld[3*8];
+        for (int k = 0; k < 3; ++k)
+        {
+            for (int i = 0; i < n-c; ++i)
+            {
+                tailSums[k*8+i]=sums[k*stride+c+i];
+                if(old)
+                    tailOld[k*8+i]=old[k*stride+c+i];
+            }
+        }
+        harrisRowScalar(src+c,step,n-c,8,tail,tailSums,old? tailOld : NULL);
+        for (int k = 0; k < 3; ++k)
+        {
+            for (int i = 0; i < n-c; ++i)
+            {
+                dst[k*stride+c+i]=tail[k*8+i];
+                sums[k*stride+c+i]=tailSums[k*8+i];
+            }
+        }
+    }
+}
+
+#elif defined(ORB_SIMD_NEON)
+
+//NEON版本，一次处理8个像素，梯度用16位整数计算，乘积扩展成32位
+static void harrisRowNEON(const uchar* src,const int &step,const int &n,const int &stride,int* dst,int* sums,const int* old)
+{
+    int c=0;
+    for (; c+8 <= n; c+=8)
+    {
+        const uchar* p=src+c;
+#define HARRIS_LOAD(q) vreinterpretq_s16_u16(vmovl_u8(vld1_u8(q)))
+        const int16x8_t ul=HARRIS_LOAD(p-step-1),u=HARRIS_LOAD(p-step),ur=HARRIS_LOAD(p-step+1);
+        const int16x8_t l=HARRIS_LOAD(p-1),r=HARRIS_LOAD(p+1);
+        const int16x8_t dl=HARRIS_LOAD(p+step-1),d=HARRIS_LOAD(p+step),dr=HARRIS_LOAD(p+step+1);
+#undef HARRIS_LOAD
+        const int16x8_t ix=vaddq_s16(vshlq_n_s16(vsubq_s16(r,l),1),vaddq_s16(vsubq_s16(ur,ul),vsubq_s16(dr,dl)));
+        const int16x8_t iy=vaddq_s16(vshlq_n_s16(vsubq_s16(d,u),1),vaddq_s16(vsubq_s16(dl,ul),vsubq_s16(dr,ur)));
+        const int32x4_t prod[6]={
+            vmull_s16(vget_low_s16(ix),vget_low_s16(ix)),vmull_s16(vget_high_s16(ix),vget_high_s16(ix)),
+            vmull_s16(vget_low_s16(iy),vget_low_s16(iy)),vmull_s16(vget_high_s16(iy),vget_high_s16(iy)),
+            vmull_s16(vget_low_s16(ix),vget_low_s16(iy)),vmull_s16(vget_high_s16(ix),vget_high_s16(iy))};
+
+        for (int k = 0; k < 3; ++k)
+        {
+            for (int h = 0; h < 2; ++h)
+            {
+                const int o=k*stride+c+4*h;
+                int32x4_t sum=vld1q_s32(sums+o);
+                if(old)
+                    sum=vsubq_s32(sum,vld1q_s32(old+o));
+                vst1q_s32(dst+o,prod[2*k+h]);
+                vst1q_s32(sums+o,vaddq_s32(sum,prod[2*k+h]));
+            }
+        }
+    }
+    if(c<n)
+    {
+        int tail[3*8],tailSums[3*8],tailOld[3*8];
+        for (int k = 0; k < 3; ++k)
+        {
+            for (int i = 0; i < n-c; ++i)
+            {
+                tailSums[k*8+i]=sums[k*stride+c+i];
+                if(old)
+                    tailOld[k*8+i]=old[k*stride+c+i];
+            }
+        }
+        harrisRowScalar(src+c,step,n-c,8,tail,tailSums,old? tailOld : NULL);
+        for (int k = 0; k < 3; ++k)
+        {
+            for (int i = 0; i < n-c; ++i)
+            {
+                dst[k*stride+c+i]=tail[k*8+i];
+                sums[k*stride+c+i]=tailSums[k*8+i];
+            }
+        }
+    }
+}
+
+#endif
+
+static HarrisRowKernel SelectHarrisRowKernel()
+{
+#if defined(ORB_SIMD_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return harrisRowAVX2;
+#elif defined(ORB_SIMD_NEON)
+    return harrisRowNEON;
+#endif
+    return harrisRowScalar;
+}
+
+static const HarrisRowKernel gHarrisRowKernel=SelectHarrisRowKernel();
+
+/**
+ * @brief 一次扫描计算一层所有候选角点的Harris响应值，写入response
+ * @details 和OpenCV中ORB的HarrisResponses相同：3x3 Sobel梯度，7x7窗口，k=0.04。
+ * 先把候选点按行做计数排序，然后从上到下逐行计算梯度乘积，同时维护最近7行的列和；
+ * 累加到某个候选点所在行的下方第3行时，对列和做水平7点求和，就得到这个点窗口内的二阶矩。
+ * 相邻两个有候选点的行相距较远时重新开始累加，所以只扫描候选点附近的行。
+ * 所有的累加都是整数运算，结果和逐点计算完全一致
+ * @param[in] image 本层图像
+ * @param[in&out] keypoints 候选角点，坐标以(offsetX,offsetY)为原点
+ * @param[in] offsetX 坐标原点在图像中的x坐标
+ * @param[in] offsetY 坐标原点在图像中的y坐标
+ * @param[in] vBuffer 缓存，跨帧复用
+ */
+static void ComputeHarrisResponses(const Mat &image,vector<KeyPoint> &keypoints,const int &offsetX,const int &offsetY,vector<int> &vBuffer)
+{
+    const int N=(int)keypoints.size();
+    if(N==0)
+        return;
+
+    const int H=HARRIS_BLOCK_SIZE/2;
+
+    //候选点所覆盖的范围
+    int minX=std::numeric_limits<int>::max(),maxX=std::numeric_limits<int>::min();
+    int minY=std::numeric_limits<int>::max(),maxY=std::numeric_limits<int>::min();
+    for (int i = 0; i < N; ++i)
+    {
+        const int x=cvRound(keypoints[i].pt.x)+offsetX;
+        const int y=cvRound(keypoints[i].pt.y)+offsetY;
+        minX=std::min(minX,x);
+        maxX=std::max(maxX,x);
+        minY=std::min(minY,y);
+        maxY=std::max(maxY,y);
+    }
+
+    //需要计算梯度的列[x0,x0+n)，和有候选点的行[minY,maxY]
+    const int x0=minX-H;
+    const int n=maxX-minX+2*H+1;
+    const int nRows=maxY-minY+1;
+
+    //缓存依次为：每行候选点的结束位置、按行排好的候选点编号、最近7行的梯度乘积、列和
+    vBuffer.resize(nRows+N+(HARRIS_BLOCK_SIZE+1)*3*n);
+    int* rowEnd=&vBuffer[0];
+    int* order=rowEnd+nRows;
+    int* ring=order+N;
+    int* sums=ring+HARRIS_BLOCK_SIZE*3*n;
+
+    //计数排序：先统计每行的候选点数目，转换成每行的起始位置，填入后变成每行的结束位置
+    std::fill(rowEnd,rowEnd+nRows,0);
+    for (int i = 0; i < N; ++i)
+        rowEnd[cvRound(keypoints[i].pt.y)+offsetY-minY]++;
+    for (int r = 0,start = 0; r < nRows; ++r)
+    {
+        const int count=rowEnd[r];
+        rowEnd[r]=start;
+        start+=count;
+    }
+    for (int i = 0; i < N; ++i)
+        order[rowEnd[cvRound(keypoints[i].pt.y)+offsetY-minY]++]=i;
+
+    const int step=(int)image.step1();
+    const float scale=1.f/((1<<2)*HARRIS_BLOCK_SIZE*255.f);
+    const float scale_sq_sq=scale*scale*scale*scale;
+
+    //lastRow是已经累加的最后一行，firstRow是本次连续累加的第一行
+    int lastRow=std::numeric_limits<int>::min(),firstRow=0;
+    for (int r = 0; r < nRows; ++r)
+    {
+        const int begin=r>0? rowEnd[r-1] : 0;
+        const int end=rowEnd[r];
+        if(begin==end)
+            continue;
+
+        const int yc=minY+r;
+
+        //窗口和已经累加的行没有重叠，重新开始
+        if(lastRow<yc-H)
+        {
+            std::fill(sums,sums+3*n,0);
+            firstRow=yc-H;
+            lastRow=firstRow-1;
+        }
+
+        //累加到yc+H行，离开窗口的行从列和中减去
+        for (int y = lastRow+1; y <= yc+H; ++y)
+        {
+            int* slot=ring+(y%HARRIS_BLOCK_SIZE)*3*n;
+            const int* old=y-HARRIS_BLOCK_SIZE>=firstRow? slot : NULL;
+            gHarrisRowKernel(image.ptr<uchar>(y)+x0,step,n,n,slot,sums,old);
+        }
+        lastRow=yc+H;
+
+        //本行的候选点：对列和做水平方向的求和
+        for (int i = begin; i < end; ++i)
+        {
+            KeyPoint &kp=keypoints[order[i]];
+            const int cx=cvRound(kp.pt.x)+offsetX-x0;
+            int a=0,b=0,c=0;
+            for (int k = cx-H; k <= cx+H; ++k)
+            {
+                a+=sums[k];
+                b+=sums[n+k];
+                c+=sums[2*n+k];
+            }
+            kp.response=((float)a*b-(float)c*c-HARRIS_K*((float)a+b)*((float)a+b))*scale_sq_sq;
+        }
+    }
+
+}//ComputeHarrisResponses
+
+//计算四叉树的特征点，函数名字后的octtree只是说明在过滤和分配特征点的时候使用的方式
+void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint>>& allkeypoints){
+
+    allkeypoints.resize(nlevels);
+
+    //第一步：所有层的所有网格作为独立的任务一起检测FAST角点，每个网格写到自己的缓存中，不需要加锁
+    RunParallel((int)mvCellLevel.size(),[this](int cell){
+        ComputeCellKeyPoints(mvCellLevel[cell],cell);
+    });
+
+    //有掩码时，根据各层未被遮挡的面积重新分配各层的特征点数目
+    ComputeMaskedFeaturesPerLevel();
+
+    //第二步：每层按网格的顺序合并角点，再分配并计算方向。每层的结果写到各自的vector中，所以各层之间可以并行
+    RunParallel(nlevels,[this,&allkeypoints](int level){
+        ComputeKeyPointsOctTreeLevel(level,allkeypoints[level]);
+    });
+
+}//ORBextractor::ComputeKeyPointsOctTree
+
+//在某一层的一个网格中检测FAST角点
+void ORBextractor::ComputeCellKeyPoints(const int &level,const int &cell){
+
+    //视频模式下网格中的角点可能会被复用，所以先不清空
+    vector<KeyPoint> &vKeysCell=mvvCellKeys[cell];
+    mvCellTime[cell]=0;
+    mvCellReused[cell]=0;
+    mvCellArea[cell]=0;
+    mvCellValidArea[cell]=0;
+
+    //网格在本层中的行号和列号
+    const int i=(cell-mvnCellStart[level])/mvnCellCols[level];
+    const int j=(cell-mvnCellStart[level])%mvnCellCols[level];
+    const int wCell=mvnCellWidth[level];
+    const int hCell=mvnCellHeight[level];
+
+    //计算进行特征点提取的图像区域尺寸，这里的3是FAST角点检测时需要的半径
+    const int minBorderX = EDGE_THRESHOLD-3;
+    const int minBorderY = minBorderX;
+    const int maxBorderX = mvImagePyramid[level].cols-EDGE_THRESHOLD+3;
+    const int maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD+3;
+
+    //网格的上下边界，多出来的6个像素是为了FAST检测时网格之间有重叠
+    const int iniY = minBorderY+i*hCell;
+    int maxY = iniY+hCell+6;
+    //网格的起始行已经超出了有效的图像区域
+    if(iniY>=maxBorderY-3)
+    {
+        vKeysCell.clear();
+        return;
+    }
+    if(maxY>maxBorderY)
+        maxY = maxBorderY;
+
+    //网格的左右边界
+    const int iniX = minBorderX+j*wCell;
+    int maxX = iniX+wCell+6;
+    if(iniX>=maxBorderX-6)
+    {
+        vKeysCell.clear();
+        return;
+    }
+    if(maxX>maxBorderX)
+        maxX = maxBorderX;
+
+    //有掩码时统计网格中未被遮挡的像素，全部被遮挡的网格不再检测
+    const int nArea=(maxY-iniY)*(maxX-iniX);
+    int nValid=nArea;
+    if(mbMaskActive)
+        nValid=countNonZero(mvMaskPyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX));
+    mvCellArea[cell]=nArea;
+    mvCellValidArea[cell]=nValid;
+    if(nValid==0)
+    {
+        vKeysCell.clear();
+        mvCellThFAST[cell]=-1;
+        return;
+    }
+
+    //视频模式：用网格内均匀采样的8x8个像素作为网格内容的特征，和上次检测时的采样比较平均绝对差（SAD）。
+    //变化不大、阈值和掩码都没有变化、也没有到定期刷新的时候，就直接复用上次检测到的角点
+    if(mbVideoMode)
+    {
+        //没有掩码时为0
+        const uint64_t maskSignature=mbMaskActive? ComputeMaskSignature(mvMaskPyramid[level],iniX,iniY,maxX,maxY) : 0;
+        uchar signature[CELL_SIGNATURE_SIZE];
+        const float fDiff=ComputeCellSignature(mvImagePyramid[level],iniX,iniY,maxX,maxY,
+                                               &mvCellSignature[cell*CELL_SIGNATURE_SIZE],signature);
+
+        //定期刷新的时刻按网格错开，避免所有网格在同一帧重新检测
+        const bool bRefresh=(mnFrameId+cell)%mnVideoRefresh==0;
+        if(fDiff<=mfVideoThreshold && mvCellThFAST[cell]==mviniThFAST[level] && mvCellMaskSignature[cell]==maskSignature && !bRefresh)
+        {
+            mvCellReused[cell]=1;
+            return;
+        }
+
+        //重新检测，记录本次检测时的采样、阈值和掩码
+        std::copy(signature,signature+CELL_SIGNATURE_SIZE,mvCellSignature.begin()+cell*CELL_SIGNATURE_SIZE);
+        mvCellThFAST[cell]=mviniThFAST[level];
+        mvCellMaskSignature[cell]=maskSignature;
+    }
+
+    //网格被部分遮挡时，需要去掉落在被遮挡区域的角点
+    const bool bFilter=nValid<nArea;
+
+    vKeysCell.clear();
+
+    std::chrono::steady_clock::time_point t1;
+    if(mbMeasureTime)
+        t1=std::chrono::steady_clock::now();
+
+    //先用初始阈值检测FAST角点
+    FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
+         vKeysCell,mviniThFAST[level],true);
+    if(bFilter)
+        FilterKeyPointsByMask(mvMaskPyramid[level],iniX,iniY,vKeysCell);
+
+    //如果这个网格中没有检测到角点，那么降低阈值重新检测
+    if(vKeysCell.empty())
+    {
+        FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
+             vKeysCell,mvminThFAST[level],true);
+        if(bFilter)
+            FilterKeyPointsByMask(mvMaskPyramid[level],iniX,iniY,vKeysCell);
+    }
+
+    //角点的坐标从网格坐标系转换到以(minBorderX,minBorderY)为原点的坐标系
+    for(vector<cv::KeyPoint>::iterator vit=vKeysCell.begin(); vit!=vKeysCell.end();vit++)
+    {
+        (*vit).pt.x+=j*wCell;
+        (*vit).pt.y+=i*hCell;
+    }
+
+    if(mbMeasureTime)
+        mvCellTime[cell]=ElapsedTime(t1);
+
+}//ORBextractor::ComputeCellKeyPoints
+
+//计算某一层图像的特征点
+void ORBextractor::ComputeKeyPointsOctTreeLevel(const int &level,vector<KeyPoint>& keypoints){
+
+    const int minBorderX = EDGE_THRESHOLD-3;
+    const int minBorderY = minBorderX;
+    const int maxBorderX = mvImagePyramid[level].cols-EDGE_THRESHOLD+3;
+    const int maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD+3;
+
+    //按照网格的顺序合并本层所有网格中的角点，顺序和串行检测时相同
+    vector<KeyPoint> &vToDistributeKeys=mvvToDistributeKeys[level];
+    vToDistributeKeys.clear();
+    for (int cell = mvnCellStart[level]; cell < mvnCellStart[level+1]; ++cell)
+    {
+        vToDistributeKeys.insert(vToDistributeKeys.end(),mvvCellKeys[cell].begin(),mvvCellKeys[cell].end());
+    }
+
+    mvnDetectedKeys[level]=(int)vToDistributeKeys.size();
+
+    //检测的耗时是本层各个网格耗时之和
+    if(mbMeasureTime)
+    {
+        mvDetectTime[level]=0;
+        for (int cell = mvnCellStart[level]; cell < mvnCellStart[level+1]; ++cell)
+            mvDetectTime[level]+=mvCellTime[cell];
+    }
+
+    //使用Harris响应值时，分配之前一次算出本层所有候选点的响应值，耗时计入检测阶段
+    if(mnScoreType==HARRIS_SCORE)
+    {
+        std::chrono::steady_clock::time_point t1;
+        if(mbMeasureTime)
+            t1=std::chrono::steady_clock::now();
+        ComputeHarrisResponses(mvImagePyramid[level],vToDistributeKeys,minBorderX,minBorderY,mvvHarrisBuffers[level]);
+        if(mbMeasureTime)
+            mvDetectTime[level]+=ElapsedTime(t1);
+    }
+
+    //分配特征点，使其在图像中均匀分布
+    DistributeKeyPoints(vToDistributeKeys,minBorderX,maxBorderX,minBorderY,maxBorderY,
+                        mbMaskActive? mvMaskedFeaturesPerLevel[level] : mvFeaturesPerLevel[level],level,keypoints);
+
+    //PATCH_SIZE是对于底层的初始图像来说的，现在要根据当前图层的尺度缩放倍数进行缩放得到缩放后的PATCH大小
+    const int scaledPatchSize = PATCH_SIZE*mvScaleFactor[level];
+
+    //恢复特征点在本层图像中的坐标，并记录特征点所在的层和尺寸
+    for(vector<KeyPoint>::iterator keypoint=keypoints.begin();keypoint!=keypoints.end();++keypoint)
+    {
+        keypoint->pt.x+=minBorderX;
+        keypoint->pt.y+=minBorderY;
+        keypoint->octave=level;
+        keypoint->size=scaledPatchSize;
+    }
+
+    //计算特征点的方向
+    std::chrono::steady_clock::time_point t2;
+    if(mbMeasureTime)
+        t2=std::chrono::steady_clock::now();
+    mpfnOrientation(mvImagePyramid[level],keypoints);
+    if(mbMeasureTime)
+        mvOrientationTime[level]=ElapsedTime(t2);
+
+}//ORBextractor::ComputeKeyPointsOctTreeLevel
+
+
+//这个函数已经弃用了
+void ORBextractor::ComputeKeyPOintsold(vector<vector<KeyPoint>>& allkeypoints){
+
+}//ORBextractor::ComputeKeyPOintsold
+
+/**
+ * @brief 使用预先旋转好的采样点查找表，计算某层金字塔上特征点的描述子
+ * @details 特征点的方向被离散化到ANGLE_BINS个区间中，每个描述子就只剩下查表取值和比较的操作，
+ * 与computeDescriptors相比省去了每个特征点的sin/cos和1024次取整
+ * @param[in] vOffsets 由ComputePatternOffsets按照image的行步长计算出的地址偏移量
+ * @param[in] kernel 描述子核函数
+*/
+template<class Config>
+static void computeDescriptorsLUTT(const cv::Mat& image,const vector<KeyPoint>& KeyPoints,cv::Mat& descriptors,const vector<int>& vOffsets,
+                                   DescriptorKernel kernel)
+{
+    //和computeDescriptorsT一样直接写入调用者的描述子矩阵
+    CV_Assert(descriptors.rows==(int)KeyPoints.size() && descriptors.cols==Config::DescBytes && descriptors.type()==CV_8UC1);
+
+    for (size_t i = 0; i < KeyPoints.size(); ++i)
+    {
+        const KeyPoint &kpt=KeyPoints[i];
+        const int* ofs=&vOffsets[GetAngleBin(kpt.angle)*512];
+        kernel(&image.at<uchar>(cvRound(kpt.pt.y),cvRound(kpt.pt.x)),
+               ofs,ofs+256,Config::DescBytes,
+               descriptors.ptr((int)i));
+    }
+
+}//computeDescriptorsLUTT
+
+//提取时使用的查找表描述子计算，核函数为运行时选择的最快版本
+template<class Config>
+static void computeDescriptorsLUTDefaultT(const cv::Mat& image,const vector<KeyPoint>& KeyPoints,cv::Mat& descriptors,const vector<int>& vOffsets)
+{
+    computeDescriptorsLUTT<Config>(image,KeyPoints,descriptors,vOffsets,gDescriptorKernel);
+}
+
+
+/**
+ * @brief 直接计算一幅图像上特征点的描述子，用于单独测试和对比各种计算方式
+ * @param[in] image 单通道灰度图像，特征点到边界的距离要大于EDGE_THRESHOLD
+ * @param[in] keypoints 已经计算好方向的特征点
+ * @param[out] descriptors 描述子，使用默认配置（32字节）
+ * @param[in] method DESCRIPTOR_EXACT、DESCRIPTOR_LUT或DESCRIPTOR_LUT_SCALAR
+ */
+void ORBextractor::ComputeDescriptors(const cv::Mat &image,const std::vector<cv::KeyPoint> &keypoints,cv::Mat &descriptors,const int &method)
+{
+    assert(image.type()==CV_8UC1);
+    descriptors.create((int)keypoints.size(),DefaultORBConfig::DescBytes,CV_8UC1);
+    if(method==DESCRIPTOR_EXACT)
+    {
+        computeDescriptorsT<DefaultORBConfig>(image,keypoints,descriptors);
+        return;
+    }
+
+    //查找表只和行步长有关，和提取时一样从共享的缓存中获取
+    shared_ptr<const vector<int> > pOffsets=GetPatternOffsets((int)image.step1());
+    computeDescriptorsLUTT<DefaultORBConfig>(image,keypoints,descriptors,*pOffsets,
+                                             method==DESCRIPTOR_LUT_SCALAR? computeOrbDescriptorScalar : gDescriptorKernel);
+}
+
+/**
+ * @brief 计算BORDER_REFLECT_101方式下越界坐标所对应的坐标
+ * @param[in] p 坐标，要求越界的距离小于len
+ * @param[in] len 长度
+ */
+static inline int Reflect101(const int &p,const int &len)
+{
+    if(p<0)
+        return -p;
+    if(p>=len)
+        return 2*len-p-2;
+    return p;
+}
+
+//定点化的7x7高斯核（sigma=2）一维系数的小数位数
+const int BLUR_BITS=10;
+
+//定点化的高斯核一维系数，和为1<<BLUR_BITS
+static const vector<int>& GetBlurKernel()
+{
+    static const vector<int> vKernel=[]{
+        vector<int> v(7);
+        double w[7],sum=0;
+        for (int i = 0; i < 7; ++i)
+        {
+            w[i]=exp(-(i-3)*(i-3)/(2.0*2.0*2.0));
+            sum+=w[i];
+        }
+        int isum=0;
+        for (int i = 0; i < 7; ++i)
+        {
+            v[i]=cvRound(w[i]/sum*(1<<BLUR_BITS));
+            if(i!=3)
+                isum+=v[i];
+        }
+        //调整中心系数，保证系数之和严格等于1<<BLUR_BITS
+        v[3]=(1<<BLUR_BITS)-isum;
+        return v;
+    }();
+    return vKernel;
+}
+
+/**
+ * @brief 融合的金字塔单层构建：一次按行的扫描同时完成缩放、补边和7x7高斯模糊
+ * @details 对带边界图像的每一行：先（缩放或拷贝）生成该行并补齐左右边界，趁这一行还在缓存中时做水平方向的模糊，
+ * 结果放到8行的环形缓存中；再延迟3行做竖直方向的模糊。这样每层图像只被完整地遍历一次，而不是分别被resize、
+ * copyMakeBorder和GaussianBlur各遍历一遍。缩放使用和INTER_LINEAR相同的坐标映射和11位定点系数，但按标量公式一次舍入，
+ * OpenCV的SIMD实现会先截断中间结果，所以缩放结果和resize可能有±1的差别；模糊使用BLUR_BITS位定点系数，
+ * 和GaussianBlur同样可能有±1的差别
+ * @param[in] src 第0层时为输入图像，否则为上一层（不带边界）的图像
+ * @param[in] bResize 是否需要缩放，第0层为false
+ * @param[out] border 本层带边界的图像
+ * @param[out] blurBorder 本层带边界的模糊图像
+ * @param[in] vBuffer 临时缓存，容量足够时不会分配内存
+ */
+static void BuildFusedLevel(const Mat &src,const bool &bResize,Mat &border,Mat &blurBorder,vector<int> &vBuffer)
+{
+    const int E=EDGE_THRESHOLD;
+    const int R=border.rows,C=border.cols;
+    //不带边界的本层图像的尺寸
+    const int W=C-2*E,H=R-2*E;
+
+    vBuffer.resize(3*W+8*C);
+    int* xofs0=&vBuffer[0];
+    int* xofs1=xofs0+W;
+    int* xalpha=xofs1+W;
+    int* ring=xalpha+W;
+
+    const vector<int>& vKernel=GetBlurKernel();
+    const int* k=&vKernel[0];
+
+    //预先计算每一列在上一层图像中的插值位置和系数
+    const double scaleX=(double)src.cols/W,scaleY=(double)src.rows/H;
+    if(bResize)
+    {
+        for (int x = 0; x < W; ++x)
+        {
+            float fx=(float)((x+0.5)*scaleX-0.5);
+            int sx=cvFloor(fx);
+            fx-=sx;
+            if(sx<0)
+            {
+                sx=0;
+                fx=0;
+            }
+            if(sx>=src.cols-1)
+            {
+                sx=src.cols-1;
+                fx=0;
+            }
+            xofs0[x]=sx;
+            xofs1[x]=std::min(sx+1,src.cols-1);
+            xalpha[x]=cvRound(fx*2048);
+        }
+    }
+
+    //竖直方向模糊并输出一行，行号按BORDER_REFLECT_101在带边界的图像内部反射
+    auto blurRow=[&](const int &o){
+        const int* rows[7];
+        for (int i = 0; i < 7; ++i)
+        {
+            rows[i]=ring+(Reflect101(o+i-3,R)&7)*C;
+        }
+        uchar* out=blurBorder.ptr(o);
+        for (int c = 0; c < C; ++c)
+        {
+            int sum=k[0]*rows[0][c]+k[1]*rows[1][c]+k[2]*rows[2][c]+k[3]*rows[3][c]
+                   +k[4]*rows[4][c]+k[5]*rows[5][c]+k[6]*rows[6][c];
+            out[c]=(uchar)((sum+(1<<(2*BLUR_BITS-1)))>>(2*BLUR_BITS));
+        }
+    };
+
+    for (int r = 0; r < R; ++r)
+    {
+        uchar* dst=border.ptr(r);
+        uchar* inner=dst+E;
+        //带边界图像的第r行对应本层图像中的第y行
+        const int y=Reflect101(r-E,H);
+
+        if(bResize)
+        {
+            float fy=(float)((y+0.5)*scaleY-0.5);
+            int sy=cvFloor(fy);
+            fy-=sy;
+            if(sy<0)
+            {
+                sy=0;
+                fy=0;
+            }
+            if(sy>=src.rows-1)
+            {
+                sy=src.rows-1;
+                fy=0;
+            }
+            const uchar* S0=src.ptr(sy);
+            const uchar* S1=src.ptr(std::min(sy+1,src.rows-1));
+            const int beta=cvRound(fy*2048);
+            for (int x = 0; x < W; ++x)
+            {
+                int t0=S0[xofs0[x]]*(2048-xalpha[x])+S0[xofs1[x]]*xalpha[x];
+                int t1=S1[xofs0[x]]*(2048-xalpha[x])+S1[xofs1[x]]*xalpha[x];
+                inner[x]=(uchar)((t0*(2048-beta)+t1*beta+(1<<21))>>22);
+            }
+        }
+        else
+        {
+            memcpy(inner,src.ptr(y),W);
+        }
+
+        //补齐左右边界
+        for (int i = 1; i <= E; ++i)
+        {
+            inner[-i]=inner[i];
+            inner[W-1+i]=inner[W-1-i];
+        }
+
+        //水平方向模糊，边界处的3列按BORDER_REFLECT_101反射
+        int* h=ring+(r&7)*C;
+        for (int c = 0; c < 3; ++c)
+        {
+            int sum=0;
+            for (int i = -3; i <= 3; ++i)
+                sum+=k[i+3]*dst[Reflect101(c+i,C)];
+            h[c]=sum;
+        }
+        for (int c = 3; c < C-3; ++c)
+        {
+            h[c]=k[0]*dst[c-3]+k[1]*dst[c-2]+k[2]*dst[c-1]+k[3]*dst[c]
+                +k[4]*dst[c+1]+k[5]*dst[c+2]+k[6]*dst[c+3];
+        }
+        for (int c = C-3; c < C; ++c)
+        {
+            int sum=0;
+            for (int i = -3; i <= 3; ++i)
+                sum+=k[i+3]*dst[Reflect101(c+i,C)];
+            h[c]=sum;
+        }
+
+        //第r-3行需要的第r-6到第r行都已经在环形缓存中了
+        if(r>=3)
+            blurRow(r-3);
+    }
+
+    //最后3行
+    for (int o = std::max(R-3,0); o < R; ++o)
+    {
+        blurRow(o);
+    }
+
+}//BuildFusedLevel
+
+//稀疏模糊时分块的边长
+const int BLUR_TILE=32;
+
+//水平方向模糊一行：dst[c]=sum(k[i]*src[c+i-3])，要求src[-3]到src[n+2]都可以访问
+typedef void (*BlurRowHKernel)(const uchar* src,int* dst,const int &n,const int* k);
+//竖直方向模糊一行：dst[c]=(sum(k[i]*rows[i][c])+舍入)>>(2*BLUR_BITS)
+typedef void (*BlurRowVKernel)(const int* const* rows,uchar* dst,const int &n,const int* k);
+
+static void blurRowHScalar(const uchar* src,int* dst,const int &n,const int* k)
+{
+    for (int c = 0; c < n; ++c)
+    {
+        dst[c]=k[0]*src[c-3]+k[1]*src[c-2]+k[2]*src[c-1]+k[3]*src[c]
+              +k[4]*src[c+1]+k[5]*src[c+2]+k[6]*src[c+3];
+    }
+}
+
+static void blurRowVScalar(const int* const* rows,uchar* dst,const int &n,const int* k)
+{
+    for (int c = 0; c < n; ++c)
+    {
+        int sum=k[0]*rows[0][c]+k[1]*rows[1][c]+k[2]*rows[2][c]+k[3]*rows[3][c]
+               +k[4]*rows[4][c]+k[5]*rows[5][c]+k[6]*rows[6][c];
+        dst[c]=(uchar)((sum+(1<<(2*BLUR_BITS-1)))>>(2*BLUR_BITS));
+    }
+}
+
+#if defined(ORB_SIMD_X86)
 
-    //调整容器的大小为要提取的特征点数目
-    vResultKeys.reserve(nfeatures);
+//AVX2版本，一次处理8个像素，每个像素扩展成32位整数后乘加
+__attribute__((target("avx2")))
+static void blurRowHAVX2(const uchar* src,int* dst,const int &n,const int* k)
+{
+    __m256i vk[7];
+    for (int i = 0; i < 7; ++i)
+        vk[i]=_mm256_set1_epi32(k[i]);
 
-    for (list<ExtractorNode>::iterator  lit = lNodes.begin(); lit !=lNodes.end(); lit++)
+    int c=0;
+    for (; c+8 <= n; c+=8)
     {
-        vector<cv::KeyPoint> &vNodeKeys=lit->vKeys;
-        cv::KeyPoint* pKP=&vNodeKeys[0];
-        float maxResponse=pKP->response;
-        for(int i=1;i<vNodeKeys.size();i++){
-            if (vNodeKeys[i].response>maxResponse)
-            {
-                pKP=&vNodeKeys[i];
-                maxResponse=vNodeKeys[i].response;
-            }
-            
+        __m256i sum=_mm256_setzero_si256();
+        for (int i = 0; i < 7; ++i)
+        {
+            __m256i p=_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src+c+i-3)));
+            sum=_mm256_add_epi32(sum,_mm256_mullo_epi32(p,vk[i]));
         }
-        
-        vResultKeys.push_back(*pKP);
-        
+        _mm256_storeu_si256((__m256i*)(dst+c),sum);
     }
-    return vResultKeys;
-    
-
+    blurRowHScalar(src+c,dst+c,n-c,k);
+}
 
+__attribute__((target("avx2")))
+static void blurRowVAVX2(const int* const* rows,uchar* dst,const int &n,const int* k)
+{
+    __m256i vk[7];
+    for (int i = 0; i < 7; ++i)
+        vk[i]=_mm256_set1_epi32(k[i]);
+    const __m256i round=_mm256_set1_epi32(1<<(2*BLUR_BITS-1));
 
+    int c=0;
+    for (; c+8 <= n; c+=8)
+    {
+        __m256i sum=round;
+        for (int i = 0; i < 7; ++i)
+        {
+            sum=_mm256_add_epi32(sum,_mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(rows[i]+c)),vk[i]));
+        }
+        sum=_mm256_srli_epi32(sum,2*BLUR_BITS);
+        __m128i p16=_mm_packus_epi32(_mm256_castsi256_si128(sum),_mm256_extracti128_si256(sum,1));
+        _mm_storel_epi64((__m128i*)(dst+c),_mm_packus_epi16(p16,p16));
+    }
+    const int* tail[7];
+    for (int i = 0; i < 7; ++i)
+        tail[i]=rows[i]+c;
+    blurRowVScalar(tail,dst+c,n-c,k);
+}
 
-}//ORBextractor::DistributeOctTree
+#elif defined(ORB_SIMD_NEON)
 
-//计算四叉树的特征点，函数名字后的octtree只是说明在过滤和分配特征点的时候使用的方式
-void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint>>& allkeypoints){
+//NEON版本，一次处理8个像素
+static void blurRowHNEON(const uchar* src,int* dst,const int &n,const int* k)
+{
+    int c=0;
+    for (; c+8 <= n; c+=8)
+    {
+        int32x4_t lo=vdupq_n_s32(0),hi=vdupq_n_s32(0);
+        for (int i = 0; i < 7; ++i)
+        {
+            uint16x8_t p=vmovl_u8(vld1_u8(src+c+i-3));
+            lo=vmlaq_n_s32(lo,vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(p))),k[i]);
+            hi=vmlaq_n_s32(hi,vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(p))),k[i]);
+        }
+        vst1q_s32(dst+c,lo);
+        vst1q_s32(dst+c+4,hi);
+    }
+    blurRowHScalar(src+c,dst+c,n-c,k);
+}
 
+static void blurRowVNEON(const int* const* rows,uchar* dst,const int &n,const int* k)
+{
+    int c=0;
+    for (; c+8 <= n; c+=8)
+    {
+        int32x4_t lo=vdupq_n_s32(1<<(2*BLUR_BITS-1)),hi=lo;
+        for (int i = 0; i < 7; ++i)
+        {
+            lo=vmlaq_n_s32(lo,vld1q_s32(rows[i]+c),k[i]);
+            hi=vmlaq_n_s32(hi,vld1q_s32(rows[i]+c+4),k[i]);
+        }
+        uint16x8_t p16=vcombine_u16(vqmovun_s32(vshrq_n_s32(lo,2*BLUR_BITS)),vqmovun_s32(vshrq_n_s32(hi,2*BLUR_BITS)));
+        vst1_u8(dst+c,vqmovn_u16(p16));
+    }
+    const int* tail[7];
+    for (int i = 0; i < 7; ++i)
+        tail[i]=rows[i]+c;
+    blurRowVScalar(tail,dst+c,n-c,k);
+}
 
-}//ORBextractor::ComputeKeyPointsOctTree
+#endif
 
+static BlurRowHKernel SelectBlurRowHKernel()
+{
+#if defined(ORB_SIMD_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return blurRowHAVX2;
+#elif defined(ORB_SIMD_NEON)
+    return blurRowHNEON;
+#endif
+    return blurRowHScalar;
+}
 
-//这个函数已经弃用了
-void ORBextractor::ComputeKeyPOintsold(vector<vector<KeyPoint>>& allkeypoints){
+static BlurRowVKernel SelectBlurRowVKernel()
+{
+#if defined(ORB_SIMD_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return blurRowVAVX2;
+#elif defined(ORB_SIMD_NEON)
+    return blurRowVNEON;
+#endif
+    return blurRowVScalar;
+}
 
-}//ORBextractor::ComputeKeyPOintsold
+static const BlurRowHKernel gBlurRowHKernel=SelectBlurRowHKernel();
+static const BlurRowVKernel gBlurRowVKernel=SelectBlurRowVKernel();
 
-//注意这是一个不属于任何类的全局静态函数，static修饰符限定只能够被本文件中的函数调用
 /**
- * @brief 计算某层金字塔上特征点的描述子
-*/
-static void computeDescriptors(const cv::Mat& image,vector<KeyPoint>& KeyPoints,cv::Mat& descriptors,const vector<cv::Point>& pattern)
+ * @brief 只模糊计算描述子时会用到的区域
+ * @details 把带边界的图像分成BLUR_TILE x BLUR_TILE的块，只有和某个特征点周围EDGE_THRESHOLD半径（描述子采样点旋转后的最大范围）
+ * 相交的块才进行模糊。每块先对上下各多3行做水平方向的模糊，再做竖直方向的模糊，中间结果放在栈上，不需要额外的内存。
+ * 定点系数和舍入方式和融合的金字塔构建相同，所以结果和BuildFusedLevel得到的模糊图像完全一致，和GaussianBlur可能有±1的差别
+ * @param[in] border 本层带边界的图像
+ * @param[out] blurBorder 本层带边界的模糊图像，只有特征点附近的区域被写入
+ * @param[in] keypoints 本层的特征点，坐标是本层不带边界图像中的坐标
+ * @param[in] vTiles 标记需要模糊的块的缓存
+ */
+static void BlurKeyPointRegions(const Mat &border,Mat &blurBorder,const vector<KeyPoint> &keypoints,vector<uchar> &vTiles)
 {
-    descriptors=cv::Mat::zeros((int)KeyPoints.size(),32,CV_8UC1);
-    for (size_t i = 0; i < KeyPoints.size(); i++)
+    const int E=EDGE_THRESHOLD;
+    const int R=border.rows,C=border.cols;
+    const int nTilesX=(C+BLUR_TILE-1)/BLUR_TILE;
+    const int nTilesY=(R+BLUR_TILE-1)/BLUR_TILE;
+
+    //标记每个特征点周围的描述子采样区域所覆盖的块
+    vTiles.assign(nTilesX*nTilesY,0);
+    for (size_t i = 0; i < keypoints.size(); ++i)
     {
-        computerOrbDescriptor(KeyPoints[i],
-                            image,
-                            &pattern[0],//随机点集的首地址
-                            descriptors.ptr((int) i));//取出来的描述子保存的位置
+        const int x=cvRound(keypoints[i].pt.x)+E;
+        const int y=cvRound(keypoints[i].pt.y)+E;
+        const int tx0=std::max(x-E,0)/BLUR_TILE,tx1=std::min(x+E,C-1)/BLUR_TILE;
+        const int ty0=std::max(y-E,0)/BLUR_TILE,ty1=std::min(y+E,R-1)/BLUR_TILE;
+        for (int ty = ty0; ty <= ty1; ++ty)
+            for (int tx = tx0; tx <= tx1; ++tx)
+                vTiles[ty*nTilesX+tx]=1;
     }
 
-}//computeDescriptors
+    const int* k=&GetBlurKernel()[0];
+
+    //水平方向模糊的中间结果，块的上下各多3行
+    int h[(BLUR_TILE+6)*BLUR_TILE];
+    //补齐了左右各3个像素的一行
+    uchar line[BLUR_TILE+6];
+
+    for (int ty = 0; ty < nTilesY; ++ty)
+    {
+        const int y0=ty*BLUR_TILE,y1=std::min(y0+BLUR_TILE,R);
+        for (int tx = 0; tx < nTilesX; ++tx)
+        {
+            if(!vTiles[ty*nTilesX+tx])
+                continue;
+
+            const int x0=tx*BLUR_TILE,x1=std::min(x0+BLUR_TILE,C);
+            const int tw=x1-x0;
+            const bool bInside=x0>=3 && x1+3<=C;
+
+            //水平方向，超出带边界图像的行和列按BORDER_REFLECT_101反射，和GaussianBlur中BORDER_ISOLATED的效果相同
+            for (int r = y0-3; r < y1+3; ++r)
+            {
+                const uchar* src=border.ptr(Reflect101(r,R));
+                const uchar* p;
+                if(bInside)
+                {
+                    p=src+x0;
+                }
+                else
+                {
+                    for (int j = -3; j < tw+3; ++j)
+                        line[j+3]=src[Reflect101(x0+j,C)];
+                    p=line+3;
+                }
+                gBlurRowHKernel(p,h+(r-y0+3)*BLUR_TILE,tw,k);
+            }
+
+            //竖直方向
+            for (int o = y0; o < y1; ++o)
+            {
+                const int* rows[7];
+                for (int i = 0; i < 7; ++i)
+                    rows[i]=h+(o-y0+i)*BLUR_TILE;
+                gBlurRowVKernel(rows,blurBorder.ptr(o)+x0,tw,k);
+            }
+        }
+    }
 
+}//BlurKeyPointRegions
 
 /**
  * @brief 仿函数
@@ -919,16 +2764,210 @@ void ORBextractor::operator()(cv::InputArray _image,cv::InputArray _mask,std::ve
     assert(image.type()==CV_8UC1);
 
     //step2 构建图像的金子塔
-    ComputerPyramid(image);
+    BeginFrame(image,_mask.getMat());
 
     //step3 计算图像的特征点，并将特征点进行均匀化。均匀的特征点可以提高位姿计算精度
-    //存储所有的节点，此处为二维的vector，第一位存储的是金字塔的层数，第二层存储的是第一层金字塔里边提取到的所有特征点
-    vector<vector<cv::KeyPoint>> allkeypoins;
     //使用四叉树的方式计算每层图像的特征点进行分配
-    ComputeKeyPointsOctTree(allkeypoins);
+    ComputeKeyPointsOctTree(mvvKeypoints);
 
-    //step4拷贝图像描述子到新的矩阵descriptors
-    Mat descriptors;
+    //step4 创建描述子矩阵
+    PrepareDescriptors(_descriptors);
+
+    //step5、6 开始遍历每一层图像，各层之间相互独立
+    RunParallel(nlevels,[this](int level){
+        ComputeDescriptorsLevel(level);
+    });
+
+    //输出特征点
+    CollectKeyPoints(_keypoints);
+
+    EndFrame();
+
+}
+
+void ORBextractor::operator()(cv::InputArray _image,cv::InputArray _mask,ORBFeatures &features){
+    if(_image.empty()){
+        features.Resize(0);
+        return;
+    }
+
+    Mat image =_image.getMat();
+    assert(image.type()==CV_8UC1);
+
+    BeginFrame(image,_mask.getMat());
+
+    ComputeKeyPointsOctTree(mvvKeypoints);
+
+    //按特征点总数准备好结构数组，描述子矩阵直接使用结构数组中的描述子内存
+    int nkeypoints=0;
+    for (int level = 0; level < nlevels; ++level)
+    {
+        nkeypoints+=(int)mvvKeypoints[level].size();
+    }
+    features.Resize(nkeypoints,mnDescriptorBytes);
+    Mat descriptors=features.GetDescriptors();
+    PrepareDescriptors(descriptors);
+
+    //各层计算完描述子之后，把特征点写到结构数组中本层的那一段
+    RunParallel(nlevels,[this,&features](int level){
+        ComputeDescriptorsLevel(level);
+        CollectKeyPointsLevel(level,features);
+    });
+
+    EndFrame();
+
+}
+
+void ORBextractor::ExtractBatch(const std::vector<ORBextractor*> &vpExtractors,const std::vector<cv::Mat> &vImages,
+                                std::vector<std::vector<cv::KeyPoint> > &vvKeypoints,std::vector<cv::Mat> &vDescriptors,
+                                ThreadPool* pThreadPool,const std::vector<cv::Mat> &vMasks)
+{
+    const int N=(int)vImages.size();
+    assert((int)vpExtractors.size()==N);
+    assert(vMasks.empty() || (int)vMasks.size()==N);
+    //每幅图像的缓存和中间结果都在自己的提取器中，同一个提取器出现两次时两幅图像的任务会同时写同一块缓存
+    for (int i = 0; i < N; ++i)
+        assert(std::find(vpExtractors.begin()+i+1,vpExtractors.end(),vpExtractors[i])==vpExtractors.end());
+
+    vvKeypoints.resize(N);
+    vDescriptors.resize(N);
+
+    //任务的执行方式：有线程池时并行，否则串行
+    std::function<void(int,const std::function<void(int)>&)> run=[pThreadPool](int n,const std::function<void(int)> &f){
+        if(pThreadPool)
+            pThreadPool->ParallelFor(n,f);
+        else
+            for (int i = 0; i < n; ++i)
+                f(i);
+    };
+
+    //空图像不参与提取，和单独调用时一样直接返回空的结果
+    vector<int> vValid;
+    vValid.reserve(N);
+    for (int i = 0; i < N; ++i)
+    {
+        if(vImages[i].empty())
+        {
+            vvKeypoints[i].clear();
+            vDescriptors[i].release();
+            continue;
+        }
+        assert(vImages[i].type()==CV_8UC1);
+        vValid.push_back(i);
+    }
+    const int nValid=(int)vValid.size();
+    if(nValid==0)
+        return;
+
+    //第一步：每幅图像构建自己的金字塔（各层之间有依赖，所以一幅图像是一个任务）
+    run(nValid,[&](int k){
+        vpExtractors[vValid[k]]->BeginFrame(vImages[vValid[k]],vMasks.empty()? cv::Mat() : vMasks[vValid[k]]);
+    });
+
+    //把各幅图像的任务编号拼接成一个连续的编号空间，vStart[k]是第k幅图像的第一个任务
+    vector<int> vStart(nValid+1);
+    //任务编号对应的图像
+    auto imageOf=[&vStart](int task){
+        return (int)(std::upper_bound(vStart.begin(),vStart.end(),task)-vStart.begin())-1;
+    };
+
+    //第二步：所有图像所有层的所有网格一起检测FAST角点
+    vStart[0]=0;
+    for (int k = 0; k < nValid; ++k)
+        vStart[k+1]=vStart[k]+(int)vpExtractors[vValid[k]]->mvCellLevel.size();
+    run(vStart[nValid],[&](int task){
+        const int k=imageOf(task);
+        ORBextractor* pExtractor=vpExtractors[vValid[k]];
+        const int cell=task-vStart[k];
+        pExtractor->ComputeCellKeyPoints(pExtractor->mvCellLevel[cell],cell);
+    });
+
+    for (int k = 0; k < nValid; ++k)
+        vpExtractors[vValid[k]]->ComputeMaskedFeaturesPerLevel();
+
+    //第三步：所有图像的所有层一起分配特征点并计算方向
+    for (int k = 0; k < nValid; ++k)
+        vStart[k+1]=vStart[k]+vpExtractors[vValid[k]]->nlevels;
+    run(vStart[nValid],[&](int task){
+        const int k=imageOf(task);
+        ORBextractor* pExtractor=vpExtractors[vValid[k]];
+        const int level=task-vStart[k];
+        pExtractor->ComputeKeyPointsOctTreeLevel(level,pExtractor->mvvKeypoints[level]);
+    });
+
+    //创建各幅图像的描述子矩阵
+    for (int k = 0; k < nValid; ++k)
+        vpExtractors[vValid[k]]->PrepareDescriptors(vDescriptors[vValid[k]]);
+
+    //第四步：所有图像的所有层一起模糊并计算描述子，层数和第三步相同
+    run(vStart[nValid],[&](int task){
+        const int k=imageOf(task);
+        vpExtractors[vValid[k]]->ComputeDescriptorsLevel(task-vStart[k]);
+    });
+
+    for (int k = 0; k < nValid; ++k)
+    {
+        vpExtractors[vValid[k]]->CollectKeyPoints(vvKeypoints[vValid[k]]);
+        vpExtractors[vValid[k]]->EndFrame();
+    }
+}
+
+/**
+ * @brief 开始处理一帧：清零本帧的统计，构建图像金字塔和掩码金字塔
+ * @param[in] image 单通道灰度图像
+ * @param[in] mask 和image同样大小的单通道掩码，非0的像素可以提取特征点，为空时不使用掩码
+*/
+void ORBextractor::BeginFrame(const cv::Mat &image,const cv::Mat &mask){
+
+    //本帧中内部缓存的分配次数清零
+    mnFrameAllocations=0;
+    ++mnFrameId;
+
+    //开启了时间预算模式或者耗时统计时，记录各阶段的耗时
+    mbMeasureTime=mbProfiling || mdTimeBudget>0;
+    if(mbMeasureTime)
+    {
+        mtFrameStart=std::chrono::steady_clock::now();
+        std::fill(mvBlurTime.begin(),mvBlurTime.end(),0.0);
+        std::fill(mvDescriptorTime.begin(),mvDescriptorTime.end(),0.0);
+    }
+
+    //构建图像的金子塔
+    ComputerPyramid(image);
+
+    //掩码金字塔：每层都直接从原始掩码按最近邻缩放，避免逐层缩放时误差累积
+    mbMaskActive=!mask.empty();
+    if(mbMaskActive)
+    {
+        assert(mask.type()==CV_8UC1 && mask.size()==image.size());
+        for (int level = 0; level < nlevels; ++level)
+        {
+            const uchar* data=mvMaskPyramid[level].data;
+            if(level==0)
+                mask.copyTo(mvMaskPyramid[level]);
+            else
+                resize(mask,mvMaskPyramid[level],mvImagePyramid[level].size(),0,0,INTER_NEAREST);
+            if(mvMaskPyramid[level].data!=data)
+                ++mnFrameAllocations;
+        }
+    }
+
+    if(mbMeasureTime)
+        mdPyramidTime=ElapsedTime(mtFrameStart);
+
+    //存储所有的节点，此处为二维的vector，第一位存储的是金字塔的层数，第二层存储的是第一层金字塔里边提取到的所有特征点
+    //这里使用的是跨帧复用的成员变量，容量足够时不会再分配内存。记录提取前所有复用容器的容量，在EndFrame中判断本帧是否分配了内存
+    TrackBufferCapacities(true);
+
+}//ORBextractor::BeginFrame
+
+/**
+ * @brief 特征点提取完成后，创建存放整个金字塔描述子的矩阵，并计算每层描述子的起始行
+ * @param[out] _descriptors 描述子矩阵
+*/
+void ORBextractor::PrepareDescriptors(cv::OutputArray _descriptors){
+
+    vector<vector<cv::KeyPoint>>& allkeypoins=mvvKeypoints;
 
     //统计整个图像金子塔的特征点
     int nkeypoints=0;
@@ -942,14 +2981,107 @@ void ORBextractor::operator()(cv::InputArray _image,cv::InputArray _mask,std::ve
     //如果本图像金字塔中没有任何的特征点
     if(nkeypoints==0){
         _descriptors.release();
+        mDescriptors.release();
     }else{
         //如果图像金子塔中有特征点，那么就是创建这个存储描述子的矩阵，注意这个矩阵是存储整个图像金字塔中特征点的描述子
         _descriptors.create(nkeypoints,//
-        32,//矩阵的列数，对应为使用32*8=256位描述子
+        mnDescriptorBytes,//矩阵的列数，默认为32，对应为使用32*8=256位描述子
         CV_8U);//矩阵元素的格式
-        //获取这个描述子的矩阵信息
-        //
-        descriptors=_descriptors.getMat();
+        //获取这个描述子的矩阵信息，各层计算描述子时写到它的不同行中
+        mDescriptors=_descriptors.getMat();
+    }
+
+    //因为遍历是一层一层进行的，但是描述子那个矩阵存储的是整个图像金字塔中特征点的描述子，所以在这里设置offset变量来保存"寻址”时的偏移量
+    //辅助进行在描述子中mat定位。这里预先算出每层的偏移量，这样各层就可以独立（并行）地写入自己的那几行描述子
+    vector<int>& vOffsets=mvLevelRowOffsets;
+    vOffsets[0]=0;
+    for (int level = 1; level < nlevels; ++level)
+    {
+        vOffsets[level]=vOffsets[level-1]+(int)allkeypoins[level-1].size();
+    }
+
+}//ORBextractor::PrepareDescriptors
+
+/**
+ * @brief 对某一层图像进行高斯模糊，计算该层特征点的描述子，并把特征点坐标恢复到第0层，各层之间可以并行调用
+ * @param[in] level 金字塔层
+*/
+void ORBextractor::ComputeDescriptorsLevel(const int &level){
+
+    //获取在allkeypoints中当前成本法特征点容器的句柄
+    vector<KeyPoint>& keypoints=mvvKeypoints[level];
+    //本层的特征点数
+    int nkeypointsLevel=(int)keypoints.size();
+
+    //如果特征点数目为0，跳出本次循环，继续下一层金字塔
+    if(nkeypointsLevel==0){
+        return;
+    }
+    //step5 对图像进行高斯模糊。如果使用了融合的金字塔构建，模糊图像已经在构建金字塔时得到了
+    //注意：提取特征点的时候，使用的是清晰的图像；这里计算描述子的时候，为了避免图像噪声的影响，使用了搞死模糊
+    //模糊的是整个带边界的图像，结果写到预先分配的缓存中，不再深拷贝。因为边界是本层图像的镜像，
+    //所以本层图像区域内的结果和单独拷贝出来再模糊是一样的；BORDER_ISOLATED避免读到缓存中相邻层的数据
+    Mat workingMat = mvBlurPyramid[level];
+    //默认只模糊特征点附近会被描述子采样到的区域；精确方式下和原来一样用GaussianBlur模糊整层图像
+    std::chrono::steady_clock::time_point t1;
+    if(mbMeasureTime)
+        t1=std::chrono::steady_clock::now();
+    if(!mbFusedPyramid)
+    {
+        if(mbExactDescriptors)
+            GaussianBlur(mvPyramidBorder[level],//源图像
+            mvBlurPyramidBorder[level],//输出出图像
+            Size(7,7),2,2,BORDER_REFLECT_101+BORDER_ISOLATED);
+        else
+            BlurKeyPointRegions(mvPyramidBorder[level],mvBlurPyramidBorder[level],keypoints,mvvBlurTiles[level]);
+        if(mbMeasureTime)
+            mvBlurTime[level]=ElapsedTime(t1);
+    }
+
+    //计算描述子
+    //desc存储当前图层的描述子
+    Mat desc=mDescriptors.rowRange(mvLevelRowOffsets[level],mvLevelRowOffsets[level]+nkeypointsLevel);
+
+    //step6 计算高斯模糊之后的图像的描述子
+    std::chrono::steady_clock::time_point t2;
+    if(mbMeasureTime)
+        t2=std::chrono::steady_clock::now();
+    if(mbExactDescriptors)
+        mpfnDescriptors(workingMat,keypoints,desc);
+    else
+        mpfnDescriptorsLUT(workingMat,keypoints,desc,*mpPatternOffsets);
+    if(mbMeasureTime)
+        mvDescriptorTime[level]=ElapsedTime(t2);
+
+    // Scale keypoint coordinates
+    // Step 6 对非第0层图像中的特征点的坐标恢复到第0层图像（原图像）的坐标系下
+    // ? 得到所有层特征点在第0层里的坐标放到_keypoints里面
+    // 对于第0层的图像特征点，他们的坐标就不需要再进行恢复了
+    if (level != 0)
+    {
+        // 获取当前图层上的缩放系数
+        float scale = mvScaleFactor[level];
+        // 遍历本层所有的特征点
+        for (vector<KeyPoint>::iterator keypoint = keypoints.begin(),
+             keypointEnd = keypoints.end(); keypoint != keypointEnd; ++keypoint)
+            // 特征点本身直接乘缩放倍数就可以了
+            keypoint->pt *= scale;
+    }
+
+}//ORBextractor::ComputeDescriptorsLevel
+
+/**
+ * @brief 按层的顺序输出特征点
+ * @param[out] _keypoints 输出的特征点，和描述子矩阵的行一一对应
+*/
+void ORBextractor::CollectKeyPoints(std::vector<cv::KeyPoint> &_keypoints){
+
+    vector<vector<cv::KeyPoint>>& allkeypoins=mvvKeypoints;
+
+    int nkeypoints=0;
+    for (int level = 0; level < nlevels; ++level)
+    {
+        nkeypoints+=(int)allkeypoins[level].size();
     }
 
     //清空用作返回特征点提取结果的vector容器
@@ -957,94 +3089,300 @@ void ORBextractor::operator()(cv::InputArray _image,cv::InputArray _mask,std::ve
     //并预分配正确大小的空间
     _keypoints.reserve(nkeypoints);
 
-    //因为遍历是一层一层进行的，但是描述子那个矩阵存储的是整个图像金字塔中特征点的描述子，所以在这里设置offset变量来保存"寻址”时的偏移量
-    //辅助进行在描述子中mat定位
-    int offset=0;
-    //开始遍历每一层图像
+    // And add the keypoints to the output
+    // 将keypoints中内容按层的顺序插入到_keypoints 的末尾，保证和描述子的行一一对应
+    // allkeypoints中的所有特征点在这里被转存到输出的_keypoints
     for (int level = 0; level < nlevels; ++level)
     {
-        //获取在allkeypoints中当前成本法特征点容器的句柄
-        vector<KeyPoint>& keypoints=allkeypoins[level];
-        //本层的特征点数
-        int nkeypointsLevel=(int)keypoints.size();
+        _keypoints.insert(_keypoints.end(), allkeypoins[level].begin(), allkeypoins[level].end());
+    }
 
-        //如果特征点数目为0，跳出本次循环，继续下一层金字塔
-        if(nkeypointsLevel==0){
-            continue;
+}//ORBextractor::CollectKeyPoints
+
+/**
+ * @brief 把某一层的特征点写到结构数组中，起始位置和该层描述子的起始行相同
+ * @param[in] level 金字塔层
+ * @param[out] features 输出的结构数组，已经按特征点总数调整好大小
+*/
+void ORBextractor::CollectKeyPointsLevel(const int &level,ORBFeatures &features){
+
+    const vector<KeyPoint> &keypoints=mvvKeypoints[level];
+    const int offset=mvLevelRowOffsets[level];
+
+    for (size_t i = 0; i < keypoints.size(); ++i)
+    {
+        const KeyPoint &kp=keypoints[i];
+        features.x[offset+i]=kp.pt.x;
+        features.y[offset+i]=kp.pt.y;
+        features.angle[offset+i]=kp.angle;
+        features.response[offset+i]=kp.response;
+        features.octave[offset+i]=kp.octave;
+    }
+
+}//ORBextractor::CollectKeyPointsLevel
+
+/**
+ * @brief 结束一帧：更新统计和时间预算
+*/
+void ORBextractor::EndFrame(){
+
+    vector<vector<cv::KeyPoint>>& allkeypoins=mvvKeypoints;
+
+    //不再需要访问描述子矩阵，释放对它的引用
+    mDescriptors.release();
+
+    //各个阶段都已经结束，统计复用的容器中有多少个在本帧重新分配了内存
+    mnFrameAllocations+=TrackBufferCapacities(false);
+
+    int nkeypoints=0;
+    for (int level = 0; level < nlevels; ++level)
+    {
+        nkeypoints+=(int)allkeypoins[level].size();
+    }
+
+    mnTotalAllocations+=mnFrameAllocations;
+
+    if(mbMeasureTime)
+    {
+        mdFrameTime=ElapsedTime(mtFrameStart);
+
+#ifdef ORB_PROFILING
+        //写入本帧各阶段的耗时统计
+        if(mbProfiling)
+        {
+            mProfiler.Push(mnFrameId,ORBprofiler::STAGE_PYRAMID,-1,-1,mdPyramidTime);
+            for (int level = 0; level < nlevels; ++level)
+            {
+                const int nKeysLevel=(int)allkeypoins[level].size();
+                mProfiler.Push(mnFrameId,ORBprofiler::STAGE_DETECT,level,mvnDetectedKeys[level],mvDetectTime[level]);
+                mProfiler.Push(mnFrameId,ORBprofiler::STAGE_DISTRIBUTE,level,nKeysLevel,mvDistributionTime[level]);
+                mProfiler.Push(mnFrameId,ORBprofiler::STAGE_ORIENTATION,level,nKeysLevel,mvOrientationTime[level]);
+                mProfiler.Push(mnFrameId,ORBprofiler::STAGE_BLUR,level,-1,mvBlurTime[level]);
+                mProfiler.Push(mnFrameId,ORBprofiler::STAGE_DESCRIPTOR,level,nKeysLevel,mvDescriptorTime[level]);
+            }
+            mProfiler.Push(mnFrameId,ORBprofiler::STAGE_TOTAL,-1,nkeypoints,mdFrameTime);
+        }
+#endif
+
+        //根据本帧的耗时调整下一帧的特征点数目和FAST阈值
+        if(mdTimeBudget>0)
+            UpdateBudget(nkeypoints);
+    }
+
+}//ORBextractor::EndFrame
+
+/**
+ * @brief 按固定的顺序遍历所有跨帧复用的容器，记录或者比较它们的容量
+ * @details 容器的个数只在网格划分变化（图像尺寸变化）时才会改变，而网格只在BeginFrame中构建金字塔时重新划分，
+ * 所以同一帧中记录和比较时遍历到的容器是一一对应的
+ * @param[in] bRecord 为true时记录当前的容量，为false时和记录的容量比较
+ * @return 比较时容量发生变化的容器个数
+*/
+int ORBextractor::TrackBufferCapacities(const bool &bRecord){
+
+    int nChanged=0;
+    size_t i=0;
+    const size_t tableCapacity=mvBufferCapacity.capacity();
+    auto track=[this,&bRecord,&nChanged,&i](const size_t &capacity){
+        if(bRecord)
+        {
+            if(i<mvBufferCapacity.size())
+                mvBufferCapacity[i]=capacity;
+            else
+                mvBufferCapacity.push_back(capacity);
         }
-        //step5 对图像进行高斯模糊
-        //深拷贝当前金子塔所在层级的图像
-        Mat workingMat = mvImagePyramid[level].clone();
-
-        //注意：提取特征点的时候，使用的是清晰的图像；这里计算描述子的时候，为了避免图像噪声的影响，使用了搞死模糊
-        GaussianBlur(workingMat,//源图像
-        workingMat,//输出出图像
-        Size(7,7),2,2,BORDER_REFLECT_101);
-
-        //计算描述子
-        //desc存储当前图层的描述子
-        Mat desc=descriptors.rowRange(offset,offset+nkeypointsLevel);
-
-        //step6 计算高斯模糊之后的图像的描述子
-        computeDescriptors(workingMat,keypoints,desc,pattern);
-
-        // 更新偏移量的值 
-        offset += nkeypointsLevel;
-
-        // Scale keypoint coordinates
-		// Step 6 对非第0层图像中的特征点的坐标恢复到第0层图像（原图像）的坐标系下
-        // ? 得到所有层特征点在第0层里的坐标放到_keypoints里面
-		// 对于第0层的图像特征点，他们的坐标就不需要再进行恢复了
-        if (level != 0)
+        else if(mvBufferCapacity[i]!=capacity)
         {
-			// 获取当前图层上的缩放系数
-            float scale = mvScaleFactor[level];
-            // 遍历本层所有的特征点
-            for (vector<KeyPoint>::iterator keypoint = keypoints.begin(),
-                 keypointEnd = keypoints.end(); keypoint != keypointEnd; ++keypoint)
-				// 特征点本身直接乘缩放倍数就可以了
-                keypoint->pt *= scale;
+            ++nChanged;
         }
-        
-        // And add the keypoints to the output
-        // 将keypoints中内容插入到_keypoints 的末尾
-        // keypoint其实是对allkeypoints中每层图像中特征点的引用，这样allkeypoints中的所有特征点在这里被转存到输出的_keypoints
-        _keypoints.insert(_keypoints.end(), keypoints.begin(), keypoints.end());
+        ++i;
+    };
 
+    for (int level = 0; level < nlevels; ++level)
+    {
+        track(mvvKeypoints[level].capacity());
+        track(mvvBlurTiles[level].capacity());
+        track(mvvToDistributeKeys[level].capacity());
+        track(mvvHarrisBuffers[level].capacity());
+    }
 
+    //分配特征点时四叉树的节点和索引
+    for (int level = 0; level < nlevels; ++level)
+    {
+        const DistributionBuffer &buffer=mvDistributionBuffers[level];
+        track(buffer.vNodes.capacity());
+        track(buffer.vIndices.capacity());
+        track(buffer.vScratch.capacity());
+        track(buffer.vOrder.capacity());
+        track(buffer.vOrderTmp.capacity());
+        track(buffer.vFront.capacity());
+        track(buffer.vSizeAndNode.capacity());
+        track(buffer.vPrevSizeAndNode.capacity());
+        //ANMS/SSC/网格分配方式的缓存
+        track(buffer.vGrid.capacity());
+        track(buffer.vNext.capacity());
+        track(buffer.vRadius.capacity());
+    }
 
+    //每个网格检测到的角点
+    for (size_t cell = 0; cell < mvvCellKeys.size(); ++cell)
+    {
+        track(mvvCellKeys[cell].capacity());
+    }
 
-    }//开始遍历每一层图像
-    
-    
+    if(bRecord)
+    {
+        //容量表本身也是复用的，只在容器个数增加时才会扩容
+        mvBufferCapacity.resize(i);
+        if(mvBufferCapacity.capacity()!=tableCapacity)
+            ++mnFrameAllocations;
+    }
+    return nChanged;
 
-}
+}//ORBextractor::TrackBufferCapacities
 
 /**
- * @brief 构建图像金字塔
- * @image 输入原图像，这个输入图像所有的像素是有效的，也就是说都可以在其上边提取到fast角点
+ * @brief 根据图像尺寸分配金字塔缓存
+ * @details 所有层带边界的图像按行依次排列在同一块内存mPyramidArena中，各层图像只是其中的ROI，
+ * 因此所有层的行步长都相同；模糊后的图像使用布局相同的另一块内存mBlurArena
+ * @param[in] imageSize 输入图像（第0层）的尺寸
 */
-void ORBextractor::ComputerPyramid(cv::Mat image){
+void ORBextractor::AllocatePyramid(const cv::Size &imageSize){
 
-    //遍历所有的图层
+    mImageSize=imageSize;
+
+    mvPyramidBorder.resize(nlevels);
+    mvBlurPyramidBorder.resize(nlevels);
+    mvBlurPyramid.resize(nlevels);
+
+    //第0层最大，它的宽度就是整块内存的宽度
+    const int arenaCols=imageSize.width+EDGE_THRESHOLD*2;
+    int arenaRows=0;
+    for (int level = 0; level < nlevels; ++level)
+    {
+        arenaRows+=cvRound((float)imageSize.height*mvInvScaleFactor[level])+EDGE_THRESHOLD*2;
+    }
+
+    mPyramidArena.create(arenaRows,arenaCols,CV_8UC1);
+    mBlurArena.create(arenaRows,arenaCols,CV_8UC1);
+    mnFrameAllocations+=2;
+
+    int y=0;
     for (int level = 0; level < nlevels; ++level)
     {
         float scale = mvInvScaleFactor[level];
         //计算本层图像的像素尺寸大小
-        Size sz(cvRound((float)image.cols*scale),cvRound((float)image.rows*scale));
+        Size sz(cvRound((float)imageSize.width*scale),cvRound((float)imageSize.height*scale));
         //全尺寸图像。包括无效图像区域的大小。将图像进行“补边”，EDGE_THRESHOLD区域外的图像不进行FAST角点检测
         Size wholeSize(sz.width+EDGE_THRESHOLD*2,sz.height+EDGE_THRESHOLD*2);
-        //定义了两个变量：temp是扩展边界的图像，maketemp并未使用
-        Mat temp(wholeSize,image.type()),masktemp;
-        //mvImagePyramid刚开始时是一个空的vector<Mat>
-        //把图像金子塔该图层的图像指针mvImagePyramid指向temp的中间部分（这里为浅拷贝，内存相同）
-        mvImagePyramid[level]=temp(Rect(EDGE_THRESHOLD,EDGE_THRESHOLD,sz.width,sz.height));
+        Rect inner(EDGE_THRESHOLD,EDGE_THRESHOLD,sz.width,sz.height);
+
+        mvPyramidBorder[level]=mPyramidArena(Rect(0,y,wholeSize.width,wholeSize.height));
+        mvBlurPyramidBorder[level]=mBlurArena(Rect(0,y,wholeSize.width,wholeSize.height));
+        //mvImagePyramid指向带边界图像的中间部分（这里为浅拷贝，内存相同）
+        mvImagePyramid[level]=mvPyramidBorder[level](inner);
+        mvBlurPyramid[level]=mvBlurPyramidBorder[level](inner);
+
+        y+=wholeSize.height;
+    }
+
+    //划分检测FAST角点的网格，每层的网格在mvvCellKeys中连续存放
+    ComputeCellGrid();
+
+    //融合构建金字塔时使用的临时缓存，第0层最大
+    mvFusedBuffer.reserve(3*imageSize.width+8*arenaCols);
+
+    //所有层的行步长相同，描述子查找表只需要一张，从共享的缓存中获取
+    mpPatternOffsets=GetPatternOffsets((int)mBlurArena.step1());
+
+}//ORBextractor::AllocatePyramid
+
+/**
+ * @brief 根据各层图像的尺寸划分检测FAST角点的网格
+*/
+void ORBextractor::ComputeCellGrid(){
+
+    //网格的期望边长
+    const float W = 30;
+
+    mvnCellCols.resize(nlevels);
+    mvnCellRows.resize(nlevels);
+    mvnCellWidth.resize(nlevels);
+    mvnCellHeight.resize(nlevels);
+    mvnCellStart.resize(nlevels+1);
+    mvCellLevel.clear();
+
+    mvnCellStart[0]=0;
+    for (int level = 0; level < nlevels; ++level)
+    {
+        //检测区域的尺寸
+        const float width = mvImagePyramid[level].cols-2*EDGE_THRESHOLD+6;
+        const float height = mvImagePyramid[level].rows-2*EDGE_THRESHOLD+6;
+
+        //网格的行列数，至少一个
+        const int nCols = std::max(1,(int)(width/W));
+        const int nRows = std::max(1,(int)(height/W));
+
+        mvnCellCols[level]=nCols;
+        mvnCellRows[level]=nRows;
+        mvnCellWidth[level]=ceil(width/nCols);
+        mvnCellHeight[level]=ceil(height/nRows);
+        mvnCellStart[level+1]=mvnCellStart[level]+nCols*nRows;
+
+        mvCellLevel.insert(mvCellLevel.end(),nCols*nRows,level);
+    }
+
+    mvvCellKeys.resize(mvnCellStart[nlevels]);
+    mvCellTime.resize(mvnCellStart[nlevels]);
+    mvCellReused.assign(mvnCellStart[nlevels],0);
+    mvCellArea.assign(mvnCellStart[nlevels],0);
+    mvCellValidArea.assign(mvnCellStart[nlevels],0);
+    mvCellMaskSignature.assign(mvnCellStart[nlevels],0);
+
+    //网格变化之后，之前的检测结果都不能复用
+    mvCellSignature.assign(mvnCellStart[nlevels]*CELL_SIGNATURE_SIZE,0);
+    mvCellThFAST.assign(mvnCellStart[nlevels],-1);
+    mvvToDistributeKeys.resize(nlevels);
+
+}//ORBextractor::ComputeCellGrid
+
+/**
+ * @brief 构建图像金字塔
+ * @image 输入原图像，这个输入图像所有的像素是有效的，也就是说都可以在其上边提取到fast角点
+*/
+void ORBextractor::ComputerPyramid(cv::Mat image){
+
+    //第一帧或者图像尺寸发生变化的时候才需要重新分配缓存
+    if(image.size()!=mImageSize)
+        AllocatePyramid(image.size());
+
+    //融合的构建方式，每层一次扫描同时得到带边界的图像和模糊图像
+    if(mbFusedPyramid)
+    {
+        const size_t capacity=mvFusedBuffer.capacity();
+        for (int level = 0; level < nlevels; ++level)
+        {
+            BuildFusedLevel(level==0?image:mvImagePyramid[level-1],level!=0,
+                            mvPyramidBorder[level],mvBlurPyramidBorder[level],mvFusedBuffer);
+        }
+        if(mvFusedBuffer.capacity()!=capacity)
+            ++mnFrameAllocations;
+        return;
+    }
+
+    //遍历所有的图层
+    for (int level = 0; level < nlevels; ++level)
+    {
+        //temp是扩展边界的图像，mvImagePyramid[level]是它的中间部分，两者都是预先分配好的缓存
+        Mat &temp=mvPyramidBorder[level];
+        const uchar* data=temp.data;
+
         //计算第0层以上的resize后的图像
         if(level!=0){
             //将上一层金子特图像根据设定sz缩放到当前层级
             resize(mvImagePyramid[level-1],//输入图像
                     mvImagePyramid[level],//输出图像
-                    sz,//输出图像的尺寸
+                    mvImagePyramid[level].size(),//输出图像的尺寸
                     0,0,//水平方向、垂直方向的缩放系数。留0表示自动计算
                     cv::INTER_LINEAR);//图像的缩放的差值算法，这里是线性差值运算
 
@@ -1061,6 +3399,9 @@ void ORBextractor::ComputerPyramid(cv::Mat image){
                             BORDER_REFLECT_101);
         }
 
+        //尺寸匹配时OpenCV会直接写入已有的内存；如果这里发生了重新分配，说明缓存没有被复用
+        if(temp.data!=data)
+            ++mnFrameAllocations;
 
     }
     
@@ -0,0 +1,236 @@
+#include "include/ORBpipeline.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+ORBpipeline::ORBpipeline(ORBextractor* pExtractor,int nCapacity,int policy):
+    mpExtractor(pExtractor),mnEnqueuePos(0),mnDequeuePos(0),mnPolicy(policy),mnNextFrameId(0),mnDropped(0),mbStop(false)
+{
+    //容量取为2的幂次，这样取模只需要一次与运算
+    unsigned long n=1;
+    while(n<(unsigned long)std::max(nCapacity,1))
+        n<<=1;
+
+    mvSlots=vector<Slot>(n);
+    for (size_t i = 0; i < mvSlots.size(); ++i)
+    {
+        mvSlots[i].nSeq=i;
+    }
+    mnMask=n-1;
+
+    mThread=thread(&ORBpipeline::Run,this);
+}
+
+ORBpipeline::~ORBpipeline()
+{
+    {
+        unique_lock<mutex> lock(mMutex);
+        mbStop=true;
+    }
+    mCondFrame.notify_all();
+    mCondSpace.notify_all();
+    mThread.join();
+
+    //还没有提取的帧都作为丢弃的帧返回，保证每个future都会就绪
+    Job job;
+    while(TryDequeue(job))
+        Drop(job);
+}
+
+bool ORBpipeline::TryEnqueue(Job &job)
+{
+    unsigned long pos=mnEnqueuePos.load(memory_order_relaxed);
+    Slot* pSlot;
+    while(true)
+    {
+        pSlot=&mvSlots[pos&mnMask];
+        const long diff=(long)pSlot->nSeq.load(memory_order_acquire)-(long)pos;
+        if(diff==0)
+        {
+            //这个位置是空的，领取它
+            if(mnEnqueuePos.compare_exchange_weak(pos,pos+1,memory_order_relaxed))
+                break;
+        }
+        else if(diff<0)
+        {
+            //这个位置上一轮的job还没有被取走，队列已满
+            return false;
+        }
+        else
+        {
+            //被其他线程抢先领取了
+            pos=mnEnqueuePos.load(memory_order_relaxed);
+        }
+    }
+
+    pSlot->job=std::move(job);
+    pSlot->nSeq.store(pos+1,memory_order_release);
+    return true;
+}
+
+bool ORBpipeline::TryDequeue(Job &job)
+{
+    unsigned long pos=mnDequeuePos.load(memory_order_relaxed);
+    Slot* pSlot;
+    while(true)
+    {
+        pSlot=&mvSlots[pos&mnMask];
+        const long diff=(long)pSlot->nSeq.load(memory_order_acquire)-(long)(pos+1);
+        if(diff==0)
+        {
+            if(mnDequeuePos.compare_exchange_weak(pos,pos+1,memory_order_relaxed))
+                break;
+        }
+        else if(diff<0)
+        {
+            //这个位置还没有写入，队列为空
+            return false;
+        }
+        else
+        {
+            pos=mnDequeuePos.load(memory_order_relaxed);
+        }
+    }
+
+    job=std::move(pSlot->job);
+    //释放槽位中对图像的引用，再把位置交给下一轮的写入
+    pSlot->job=Job();
+    pSlot->nSeq.store(pos+mnMask+1,memory_order_release);
+    return true;
+}
+
+int ORBpipeline::GetQueueSize()
+{
+    const unsigned long nEnqueue=mnEnqueuePos.load(memory_order_acquire);
+    const unsigned long nDequeue=mnDequeuePos.load(memory_order_acquire);
+    return nEnqueue>nDequeue? (int)(nEnqueue-nDequeue) : 0;
+}
+
+void ORBpipeline::SetCallback(const function<void(const ExtractedFrame&)> &callback)
+{
+    unique_lock<mutex> lock(mMutexCallback);
+    mCallback=callback;
+}
+
+future<ExtractedFrame> ORBpipeline::Push(const cv::Mat &image,const cv::Mat &mask,const double &dTimestamp)
+{
+    Job job;
+    job.nFrameId=mnNextFrameId++;
+    job.dTimestamp=dTimestamp;
+    job.image=image;
+    job.mask=mask;
+    job.pPromise=make_shared<promise<ExtractedFrame> >();
+    future<ExtractedFrame> result=job.pPromise->get_future();
+
+    //TryEnqueue只在成功时移走job，失败时job保持不变，可以直接丢弃或者重试
+    while(!TryEnqueue(job))
+    {
+        if(mbStop)
+        {
+            Drop(job);
+            return result;
+        }
+
+        if(mnPolicy==QUEUE_DROP_NEWEST)
+        {
+            Drop(job);
+            return result;
+        }
+        else if(mnPolicy==QUEUE_DROP_OLDEST)
+        {
+            //取出最早的一帧丢弃，给新的帧腾出位置；如果这期间提取线程已经取走了，直接重试
+            Job oldest;
+            if(TryDequeue(oldest))
+                Drop(oldest);
+        }
+        else
+        {
+            //反压：等待提取线程取走一帧
+            unique_lock<mutex> lock(mMutex);
+            mCondSpace.wait(lock,[this]{ return mbStop || GetQueueSize()<=(int)mnMask; });
+        }
+    }
+
+    //加锁是为了避免提取线程检查完队列、开始等待之前的通知丢失
+    {
+        unique_lock<mutex> lock(mMutex);
+    }
+    mCondFrame.notify_one();
+
+    return result;
+}
+
+void ORBpipeline::Finish(Job &job,ExtractedFrame &frame)
+{
+    function<void(const ExtractedFrame&)> callback;
+    {
+        unique_lock<mutex> lock(mMutexCallback);
+        callback=mCallback;
+    }
+    if(callback)
+        callback(frame);
+
+    job.pPromise->set_value(std::move(frame));
+}
+
+void ORBpipeline::Drop(Job &job)
+{
+    //丢弃的帧只设置future，不调用回调函数，这样回调函数总是在提取线程中按帧的顺序被调用
+    ExtractedFrame frame;
+    frame.nFrameId=job.nFrameId;
+    frame.dTimestamp=job.dTimestamp;
+    frame.bDropped=true;
+    ++mnDropped;
+    job.pPromise->set_value(std::move(frame));
+}
+
+void ORBpipeline::Run()
+{
+    while(true)
+    {
+        //停止时不再提取新的帧，剩下的由析构函数丢弃
+        if(mbStop)
+            return;
+
+        Job job;
+        if(!TryDequeue(job))
+        {
+            unique_lock<mutex> lock(mMutex);
+            //队列中的帧可能已经领取了位置但还没有写完，这时GetQueueSize大于0，会很快重新尝试
+            mCondFrame.wait(lock,[this]{ return mbStop || GetQueueSize()>0; });
+            continue;
+        }
+
+        //队列有了空位，通知阻塞的Push
+        {
+            unique_lock<mutex> lock(mMutex);
+        }
+        mCondSpace.notify_one();
+
+        ExtractedFrame frame;
+        frame.nFrameId=job.nFrameId;
+        frame.dTimestamp=job.dTimestamp;
+        try
+        {
+            (*mpExtractor)(job.image,job.mask,frame.vKeys,frame.descriptors);
+        }
+        catch(...)
+        {
+            //提取出错时异常通过future交给调用者
+            job.pPromise->set_exception(current_exception());
+            continue;
+        }
+
+        //不再需要图像，尽早释放引用
+        job.image.release();
+        job.mask.release();
+
+        Finish(job,frame);
+    }
+}
+
+}//namespace ORB_SLAM2
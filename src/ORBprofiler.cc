@@ -0,0 +1,180 @@
+#include "include/ORBprofiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <iomanip>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+ORBprofiler::ORBprofiler(int nCapacity):mnMask(0),mnHead(0)
+{
+    //不记录时不需要缓冲区
+    if(nCapacity<=0)
+        return;
+
+    //容量取为2的幂次，这样取模只需要一次与运算
+    unsigned long n=1;
+    while(n<(unsigned long)nCapacity)
+        n<<=1;
+
+    mvSlots=vector<Slot>(n);
+    for (size_t i = 0; i < mvSlots.size(); ++i)
+    {
+        mvSlots[i].nSeq=0;
+    }
+    mnMask=n-1;
+}
+
+void ORBprofiler::Push(const int &nFrame,const int &nStage,const int &nLevel,const int &nKeys,const double &dTime)
+{
+    if(mvSlots.empty())
+        return;
+
+    //领取一个写入序号，之后只写自己的那个位置，不需要加锁
+    const unsigned long n=mnHead.fetch_add(1,memory_order_relaxed);
+    Slot &slot=mvSlots[n&mnMask];
+
+    //先标记为正在写入，再写记录，最后写入完成的序号
+    slot.nSeq.store(2*n+1,memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot.record.nFrame=nFrame;
+    slot.record.nStage=nStage;
+    slot.record.nLevel=nLevel;
+    slot.record.nKeys=nKeys;
+    slot.record.dTime=dTime;
+
+    slot.nSeq.store(2*n+2,memory_order_release);
+}
+
+vector<ORBprofiler::Record> ORBprofiler::Snapshot()
+{
+    vector<Record> vRecords;
+    if(mvSlots.empty())
+        return vRecords;
+
+    const unsigned long nHead=mnHead.load(memory_order_acquire);
+    const unsigned long nCapacity=mnMask+1;
+    const unsigned long nBegin=nHead>nCapacity? nHead-nCapacity : 0;
+    vRecords.reserve(nHead-nBegin);
+
+    for (unsigned long n = nBegin; n < nHead; ++n)
+    {
+        Slot &slot=mvSlots[n&mnMask];
+        //序号不对说明这条记录还没有写完，或者已经被更新的记录覆盖
+        const unsigned long nSeq=slot.nSeq.load(memory_order_acquire);
+        if(nSeq!=2*n+2)
+            continue;
+
+        Record record=slot.record;
+
+        //读取的过程中被覆盖了
+        atomic_thread_fence(memory_order_acquire);
+        if(slot.nSeq.load(memory_order_relaxed)!=nSeq)
+            continue;
+
+        vRecords.push_back(record);
+    }
+
+    return vRecords;
+}
+
+//排好序的数组中的百分位数（最近秩法）
+static double Percentile(const vector<double> &vSorted,const double &p)
+{
+    if(vSorted.empty())
+        return 0;
+    int idx=(int)ceil(p*vSorted.size())-1;
+    idx=std::min(std::max(idx,0),(int)vSorted.size()-1);
+    return vSorted[idx];
+}
+
+vector<ORBprofiler::Statistics> ORBprofiler::ComputeStatistics()
+{
+    const vector<Record> vRecords=Snapshot();
+
+    //按照(阶段,层)分组，map保证输出按阶段、层的顺序排列
+    map<pair<int,int>,vector<const Record*> > mGroups;
+    for (size_t i = 0; i < vRecords.size(); ++i)
+    {
+        mGroups[make_pair(vRecords[i].nStage,vRecords[i].nLevel)].push_back(&vRecords[i]);
+    }
+
+    vector<Statistics> vStatistics;
+    vStatistics.reserve(mGroups.size());
+
+    vector<double> vTimes;
+    for(map<pair<int,int>,vector<const Record*> >::iterator mit=mGroups.begin();mit!=mGroups.end();++mit)
+    {
+        const vector<const Record*> &vGroup=mit->second;
+
+        Statistics stat;
+        stat.nStage=mit->first.first;
+        stat.nLevel=mit->first.second;
+        stat.nCount=(int)vGroup.size();
+
+        vTimes.clear();
+        double sumTime=0,sumKeys=0;
+        for (size_t i = 0; i < vGroup.size(); ++i)
+        {
+            vTimes.push_back(vGroup[i]->dTime);
+            sumTime+=vGroup[i]->dTime;
+            sumKeys+=vGroup[i]->nKeys;
+        }
+        sort(vTimes.begin(),vTimes.end());
+
+        stat.dMean=sumTime/stat.nCount;
+        stat.dP50=Percentile(vTimes,0.5);
+        stat.dP90=Percentile(vTimes,0.9);
+        stat.dP99=Percentile(vTimes,0.99);
+        stat.dMax=vTimes.back();
+        stat.dMeanKeys=sumKeys/stat.nCount;
+
+        vStatistics.push_back(stat);
+    }
+
+    return vStatistics;
+}
+
+void ORBprofiler::Dump(ostream &os)
+{
+    const vector<Statistics> vStatistics=ComputeStatistics();
+
+    os<<"stage         level  count     mean      p50      p90      p99      max    keys"<<endl;
+    for (size_t i = 0; i < vStatistics.size(); ++i)
+    {
+        const Statistics &stat=vStatistics[i];
+        os<<left<<setw(14)<<GetStageName(stat.nStage)<<right
+          <<setw(5)<<stat.nLevel
+          <<setw(7)<<stat.nCount
+          <<fixed<<setprecision(3)
+          <<setw(9)<<stat.dMean
+          <<setw(9)<<stat.dP50
+          <<setw(9)<<stat.dP90
+          <<setw(9)<<stat.dP99
+          <<setw(9)<<stat.dMax
+          <<setprecision(1)
+          <<setw(8)<<stat.dMeanKeys<<endl;
+    }
+}
+
+void ORBprofiler::Clear()
+{
+    //跳过当前所有的序号，已有的记录在Snapshot中都会被认为是旧的。
+    //必须是一次原子加法，分开读写会丢掉并发的Push取得的序号，两条记录可能写到同一个位置
+    mnHead.fetch_add(mnMask+1,memory_order_acq_rel);
+}
+
+const char* ORBprofiler::GetStageName(const int &nStage)
+{
+    static const char* names[NUM_STAGES]={"pyramid","detect","distribute","orientation","blur","descriptor","total"};
+    if(nStage<0 || nStage>=NUM_STAGES)
+        return "unknown";
+    return names[nStage];
+}
+
+}//namespace ORB_SLAM2
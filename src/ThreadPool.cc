@@ -0,0 +1,119 @@
+#include "include/ThreadPool.h"
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+ThreadPool::ThreadPool(int nThreads):mpJobs(NULL),mbStop(false)
+{
+    //调用ParallelFor的线程本身也参与计算，所以只需要创建nThreads-1个工作线程
+    for (int i = 1; i < nThreads; ++i)
+    {
+        mvThreads.push_back(thread(&ThreadPool::Run,this));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        unique_lock<mutex> lock(mMutex);
+        mbStop=true;
+    }
+    mCondJob.notify_all();
+
+    for (size_t i = 0; i < mvThreads.size(); ++i)
+    {
+        mvThreads[i].join();
+    }
+}
+
+void ThreadPool::RunJob(Job &job)
+{
+    int i;
+    //原子地领取任务编号，保证每个任务只被执行一次
+    while((i=job.next++)<job.n)
+    {
+        (*job.pFunc)(i);
+    }
+}
+
+void ThreadPool::Run()
+{
+    while(true)
+    {
+        Job* pJob=NULL;
+        {
+            unique_lock<mutex> lock(mMutex);
+            //等待，直到有尚未被领取完的job或者线程池被析构
+            mCondJob.wait(lock,[this,&pJob]{
+                if(mbStop)
+                    return true;
+                for(Job* p=mpJobs;p;p=p->pNext)
+                {
+                    if(p->next<p->n)
+                    {
+                        pJob=p;
+                        return true;
+                    }
+                }
+                return false;
+            });
+
+            if(mbStop)
+                return;
+
+            //job在ParallelFor的栈上，登记之后ParallelFor会等到这个线程离开才返回
+            pJob->nWorkers++;
+        }
+        RunJob(*pJob);
+
+        unique_lock<mutex> lock(mMutex);
+        if(--pJob->nWorkers==0)
+            mCondDone.notify_all();
+    }
+}
+
+void ThreadPool::ParallelFor(int n,const function<void(int)> &f)
+{
+    if(n<=0)
+        return;
+
+    //没有工作线程或者只有一个任务时，直接串行执行
+    if(mvThreads.empty() || n==1)
+    {
+        for (int i = 0; i < n; ++i)
+            f(i);
+        return;
+    }
+
+    Job job;
+    job.pFunc=&f;
+    job.n=n;
+    job.next=0;
+    job.nWorkers=0;
+    {
+        unique_lock<mutex> lock(mMutex);
+        job.pNext=mpJobs;
+        mpJobs=&job;
+    }
+    mCondJob.notify_all();
+
+    //调用线程自己也参与计算
+    RunJob(job);
+
+    unique_lock<mutex> lock(mMutex);
+    //此时所有任务都已经被领取了，不需要再让工作线程看到这个job
+    for(Job** pp=&mpJobs;*pp;pp=&(*pp)->pNext)
+    {
+        if(*pp==&job)
+        {
+            *pp=job.pNext;
+            break;
+        }
+    }
+    //等待领取了任务的工作线程执行完成，之后job才可以随栈释放
+    mCondDone.wait(lock,[&job]{ return job.nWorkers==0; });
+}
+
+}//namespace ORB_SLAM2